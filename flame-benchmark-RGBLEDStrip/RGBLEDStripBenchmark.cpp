@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Measure the number of CPU cycles per pixel taken by the RGBLEDStrip colour kernels
+ * Timer 1 is run directly from the CPU clock, so the counts are cycles
+ */
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the FLAME Serial header
+#include <flame/HardwareSerial.h>
+
+// Bring in the AVR interrupt header (needed for cli)
+#include <avr/interrupt.h>
+
+// Bring in the AVR PROGMEM header, needed to store data in PROGMEM
+#include <avr/pgmspace.h>
+
+// Bring in stdio, required for snprintf
+#include <stdio.h>
+
+// Bring in the strip header
+#include <flame/RGBLEDStrip.h>
+
+using namespace flame;
+
+// The number of LEDs in the strip
+#define LEDS	300
+
+/* Declare the serial object on UART0
+ * Set the baud rate to 115,200
+ */
+FLAME_HARDWARESERIAL_CREATE(serial, 1, 1, FLAME_USART0, 115200);
+
+RGBLEDStrip<LEDS> strip;
+RGBLEDStrip<LEDS> overlay;
+
+/**
+ * Start counting cycles
+ */
+void startCounting() {
+	TCCR1A = 0;
+	TCCR1B = 0;
+	TCNT1 = 0;
+	TCCR1B = _BV(CS10);
+}
+
+/**
+ * Stop counting cycles and report the result
+ * Timer 1 is 16 bits, so a single measurement must take less than 65536 cycles
+ * @param	name	the name of the kernel being measured
+ * @param	pixels	the number of pixels that were processed
+ */
+void report(PGM_P name, uint16_t pixels = LEDS) {
+	uint16_t cycles = TCNT1;
+	TCCR1B = 0;
+
+	char buffer[80];
+	snprintf_P(buffer, sizeof(buffer), PSTR("%S: %u cycles, %u.%02u cycles per pixel\r\n"),
+			name, cycles, cycles / pixels, (uint16_t)((cycles % pixels) * 100UL / pixels));
+	serial.busyWrite(buffer);
+}
+
+MAIN {
+// Enable interrupts
+	sei();
+
+	serial.busyWrite_P(PSTR("RGBLEDStrip benchmark\r\n"));
+
+	overlay.fillGradient(RGB(0, 0, 0), RGB(64, 32, 16));
+
+// Interrupts would be counted too
+	cli();
+
+	startCounting();
+	strip.setAll(255, 128, 64);
+	report(PSTR("setAll"));
+
+	startCounting();
+	strip.scaleAll(200);
+	report(PSTR("scaleAll"));
+
+	startCounting();
+	strip.blendToward(RGB(0, 0, 255), 32);
+	report(PSTR("blendToward"));
+
+	startCounting();
+	strip.fillGradient(RGB(255, 0, 0), RGB(0, 0, 255));
+	report(PSTR("fillGradient"));
+
+	startCounting();
+	strip.fillGradientHSV(0, 255, 255, 255, 255, 128);
+	report(PSTR("fillGradientHSV"));
+
+	startCounting();
+	strip.add(overlay);
+	report(PSTR("add"));
+
+// The per pixel divisions make this too slow to time across the whole strip
+	startCounting();
+	for (uint16_t i = 0; i < 16; i++) {
+		strip.getPixel(i).fadeTo(RGB(0, 0, 0), 1, 16);
+	}
+	report(PSTR("RGB::fadeTo loop"), 16);
+
+	sei();
+
+	serial.busyWrite_P(PSTR("Benchmark complete\r\n"));
+
+	for (;;) {}
+
+	return 0;
+}
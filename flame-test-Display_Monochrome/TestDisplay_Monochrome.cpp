@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host tests for the Display_Monochrome blitters, checked pixel by pixel against a
+ * plain reference renderer, and for dumping a display as a PBM image
+ */
+
+#include <flame/Display_Monochrome_Buffered.h>
+#include <HostTest.h>
+#include <stdio.h>
+
+using namespace flame;
+
+#define COLS	21
+#define ROWS	13
+
+/**
+ * Write a display's contents as a plain PBM image (black for on pixels), top row first, to look at
+ * rendering on the host
+ * @param	display	the display to write
+ * @param	cols	the width of the display
+ * @param	rows	the height of the display
+ * @param	stream	the stream to write to
+ */
+template <class Display>
+void dump(Display &display, uint16_t cols, uint16_t rows, FILE *stream) {
+	fprintf(stream, "P1\n%u %u\n", cols, rows);
+
+	for (uint16_t y = rows; y-- > 0;) {
+		for (uint16_t x = 0; x < cols; ++x) {
+			fputc(display.getPixel(x, y) ? '1' : '0', stream);
+			fputc((x + 1 < cols) ? ' ' : '\n', stream);
+		}
+	}
+}
+
+/**
+ * A display that stores one byte per pixel and keeps the default, per pixel blitColumn
+ */
+class TestDisplay : public Display_Monochrome<COLS, ROWS, 1> {
+public:
+	uint8_t		pixels[COLS][ROWS];
+
+	TestDisplay() {
+		memset(pixels, 0, sizeof(pixels));
+	}
+
+	void setPixel(uint16_t col, uint16_t row, uint8_t value) {
+		if (col < COLS && row < ROWS) {
+			pixels[col][row] = value;
+		}
+	}
+
+	uint8_t getPixel(uint16_t col, uint16_t row) {
+		if (col < COLS && row < ROWS) {
+			return pixels[col][row];
+		}
+		return 0;
+	}
+
+	static bool clipSpan(int16_t *start, int16_t *length, uint16_t limit) {
+		return clip(start, length, limit);
+	}
+};
+
+/**
+ * Draw a glyph pixel by pixel, the way blitGlyph is documented to
+ * @param	reference	the pixels to draw on
+ * @param	glyph		the glyph in font layout
+ * @param	width		the width of the glyph
+ * @param	height		the height of the glyph
+ * @param	col			the column of the left side of the glyph
+ * @param	row			the row of the bottom of the glyph
+ * @param	onValue		the pixel value to use for on
+ * @param	offValue	the pixel value to use for off
+ * @param	mode		how to combine the glyph with the display
+ */
+void referenceBlit(uint8_t reference[COLS][ROWS], const uint8_t *glyph, uint8_t width, uint8_t height,
+		int16_t col, int16_t row, uint8_t onValue, uint8_t offValue, BlitMode mode) {
+	uint8_t columnBytes = (height + 7) / 8;
+
+	for (int16_t x = 0; x < width; x++) {
+		for (int16_t y = 0; y < height; y++) {
+			int16_t displayCol = col + x;
+			int16_t displayRow = row + y;
+			if (displayCol < 0 || displayCol >= COLS || displayRow < 0 || displayRow >= ROWS) {
+				continue;
+			}
+
+			bool on = glyph[x * columnBytes + y / 8] & (0x80 >> (y % 8));
+			uint8_t *pixel = &reference[displayCol][displayRow];
+			switch (mode) {
+			case BlitMode::OPAQUE:
+				*pixel = on ? onValue : offValue;
+				break;
+			case BlitMode::TRANSPARENT:
+				if (on) {
+					*pixel = onValue;
+				}
+				break;
+			case BlitMode::XOR:
+				if (on) {
+					*pixel ^= onValue;
+				}
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Draw random glyphs at every position overlapping the display, including off every edge
+ * @param	display		the display to draw on
+ * @param	name		the name of the display for the report
+ */
+template <class Display>
+void checkBlits(Display &display, const char *name) {
+	static const BlitMode modes[] = {BlitMode::OPAQUE, BlitMode::TRANSPARENT, BlitMode::XOR};
+	static const char *modeNames[] = {"opaque", "transparent", "xor"};
+	uint8_t reference[COLS][ROWS];
+	uint8_t glyph[12 * 3];
+
+	srand(1);
+	for (uint8_t m = 0; m < 3; m++) {
+		uint16_t mismatches = 0;
+		uint16_t blits = 0;
+
+		for (uint8_t height = 1; height <= 20; height += 3) {
+			for (uint8_t width = 1; width <= 12; width += 5) {
+				for (int16_t row = -(int16_t)height - 1; row <= ROWS; row++) {
+					for (int16_t col = -(int16_t)width - 1; col <= COLS; col++) {
+						// A random background, so that opaque off pixels and XOR show up
+						for (uint16_t x = 0; x < COLS; x++) {
+							for (uint16_t y = 0; y < ROWS; y++) {
+								uint8_t value = (rand() & 1) ? 255 : 0;
+								display.setPixel(x, y, value);
+								reference[x][y] = value;
+							}
+						}
+						for (uint8_t i = 0; i < sizeof(glyph); i++) {
+							glyph[i] = rand();
+						}
+
+						bool visible = display.drawBitmap(glyph, width, height, col, row, 255, 0, modes[m]);
+						referenceBlit(reference, glyph, width, height, col, row, 255, 0, modes[m]);
+						blits++;
+
+						bool expectVisible = col < COLS && col + width > 0 && row < ROWS && row + height > 0;
+						bool same = visible == expectVisible;
+						for (uint16_t x = 0; x < COLS; x++) {
+							for (uint16_t y = 0; y < ROWS; y++) {
+								same &= display.getPixel(x, y) == reference[x][y];
+							}
+						}
+						if (!same) {
+							mismatches++;
+						}
+					}
+				}
+			}
+		}
+
+		check(0 == mismatches, "%s %s blits match the reference (%u of %u differ)",
+				name, modeNames[m], mismatches, blits);
+	}
+}
+
+/**
+ * A 1 bit buffered display, using the masked byte blitColumn
+ */
+class TestBuffered1 : public Display_Monochrome_Buffered<COLS, ROWS, 1, 1> {
+};
+
+/**
+ * A 4 bit buffered display, using the per pixel blitColumn without virtual calls
+ */
+class TestBuffered4 : public Display_Monochrome_Buffered<COLS, ROWS, 1, 4> {
+};
+
+int main() {
+	static TestDisplay display;
+	static TestBuffered1 buffered1;
+	static TestBuffered4 buffered4;
+
+	checkBlits(display, "per pixel");
+	checkBlits(buffered1, "1 bit buffered");
+	checkBlits(buffered4, "4 bit buffered");
+
+	// The clip helper trims spans to the display
+	int16_t start = -3, length = 5;
+	check(TestDisplay::clipSpan(&start, &length, 10) && 0 == start && 2 == length, "clip off the low edge");
+	start = 8; length = 5;
+	check(TestDisplay::clipSpan(&start, &length, 10) && 8 == start && 2 == length, "clip off the high edge");
+	start = -5; length = 5;
+	check(!TestDisplay::clipSpan(&start, &length, 10), "clip entirely below");
+	start = 10; length = 1;
+	check(!TestDisplay::clipSpan(&start, &length, 10), "clip entirely above");
+
+	// dump() writes a plain PBM, top row first
+	static Display_Monochrome_Buffered<4, 3, 1> small;
+	small.setPixel(0, 0, 255);
+	small.setPixel(3, 2, 255);
+	small.setPixel(1, 1, 255);
+
+	char dumped[64];
+	FILE *stream = tmpfile();
+	dump(small, 4, 3, stream);
+	rewind(stream);
+	size_t read = fread(dumped, 1, sizeof(dumped) - 1, stream);
+	dumped[read] = '\0';
+	fclose(stream);
+	check(0 == strcmp(dumped, "P1\n4 3\n0 0 0 1\n0 1 0 0\n1 0 0 0\n"), "dump writes a PBM image");
+
+	return hostTestResult();
+}
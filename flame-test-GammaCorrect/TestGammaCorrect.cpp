@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host tests for the compile time gamma tables
+ */
+
+#include <flame/GammaCorrect.h>
+#include <HostTest.h>
+
+using namespace flame;
+
+/**
+ * Check that the inverse of a table undoes its correction
+ * Each value whose corrected top bits are its own comes back as is. Values that share their top bits
+ * with smaller values come back as the smallest of them, which corrects to the same top bits.
+ * @tparam	Table	the gamma table
+ * @param	name	the name of the table for the report
+ */
+template <class Table>
+void checkRoundTrip(const char *name) {
+	uint16_t exact = 0;
+	uint16_t wrong = 0;
+	uint16_t first = 0xffff;
+
+	for (uint16_t value = 0; value <= Table::inputMax; value++) {
+		uint16_t top = Table::correct(value) >> Table::inverseShift;
+		uint16_t back = Table::inverseCorrect(Table::correct(value));
+		bool smallest = value == 0 || (Table::correct(value - 1) >> Table::inverseShift) != top;
+
+		if (back == value) {
+			exact++;
+		}
+		if (smallest ? back != value :
+				back > value || (Table::correct(back) >> Table::inverseShift) != top ||
+				(back > 0 && (Table::correct(back - 1) >> Table::inverseShift) == top)) {
+			if (!wrong++) {
+				first = value;
+			}
+		}
+	}
+
+	check(!wrong, "%s inverseCorrect(correct(x)) round trips (%u exact, %u wrong, first %u)",
+			name, exact, wrong, first);
+	check(0 == Table::inverseCorrect(0) && Table::inputMax == Table::inverseCorrect(Table::outputMax),
+			"%s inverse keeps black and white", name);
+}
+
+int main() {
+	checkRoundTrip<GammaTable<250, 8, 8> >("8 -> 8");
+	checkRoundTrip<GammaTable<250, 8, 12> >("8 -> 12");
+	checkRoundTrip<GammaTable<250, 8, 16> >("8 -> 16");
+	checkRoundTrip<GammaTable<180, 8, 16> >("8 -> 16, gamma 1.8");
+
+	check(DefaultGamma::inverseCorrect(DefaultGamma::correct(200)) == 200,
+			"precalculated inverse undoes precalculated correct");
+
+	return hostTestResult();
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host tests for the RGB helpers and RGBLEDStrip colour kernels
+ */
+
+#include <flame/RGB.h>
+#include <flame/RGBLEDStrip.h>
+#include <HostTest.h>
+
+using namespace flame;
+
+/**
+ * Check that repeated blends reach the target and never overshoot it
+ * @param	from	the starting value
+ * @param	to		the target value
+ * @param	amount	the amount to blend each time
+ */
+void checkBlendReaches(uint8_t from, uint8_t to, uint8_t amount) {
+	uint8_t value = from;
+	bool overshot = false;
+	uint16_t steps;
+
+	for (steps = 0; steps < 1000 && value != to; steps++) {
+		uint8_t next = blend8(value, to, amount);
+		if ((from < to && next > to) || (from > to && next < to) || next == value) {
+			overshot = true;
+			break;
+		}
+		value = next;
+	}
+
+	check(value == to && !overshot, "blend8 %u -> %u by %u reaches the target (%u after %u steps)",
+			from, to, amount, value, steps);
+}
+
+/**
+ * Check if all channels of a colour have the same value
+ * @param	colour	the colour to check
+ * @param	value	the expected value of each channel
+ */
+bool isColour(const RGB &colour, uint8_t value) {
+	for (uint8_t channel = 0; channel < 3; channel++) {
+		if (colour.get((RGBChannel)channel) != value) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main() {
+	static const uint8_t amounts[] = {1, 8, 32, 128, 255};
+
+	for (uint8_t amount : amounts) {
+		checkBlendReaches(255, 0, amount);
+		checkBlendReaches(0, 255, amount);
+		checkBlendReaches(200, 17, amount);
+		checkBlendReaches(17, 200, amount);
+	}
+
+	// The end points are exact, and the midpoint rounds to nearest
+	bool exact = true;
+	for (uint16_t from = 0; from < 256; from++) {
+		for (uint16_t to = 0; to < 256; to++) {
+			exact &= (blend8(from, to, 0) == from) && (blend8(from, to, 255) == to);
+		}
+	}
+	check(exact, "blend8 amount 0 gives from, 255 gives to");
+	check(blend8(0, 255, 128) == 128 && blend8(255, 0, 128) == 127, "blend8 halfway rounds to nearest");
+
+	// A strip fading to black and to white gets there
+	static RGBLEDStrip<4> strip;
+	for (uint8_t amount : amounts) {
+		strip.setAll(255, 128, 3);
+		uint16_t steps;
+		for (steps = 0; steps < 1000; steps++) {
+			strip.blendToward(RGB(0, 0, 0), amount);
+		}
+		check(isColour(strip.getPixel(3), 0), "blendToward black by %u reaches black", amount);
+
+		for (steps = 0; steps < 1000; steps++) {
+			strip.blendToward(RGB(255, 255, 255), amount);
+		}
+		check(isColour(strip.getPixel(3), 255), "blendToward white by %u reaches white", amount);
+	}
+
+	return hostTestResult();
+}
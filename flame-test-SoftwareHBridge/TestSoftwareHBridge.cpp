@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host tests for the SoftwareHBridge pulse edges, with the compare match interrupts simulated tick by tick,
+ * including slow interrupts and matches that are pending together
+ */
+
+#include <flame/SoftwareHBridge.h>
+#include <HostTest.h>
+
+using namespace flame;
+
+#define TOP			1000
+#define CYCLES		40
+#define SETTLE		4
+
+TimerImplementation<FLAME_TIMER16_1, TimerMode::PWM_PHASE_CORRECT_16> timer;
+SoftwareHBridge bridge(SoftwareHBridgeType::DIRECT, timer, FLAME_PIN_B0, FLAME_PIN_B1, FLAME_PIN_B2, FLAME_PIN_B3);
+
+/**
+ * Get the count of the phase correct timer
+ * @param	tick	the ticks since the timer started
+ * @return the count, rising from 0 to TOP then falling back
+ */
+static uint16_t count(uint32_t tick) {
+	uint32_t phase = tick % (2 * TOP);
+
+	return (phase <= TOP) ? phase : 2 * TOP - phase;
+}
+
+/**
+ * Run the bridge with the interrupts simulated tick by tick
+ * Channel 1 takes priority when both flags are pending, and a flag set again before it is serviced is lost,
+ * as in the hardware. Another interrupt can hold off both for part of every cycle.
+ * @param	magnitude		the magnitude to set
+ * @param	service			the ticks each interrupt takes, the bridge switches at its start
+ * @param	blockStart		the ticks into each cycle that another interrupt starts
+ * @param	blockLength		the ticks the other interrupt takes, 0 for none
+ * @return the fraction of the time the bridge was on, after the first few cycles
+ */
+static float run(uint16_t magnitude, uint16_t service, uint16_t blockStart, uint16_t blockLength) {
+	bridge.set(SoftwareHBridgeDirection::FORWARD, magnitude);
+
+	bool flag1 = false;
+	bool flag2 = false;
+	uint32_t busyUntil = 0;
+	uint32_t on = 0;
+
+	for (uint32_t tick = 0; tick < CYCLES * 2 * TOP; tick++) {
+		uint16_t counter = count(tick);
+		uint32_t phase = tick % (2 * TOP);
+
+		if (counter == OCR1A && (phase || tick)) {
+			flag1 = true;
+		}
+		if (counter == TOP) {
+			flag2 = true;
+		}
+
+		bool blocked = phase >= blockStart && phase < (uint32_t)blockStart + blockLength;
+		if (tick >= busyUntil && !blocked && (flag1 || flag2)) {
+			TCNT1 = count(tick + 1);
+			if (flag1) {
+				flag1 = false;
+				bridge.alarm(AlarmSource::TIMER_OUTPUT_1);
+			} else {
+				flag2 = false;
+				bridge.alarm(AlarmSource::TIMER_OUTPUT_2);
+			}
+			busyUntil = tick + service;
+		}
+
+		// With fast decay, bottom 2 is only on during forward pulses
+		if (tick >= SETTLE * 2 * TOP && (PORTB & _BV(3))) {
+			on++;
+		}
+	}
+
+	return (float)on / ((CYCLES - SETTLE) * 2 * TOP);
+}
+
+int main() {
+	float fraction;
+
+	timer.setTop(TOP);
+	timer.setPrescaler(TimerPrescaler::PRESCALER_5_1);
+	bridge.setDecay(SoftwareHBridgeDecay::FAST);
+	bridge.start();
+
+	fraction = run(300, 100, 0, 0);
+	check(fraction > 0.29f && fraction < 0.31f, "30%% pulses with a quick interrupt (%.3f)", fraction);
+
+	fraction = run(900, 100, 0, 0);
+	check(fraction > 0.89f && fraction < 0.91f, "90%% pulses with a quick interrupt (%.3f)", fraction);
+
+	fraction = run(100, 100, 0, 0);
+	check(0.0f == fraction, "pulses shorter than the interrupt are left off (%.3f)", fraction);
+
+	// The top and the end of the pulse are pending together, channel 1 is serviced first
+	fraction = run(200, 50, 850, 400);
+	check(fraction > 0.19f && fraction < 0.26f, "end of pulse serviced before the top (%.3f)", fraction);
+
+	// The pulse ends while the interrupt for its start is still running, so the top and the end are pending
+	fraction = run(130, 400, 0, 0);
+	check(fraction < 0.25f, "end of pulse pending with the top after a slow start (%.3f)", fraction);
+
+	// The start, top and end of the pulse all happen while another interrupt runs
+	fraction = run(200, 50, 750, 500);
+	check(fraction < 0.05f, "whole pulse pending at once is dropped (%.3f)", fraction);
+
+	// The next cycle's pulses are still the right way round
+	fraction = run(300, 100, 0, 0);
+	check(fraction > 0.29f && fraction < 0.31f, "30%% pulses again afterwards (%.3f)", fraction);
+
+	return hostTestResult();
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host tests for the StepperProfile speed ramps
+ */
+
+#include <flame/StepperProfile.h>
+#include <HostTest.h>
+
+using namespace flame;
+
+#define FREQUENCY		2000000
+#define MAX_STEPS		20000
+
+static uint16_t	delays[MAX_STEPS];
+
+/**
+ * Run a move to completion, recording the interval before each step
+ * @param	profile		the profile to run
+ * @param	steps		the number of steps to take
+ * @param	entrySpeed	the speed at the first step, in steps/second
+ * @param	maxSpeed	the speed to cruise at, in steps/second
+ * @param	exitSpeed	the speed at the last step, in steps/second
+ * @return the number of steps taken
+ */
+static uint32_t run(StepperProfile &profile, uint32_t steps, uint16_t entrySpeed, uint16_t maxSpeed, uint16_t exitSpeed) {
+	uint32_t taken = 0;
+
+	profile.start(steps, entrySpeed, maxSpeed, exitSpeed);
+	uint16_t delay = profile.delay();
+	while (delay && taken < MAX_STEPS) {
+		delays[taken++] = delay;
+		delay = profile.next();
+	}
+
+	return taken;
+}
+
+/**
+ * Count the steps where the interval gets shorter, longer, or stays the same
+ * @param	from		the first step to look at
+ * @param	to			one past the last step to look at
+ * @param	faster		set to the number of steps shorter than the one before
+ * @param	slower		set to the number of steps longer than the one before
+ */
+static void trend(uint32_t from, uint32_t to, uint32_t *faster, uint32_t *slower) {
+	*faster = 0;
+	*slower = 0;
+	for (uint32_t i = from + 1; i < to; i++) {
+		if (delays[i] < delays[i - 1]) {
+			(*faster)++;
+		} else if (delays[i] > delays[i - 1]) {
+			(*slower)++;
+		}
+	}
+}
+
+int main() {
+	StepperProfile profile;
+	uint32_t faster, slower, taken;
+
+	profile.setFrequency(FREQUENCY);
+	profile.setAcceleration(1000);
+
+	// Accelerate from rest, cruise, and decelerate back to rest
+	taken = run(profile, 4000, 0, 1000, 0);
+	check(4000 == taken, "full move takes 4000 steps (%lu)", (unsigned long)taken);
+	check(FREQUENCY / 1000 == delays[2000], "full move cruises at 1000 steps/s (%u)", delays[2000]);
+	trend(0, 500, &faster, &slower);
+	check(0 == slower, "full move only accelerates at the start (%lu slower)", (unsigned long)slower);
+	trend(3500, taken, &faster, &slower);
+	check(0 == faster && slower > 400, "full move only decelerates at the end (%lu faster, %lu slower)",
+			(unsigned long)faster, (unsigned long)slower);
+	check(delays[taken - 1] > 8 * delays[2000], "full move ends slowly (%u)", delays[taken - 1]);
+
+	// Starting from speeds found beforehand gives the same intervals
+	profile.start(4000, profile.speed(0), profile.speed(1000), profile.speed(0));
+	taken = 0;
+	for (uint16_t delay = profile.delay(); delay && taken < MAX_STEPS; delay = profile.next()) {
+		if (delay != delays[taken]) {
+			break;
+		}
+		taken++;
+	}
+	check(4000 == taken, "full move from speeds matches (%lu steps)", (unsigned long)taken);
+
+	// Too short to cruise, so the ramps meet in the middle
+	taken = run(profile, 200, 0, 1000, 0);
+	trend(0, 100, &faster, &slower);
+	check(200 == taken && 0 == slower, "short move accelerates to the middle (%lu steps, %lu slower)",
+			(unsigned long)taken, (unsigned long)slower);
+	trend(101, taken, &faster, &slower);
+	check(0 == faster, "short move decelerates from the middle (%lu faster)", (unsigned long)faster);
+
+	// Slowing to an exit speed
+	taken = run(profile, 1000, 1000, 1000, 500);
+	check(1000 == taken, "exit move takes 1000 steps (%lu)", (unsigned long)taken);
+	check(delays[taken - 1] > 3800 && delays[taken - 1] < 4200, "exit move ends at 500 steps/s (%u)",
+			delays[taken - 1]);
+
+	// Entering too fast to stop within the move must decelerate from the first step, not cruise
+	profile.setAcceleration(1000000);
+	taken = run(profile, 10, 5000, 5000, 0);
+	trend(0, taken, &faster, &slower);
+	check(10 == taken, "fast entry takes 10 steps (%lu)", (unsigned long)taken);
+	check(FREQUENCY / 5000 == delays[0] && 0 == faster && 9 == slower,
+			"fast entry decelerates from the first step (%u to %u)", delays[0], delays[taken - 1]);
+
+	// A long, gentle ramp reaches counts where the change per step is below a tick
+	profile.setAcceleration(50);
+	taken = run(profile, MAX_STEPS, 0, 1000, 0);
+	trend(0, MAX_STEPS / 2, &faster, &slower);
+	check(MAX_STEPS == taken && 0 == slower, "long ramp only accelerates (%lu steps, %lu slower)",
+			(unsigned long)taken, (unsigned long)slower);
+	check(delays[MAX_STEPS / 2 - 1] - FREQUENCY / 1000 < 50, "long ramp nears 1000 steps/s (%u)",
+			delays[MAX_STEPS / 2 - 1]);
+
+	return hostTestResult();
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Drive a string of APA102 (or SK9822) LEDs from the hardware SPI port,
+ * refreshing in the background while the next frame is worked out
+ */
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the AVR delay header (needed for _delay_ms)
+#include <util/delay.h>
+
+// The number of LEDs in the string
+#define LEDS	300
+
+// Bring in the APA102 driver
+#include <flame/APA102.h>
+
+using namespace flame;
+
+/* Instantiate the driver on the SPI port (SCK is B5, MOSI is B3 on the ATmega328p),
+ * clocking at F_CPU/32. Asynchronous flushes take an interrupt per byte, so a slower clock
+ * leaves most of the CPU free while a frame is sent (about 20ms for 300 LEDs at 16MHz).
+ */
+APA102_SPI<FLAME_PIN_B5, FLAME_PIN_B3, LEDS, 32> apa102;
+FLAME_APA102_SPI_ASSIGN_INTERRUPTS(apa102);
+
+/**
+ * Count the frames as they finish
+ */
+class FrameCounter : public APA102Listener {
+public:
+	volatile uint16_t	frames;
+
+	FrameCounter() : frames(0) {}
+
+	void flushComplete() {
+		frames++;
+	}
+};
+
+FrameCounter counter;
+
+MAIN {
+	// SS must stay an output for the SPI port to remain the master
+	setOutput(FLAME_PIN_B2);
+
+	// Enable interrupts
+	sei();
+
+	// A plain colour, sent synchronously
+	apa102.setAll(0, 0, 64);
+	apa102.flush();
+	_delay_ms(1000);
+
+	for (;;) {
+		// Fade up from nearly nothing, using the global brightness to keep the low end smooth
+		for (uint8_t i = 0; i < 255; i++) {
+			while (apa102.busy()) {}
+			for (uint16_t led = 0; led < LEDS; led++) {
+				apa102.setPixelHighRange(led, i, i / 2, 0);
+			}
+			apa102.flushAsync(&counter);
+			_delay_ms(10);
+		}
+
+		// Spin a rainbow, the rotate is free so most of the time is spent sending
+		while (apa102.busy()) {}
+		apa102.setAllBrightness(31);
+		apa102.fillGradientHSV(0, 255, 255, 255, 255, 255);
+		for (uint16_t i = 0; i < LEDS; i++) {
+			while (apa102.busy()) {}
+			apa102.rotate(true);
+			apa102.flushAsync(&counter);
+		}
+	}
+
+	return 0;
+}
@@ -192,17 +192,16 @@ void manualTextAnimation(DISPLAY_TYPE &display) {
 	int16_t offsetX = display.getWidth() - 1;
 	int16_t offsetY = 0;
 
-	int16_t startPos = offsetX;
-
-	while (display.writeString_P(fontSansSerif8x10, &offsetX, offsetY, 1, 0, PSTR("This was a triumph!"))) {
+	// A marquee only draws the new column each step, rather than the whole string
+	Marquee marquee(fontSansSerif8x10, 0, display.getWidth() - 1, offsetY, 1, 0);
+	marquee.setText_P(PSTR("This was a triumph!"));
+	while (display.scroll(marquee)) {
 		display.flush();
 		_delay_ms(80);
-		display.clear(0);
-		offsetX = startPos--;
 	}
+	display.clear(0);
 
-	offsetX = display.getWidth() - 1;
-	startPos = offsetX;
+	int16_t startPos = offsetX;
 
 	bool toggle = true;
 	bool more = true;
@@ -0,0 +1,78 @@
+/* Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Drive a 128x64 SSD1306 OLED display from the hardware SPI port,
+ * sending only the parts of the display that change
+ */
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the AVR delay header (needed for _delay_ms)
+#include <util/delay.h>
+
+#include <stdio.h>
+#include <flame/Font_SansSerif_10x8.h>
+
+// Bring in the OLED driver
+#include <flame/Display_SSD1306.h>
+
+using namespace flame;
+
+/* Instantiate the driver on the SPI port (SCK is B5, MOSI is B3 on the ATmega328p),
+ * with the data/command line on B1 and chip select on B2 (SS, so the port stays the master)
+ */
+Display_SSD1306_SPI<128, 64, 1, SSD1306Controller::SSD1306,
+		FLAME_PIN_B5, FLAME_PIN_B3, FLAME_PIN_B1, FLAME_PIN_B2> oled;
+FLAME_SSD1306_SPI_ASSIGN_INTERRUPTS(oled);
+
+MAIN {
+	char text[8];
+	uint16_t count = 0;
+
+	// Enable interrupts
+	sei();
+
+	oled.init();
+	oled.clear(0);
+
+	// The heading is drawn once, so it is only sent by the first flush
+	int16_t x = 0;
+	oled.writeString(fontSansSerif8x10, &x, 50, 255, 0, "Counting");
+	oled.flush();
+
+	for (;;) {
+		// Only the columns under the counter change, so each flush sends a couple of short spans
+		while (oled.busy()) {}
+		snprintf(text, sizeof(text), "%5u", count++);
+		x = 40;
+		oled.writeString(fontSansSerif8x10, &x, 20, 255, 0, text);
+		oled.flushAsync(NULL);
+		_delay_ms(100);
+	}
+
+	return 0;
+}
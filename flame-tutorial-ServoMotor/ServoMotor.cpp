@@ -56,14 +56,14 @@ FLAME_TIMER_ASSIGN_1INTERRUPT(servoTimer, FLAME_TIMER1_INTERRUPTS);
 ServoControl<SERVO_COUNT> servos(servoTimer);
 
 class MoveServos: public TimerListener {
-#define SERVO_INCREMENT 1000
+#define SERVO_MOVE_TIME 800
 	void alarm(UNUSED AlarmSource source) {
-		static uint16_t position = 0;
+		static bool atEnd = false;
 
-// Increment the servo, we don't mind if it wraps, the motor will just move back to the start
-		position += SERVO_INCREMENT;
+// Swing the servo from one end to the other, the servo controller moves it smoothly in the background
+		atEnd = !atEnd;
 
-		servos.positionServo(0, position);
+		servos.easeServo(0, atEnd ? 65535 : 0, SERVO_MOVE_TIME, ServoEasing::IN_OUT);
 	}
 };
 
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Drive a DC motor with an H bridge built from discrete transistors, ramping it up & down in each direction
+ *
+ * The PWM is centre aligned, and the motor current is sampled in the middle of each pulse,
+ * cutting the pulse short if it exceeds the limit.
+ *
+ * Connections:
+ *   D4	top transistor of side 1
+ *   D5	bottom transistor of side 1
+ *   D6	top transistor of side 2
+ *   D7	bottom transistor of side 2
+ *   C0	current sense amplifier output (ADC channel 0)
+ */
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the FLAME timer header
+#include <flame/Timer.h>
+
+// Bring in the H bridge header
+#include <flame/SoftwareHBridge.h>
+
+// Bring in the AVR interrupt header (needed for cli)
+#include <avr/interrupt.h>
+
+// Bring in the power management header
+#include <avr/power.h>
+#include <avr/sleep.h>
+
+using namespace flame;
+
+// An 8 bit timer to ramp the motor speed
+TimerImplementation<FLAME_TIMER8_2, TimerMode::REPETITIVE>rampTimer;
+FLAME_TIMER_ASSIGN_1INTERRUPT(rampTimer, FLAME_TIMER2_INTERRUPTS);
+
+/* The bridge timer, this must be Timer 1 for current sensing
+ * The H bridge uses both channels, so we must assign both interrupts
+ */
+TimerImplementation<FLAME_TIMER16_1, TimerMode::PWM_PHASE_CORRECT_16>bridgeTimer;
+FLAME_TIMER_ASSIGN_2INTERRUPTS(bridgeTimer, FLAME_TIMER1_INTERRUPTS);
+
+/* The maximum value of the PWM
+ * PWM frequency = F_CPU / 2 / PWM_TOP
+ *               = 16,000,000 / 2 / 400
+ *               = 20KHz
+ */
+#define PWM_TOP 400
+
+// How much to change the magnitude by each time the ramp timer fires
+#define PWM_INCREMENT 2
+
+// The minimum time between one transistor of a side turning off and the other turning on
+#define DEAD_TIME_NS 500
+
+// The highest allowable current sense reading (out of 1023)
+#define CURRENT_LIMIT 600
+
+// The H bridge, with P channel top transistors driven directly from the pins
+SoftwareHBridge bridge(SoftwareHBridgeType::DIRECT, bridgeTimer,
+		FLAME_PIN_D4, FLAME_PIN_D5, FLAME_PIN_D6, FLAME_PIN_D7);
+FLAME_SOFTWAREHBRIDGE_ASSIGN_ADC_INTERRUPT(bridge);
+
+/* Ramp the motor up to full speed & back down, then do the same in the other direction
+ */
+class Ramp : public TimerListener {
+private:
+	bool		_forward = true;
+	bool		_up = true;
+	uint16_t	_magnitude = 0;
+
+public:
+	void alarm(UNUSED AlarmSource source) {
+		if (_up) {
+			_magnitude += PWM_INCREMENT;
+			if (_magnitude >= PWM_TOP) {
+				_up = false;
+			}
+		} else {
+			_magnitude -= PWM_INCREMENT;
+			if (0 == _magnitude) {
+				_up = true;
+				_forward = !_forward;
+			}
+		}
+
+		bridge.set(_forward ? SoftwareHBridgeDirection::FORWARD : SoftwareHBridgeDirection::BACKWARD, _magnitude);
+	}
+};
+
+Ramp ramp;
+
+MAIN {
+	// Disable all peripherals and enable just what we need
+	power_all_disable();
+	power_timer2_enable();
+	power_timer1_enable();
+	power_adc_enable();
+	set_sleep_mode(SLEEP_MODE_IDLE);
+
+	// Set up the bridge timer
+	bridgeTimer.setPrescaler(TimerPrescaler::PRESCALER_5_1);
+	bridgeTimer.setTop(PWM_TOP);
+
+	/* Short the motor through the bottom transistors between pulses,
+	 * use SoftwareHBridgeDecay::FAST to let the current decay through the diodes instead
+	 */
+	bridge.setDecay(SoftwareHBridgeDecay::SLOW);
+	bridge.setDeadTime(DEAD_TIME_NS);
+
+	/* Sample the current in the middle of each pulse
+	 * With a prescaler of 16 the ADC clock is 1MHz, so the sample is ready 13.5us into the pulse
+	 */
+	bridge.senseCurrent(ADCChannel::CHANNEL_0, ADCReference::AVCC, ADCPrescaler::DIVIDE_BY_16, CURRENT_LIMIT);
+
+	bridge.set(SoftwareHBridgeDirection::FORWARD, 0);
+	bridge.start();
+
+	// Change the speed every 20ms
+	(void) rampTimer.setTimes(20000UL, 0);
+	rampTimer.setListener1(ramp);
+	rampTimer.enable();
+
+	// Enable interrupts
+	sei();
+
+	for (;;) {
+		sleep_mode();
+	}
+
+	return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ *  License: GNU GPL v2 (see flame-Vusb-Keyboard/vusb/License.txt)
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Demonstrates how to drive 16 LEDs with the compile time software PWM driver,
+ * the LEDs fade in sequence
+ */
+
+
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the AVR delay header (needed for _delay_ms)
+#include <util/delay.h>
+
+// Bring in the power management header
+#include <avr/power.h>
+
+// Bring in the SoftwarePWM header
+#include <flame/SoftwarePWM.h>
+
+using namespace flame;
+
+// The timer for PWM control
+TimerImplementation<FLAME_TIMER8_2, TimerMode::REPETITIVE> pwmTimer;
+FLAME_TIMER_ASSIGN_1INTERRUPT(pwmTimer, FLAME_TIMER2_INTERRUPTS);
+
+#define PWM_STEPS	64
+#define PWM_CHANNELS	16
+
+// The pins are fixed at compile time, so each port is written once per step
+SoftwarePWMPinSet<PWM_STEPS,
+	SoftwarePWMChannel<FLAME_PIN_B0>, SoftwarePWMChannel<FLAME_PIN_B1>,
+	SoftwarePWMChannel<FLAME_PIN_B2>, SoftwarePWMChannel<FLAME_PIN_B3>,
+	SoftwarePWMChannel<FLAME_PIN_B4>, SoftwarePWMChannel<FLAME_PIN_B5>,
+	SoftwarePWMChannel<FLAME_PIN_C0>, SoftwarePWMChannel<FLAME_PIN_C1>,
+	SoftwarePWMChannel<FLAME_PIN_C2>, SoftwarePWMChannel<FLAME_PIN_C3>,
+	SoftwarePWMChannel<FLAME_PIN_C4>, SoftwarePWMChannel<FLAME_PIN_C5>,
+	SoftwarePWMChannel<FLAME_PIN_D2>, SoftwarePWMChannel<FLAME_PIN_D3>,
+	SoftwarePWMChannel<FLAME_PIN_D4>, SoftwarePWMChannel<FLAME_PIN_D5>
+	> pwm;
+
+MAIN {
+	power_all_disable();
+	power_timer2_enable();
+
+	// Configure the PWM timer, 64 steps at 1kHz = 64kHz, 2MHz / 31 - 8,30
+	pwmTimer.setPeriods(TimerPrescaler::PRESCALER_7_8, 30, 0);
+	pwmTimer.setListener1(pwm);
+	pwmTimer.enable();
+
+	sei();
+
+	uint8_t phase = 0;
+	for (;;) {
+		for (uint8_t channel = 0; channel < PWM_CHANNELS; channel++) {
+			uint8_t level = (phase + channel * (2 * PWM_STEPS / PWM_CHANNELS)) % (2 * PWM_STEPS);
+			if (level > PWM_STEPS) {
+				level = 2 * PWM_STEPS - level;
+			}
+			pwm.setDutyCycle(channel, level);
+		}
+		phase++;
+
+		_delay_ms(10);
+	}
+
+	return 0;
+}
@@ -38,7 +38,8 @@ TimerImplementation<FLAME_TIMER8_2, TimerMode::REPETITIVE> pwmTimer;
 FLAME_TIMER_ASSIGN_1INTERRUPT(pwmTimer, FLAME_TIMER2_INTERRUPTS);
 
 #define PWM_LISTENER_COUNT	5
-SoftwarePWM<PWM_LISTENER_COUNT> pwm(pwmTimer);
+// Only interrupt on the edges, all the LEDs are on port B so each edge is a single write
+SoftwarePWM<PWM_LISTENER_COUNT, SoftwarePWMMode::EDGES> pwm(pwmTimer);
 
 SoftwarePWMPin<FLAME_PIN_B0> led1;
 SoftwarePWMPin<FLAME_PIN_B1> led2;
@@ -50,8 +51,9 @@ MAIN {
 	power_all_disable();
 	power_timer2_enable();
 
-	// Configure the PWM timer, for ~60 fps, 256 levels = ~16kHz  - 64,20
-	pwmTimer.setPeriods(TimerPrescaler::PRESCALER_7_64, 20, 0);
+	// Configure the PWM timer, one timer count per level so a whole period fits the 8 bit timer,
+	// 256 levels of 16us = ~244Hz - 256,0
+	pwmTimer.setPeriods(TimerPrescaler::PRESCALER_7_256, 0, 0);
 	pwmTimer.setListener1(pwm);
 	pwmTimer.enable();
 
@@ -66,6 +68,7 @@ MAIN {
 	led3.setDutyCycle(64);
 	led4.setDutyCycle(128);
 	led5.setDutyCycle(255);
+	pwm.update();
 
 	sei();
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ *  License: GNU GPL v2 (see flame-Vusb-Keyboard/vusb/License.txt)
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Demonstrates how to move a stepper motor with acceleration, taking the steps from a timer interrupt
+ */
+
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the Stepper driver
+#include <flame/StepperMotorUnipolar.h>
+
+// Bring in the Stepper controller
+#include <flame/StepperController.h>
+
+// Bring in the power management header
+#include <avr/power.h>
+#include <avr/sleep.h>
+
+// Bring in the timer header
+#include <flame/Timer.h>
+
+using namespace flame;
+
+// The timer that steps the motor
+TimerImplementation<FLAME_TIMER16_1, TimerMode::REPETITIVE> stepTimer;
+FLAME_TIMER_ASSIGN_1INTERRUPT(stepTimer, FLAME_TIMER1_INTERRUPTS);
+
+/* The motor & control circuitry limit the speed, the 28BYJ48 will stall above about 1000 half steps/second,
+ * but accelerating gently lets it get closer to that than starting at full speed
+ */
+#define MAX_SPEED		900
+#define ACCELERATION	1500
+
+/* The steps per rotation
+ * For the 28BYJ48 geared stepper, this is 32 steps multiplied by a gear ratio of 64,
+ * multiplied by 2 since we are half stepping
+ */
+#define STEPS_PER_ROTATION	(2*32*64)
+
+/* The stepper driver
+ * Available modes are WAVE, FULL and HALF
+ */
+StepperMotorUnipolar<StepperMode::HALF, FLAME_PIN_B0> stepper;
+
+// The controller that generates the steps
+StepperController controller(stepTimer, stepper);
+
+
+/* A class that tells the stepper what to do next
+ * Note that moveComplete() is called from the timer interrupt every time a move is complete
+ */
+class StepperInstructions : public StepperListener {
+private:
+	bool	_forward;		// The direction we are currently rotating
+
+public:
+	StepperInstructions();
+	void moveComplete(int32_t position);
+};
+
+StepperInstructions::StepperInstructions() :
+	_forward(true) {}
+
+/**
+ * Called when a motor movement is complete
+ * @param position	the current position of the motor (unused)
+ */
+void StepperInstructions::moveComplete(UNUSED int32_t position) {
+	_forward = !_forward;
+
+	controller.moveTo((_forward) ? 1 * STEPS_PER_ROTATION : 0);
+}
+
+StepperInstructions stepperInstructions;
+
+
+MAIN {
+	// Disable all peripherals and enable just what we need
+	power_all_disable();
+	power_timer1_enable();
+
+	// Register the listener with the stepper controller to be notified when moves are complete
+	controller.registerListener(stepperInstructions);
+
+	// Run the step timer at 2MHz (at 16MHz), the controller sets the period of each step
+	stepTimer.setPeriods(TimerPrescaler::PRESCALER_5_8, 0, 0, 0);
+
+	controller.setMaxSpeed(MAX_SPEED);
+	controller.setAcceleration(ACCELERATION);
+
+	sei();
+
+	/* Start with a forward rotation of 1 revolution
+	 * Further instructions will be triggered from StepperInstructions::moveComplete
+	 */
+	controller.moveTo(1 * STEPS_PER_ROTATION);
+
+	for (;;) {
+		sleep_mode();
+	}
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ *  License: GNU GPL v2 (see flame-Vusb-Keyboard/vusb/License.txt)
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Demonstrates how to microstep a bipolar stepper motor through 2 H bridges (eg, an L298N module),
+ * dropping to a lower holding current whenever the motor stops
+ *
+ * Connections:
+ *   D4 & D5	IN1 & IN2 (coil A)
+ *   D6 & D7	IN3 & IN4 (coil B)
+ *   B3			ENA (PWM for coil A)
+ *   D3			ENB (PWM for coil B)
+ */
+
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the Stepper driver
+#include <flame/StepperMotorBipolar.h>
+
+// Bring in the Stepper controller
+#include <flame/StepperController.h>
+
+// Bring in the power management header
+#include <avr/power.h>
+#include <avr/sleep.h>
+
+// Bring in the timer header
+#include <flame/Timer.h>
+
+using namespace flame;
+
+// The timer that steps the motor
+TimerImplementation<FLAME_TIMER16_1, TimerMode::REPETITIVE> stepTimer;
+FLAME_TIMER_ASSIGN_1INTERRUPT(stepTimer, FLAME_TIMER1_INTERRUPTS);
+
+// The timer that generates the PWM for the bridge enables, phase correct PWM at 31kHz (at 16MHz) is inaudible
+TimerImplementation<FLAME_TIMER8_2, TimerMode::PWM_PHASE_CORRECT_2_OUTPUT_8> pwmTimer;
+
+// The number of microsteps per full step
+#define MICROSTEPS		8
+
+/* The steps per rotation
+ * Most bipolar steppers (eg, NEMA17) have 200 full steps per rotation
+ */
+#define STEPS_PER_ROTATION	(200 * MICROSTEPS)
+
+#define MAX_SPEED		(2 * STEPS_PER_ROTATION)
+#define ACCELERATION	(4 * STEPS_PER_ROTATION)
+
+// The coil currents, as a fraction of 255
+#define RUN_CURRENT		200
+#define HOLD_CURRENT	60
+
+// The stepper driver
+StepperMotorBipolar<MICROSTEPS, FLAME_PIN_D4, FLAME_PIN_D5, FLAME_PIN_D6, FLAME_PIN_D7> stepper(pwmTimer);
+
+// The controller that generates the steps
+StepperController controller(stepTimer, stepper);
+
+
+/* A class that tells the stepper what to do next
+ * Note that moveComplete() is called from the timer interrupt every time a move is complete
+ */
+class StepperInstructions : public StepperListener {
+private:
+	bool	_forward;		// The direction we are currently rotating
+
+public:
+	StepperInstructions();
+	void moveComplete(int32_t position);
+};
+
+StepperInstructions::StepperInstructions() :
+	_forward(true) {}
+
+/**
+ * Called when a motor movement is complete
+ * @param position	the current position of the motor (unused)
+ */
+void StepperInstructions::moveComplete(UNUSED int32_t position) {
+	_forward = !_forward;
+
+	controller.moveTo((_forward) ? 1 * STEPS_PER_ROTATION : 0);
+}
+
+StepperInstructions stepperInstructions;
+
+
+MAIN {
+	// Disable all peripherals and enable just what we need
+	power_all_disable();
+	power_timer1_enable();
+	power_timer2_enable();
+
+	// Start the PWM for the bridge enables, at the full clock rate
+	setOutput(FLAME_PIN_TIMER_2_A);
+	setOutput(FLAME_PIN_TIMER_2_B);
+	pwmTimer.connectOutput1(TimerConnect::CLEAR);
+	pwmTimer.connectOutput2(TimerConnect::CLEAR);
+	pwmTimer.setPeriods(TimerPrescaler::PRESCALER_7_1, 0, 0, 0);
+
+	// Energise the coils, this must be done after the PWM timer is configured
+	stepper.setCurrent(RUN_CURRENT, HOLD_CURRENT);
+
+	// Register the listener with the stepper controller to be notified when moves are complete
+	controller.registerListener(stepperInstructions);
+
+	// Run the step timer at 2MHz (at 16MHz), the controller sets the period of each step
+	stepTimer.setPeriods(TimerPrescaler::PRESCALER_5_8, 0, 0, 0);
+
+	controller.setMaxSpeed(MAX_SPEED);
+	controller.setAcceleration(ACCELERATION);
+
+	sei();
+
+	/* Start with a forward rotation of 1 revolution
+	 * Further instructions will be triggered from StepperInstructions::moveComplete
+	 */
+	controller.moveTo(1 * STEPS_PER_ROTATION);
+
+	for (;;) {
+		sleep_mode();
+	}
+
+	return 0;
+}
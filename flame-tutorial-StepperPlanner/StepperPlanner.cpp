@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ *  License: GNU GPL v2 (see flame-Vusb-Keyboard/vusb/License.txt)
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Demonstrates how to move 2 stepper motors together along straight lines,
+ * tracing a circle made of short moves that run into each other without stopping
+ */
+
+
+// Bring in the FLAME IO header
+#include <flame/io.h>
+
+// Bring in the Stepper driver
+#include <flame/StepperMotorUnipolar.h>
+
+// Bring in the Stepper planner
+#include <flame/StepperPlanner.h>
+
+// Bring in the timer header
+#include <flame/Timer.h>
+
+// Bring in the power management header
+#include <avr/power.h>
+
+#include <math.h>
+
+using namespace flame;
+
+// The timer that steps the motors
+TimerImplementation<FLAME_TIMER16_1, TimerMode::REPETITIVE> stepTimer;
+FLAME_TIMER_ASSIGN_1INTERRUPT(stepTimer, FLAME_TIMER1_INTERRUPTS);
+
+#define MAX_SPEED		800
+#define ACCELERATION	1500
+// How quickly an axis may change speed at a corner, in steps/second
+#define JUNCTION_SPEED	100
+
+// The circle to trace, in steps
+#define RADIUS			2000
+#define SEGMENTS		72
+
+/* The stepper drivers, each uses 4 consecutive pins
+ * Available modes are WAVE, FULL and HALF
+ */
+StepperMotorUnipolar<StepperMode::HALF, FLAME_PIN_B0> xAxis;
+StepperMotorUnipolar<StepperMode::HALF, FLAME_PIN_D4> yAxis;
+
+// The planner, with room for 8 moves
+StepperPlanner<2, 8> planner(stepTimer);
+
+MAIN {
+	// Disable all peripherals and enable just what we need
+	power_all_disable();
+	power_timer1_enable();
+
+	// Run the step timer at 2MHz (at 16MHz), the planner sets the period of each step
+	stepTimer.setPeriods(TimerPrescaler::PRESCALER_5_8, 0, 0, 0);
+
+	planner.setAxis(0, xAxis);
+	planner.setAxis(1, yAxis);
+	planner.setAcceleration(ACCELERATION);
+	planner.setJunctionSpeed(JUNCTION_SPEED);
+
+	sei();
+
+	uint8_t segment = 0;
+	for (;;) {
+		/* Keep the queue topped up, moves could just as easily come from a serial port,
+		 * addMove() returns false when there is no room
+		 */
+		segment++;
+		if (segment > SEGMENTS) {
+			segment = 1;
+		}
+
+		float angle = 2 * M_PI * segment / SEGMENTS;
+		int32_t target[2] = {
+				(int32_t)(RADIUS * sin(angle)),
+				(int32_t)(RADIUS - RADIUS * cos(angle))
+		};
+
+		while (!planner.addMove(target, MAX_SPEED)) {}
+	}
+
+	return 0;
+}
@@ -59,9 +59,9 @@ using namespace flame;
 TimerImplementation<FLAME_TIMER8_2, TimerMode::REPETITIVE>tickTimer;
 FLAME_TIMER_ASSIGN_1INTERRUPT(tickTimer, FLAME_TIMER2_INTERRUPTS);
 
-// A timer we will use to tick the LED Matrix
-TimerImplementation<FLAME_TIMER8_0, TimerMode::REPETITIVE>ledMatrixTimer;
-FLAME_TIMER_ASSIGN_1INTERRUPT(ledMatrixTimer, FLAME_TIMER0_INTERRUPTS);
+// A timer we will use to tick the LED Matrix, 16 bits so it can hold the longest BAM tick
+TimerImplementation<FLAME_TIMER16_1, TimerMode::REPETITIVE>ledMatrixTimer;
+FLAME_TIMER_ASSIGN_1INTERRUPT(ledMatrixTimer, FLAME_TIMER1_INTERRUPTS);
 
 #define ALARM_COUNT	4
 // The RTC object we will use
@@ -137,11 +137,32 @@ public:
 			break;
 		}
 	}
+
+	/* The matrix scans rows, so it hands us the columns to compile
+	 * Both columns are on port B (pins 10 & 11 are B2 & B3), so a line is the one byte
+	 * to write to the port
+	 */
+	void compileMasks(const uint8_t *pixels, UNUSED uint16_t count, uint8_t *masks) {
+		masks[0] = 0;
+		if (pixels[0] & _BV(0)) {
+			masks[0] |= _BV(PORTB2);
+		}
+		if (pixels[0] & _BV(1)) {
+			masks[0] |= _BV(PORTB3);
+		}
+	}
+
+	void writeMasks(const uint8_t *masks) {
+		PORTB = (PORTB & ~(_BV(PORTB2) | _BV(PORTB3))) | masks[0];
+	}
 };
 
 LEDDriver ledDriver;
 
-PWMMatrix<LED_MATRIX_COLS, LED_MATRIX_ROWS, 1, PWMMatrixMode::AUTO> ledMatrix(ledDriver);
+/* The matrix uses bit angle modulation, so each row gets 8 timer ticks rather than 255,
+ * and the driver sets both columns with a single byte
+ */
+PWMMatrix<LED_MATRIX_COLS, LED_MATRIX_ROWS, 1, PWMMatrixMode::AUTO, 8, PWMMatrixModulation::BAM, 1> ledMatrix(ledDriver);
 
 /* Animation routine for the LED matrix
  * brings up each LED in turn, then takes then down in turn
@@ -198,6 +219,9 @@ void Animation::alarm(UNUSED AlarmSource source) {
 		break;
 	}
 
+	// Compile the changed row for the driver
+	ledMatrix.flush();
+
 	if (_direction && FADERMAX == _fader) {
 		_fader = 0;
 		_led++;
@@ -207,20 +231,6 @@ void Animation::alarm(UNUSED AlarmSource source) {
 	}
 }
 
-class LEDMatrixTicker : public TimerListener {
-public:
-	void alarm(AlarmSource source);
-};
-
-bool tick = false;
-
-// Notify the main loop that the PWM status of the LED matrix should be refreshed
-void LEDMatrixTicker::alarm(UNUSED AlarmSource source) {
-	tick = true;
-}
-
-LEDMatrixTicker ledMatrixTicker;
-
 
 MAIN {
 	// Disable all peripherals and enable just what we need
@@ -232,10 +242,10 @@ MAIN {
 	sei();
 
 	/* Set up LED matrix - 2 rows of 2 columns
-	 * We want a framerate of 30fps, and the software will spend half its time on each column
-	 * Each frame will therefore be 1/60 seconds
-	 * There are 256 PWM periods, so each timer tick needs to be 1 / (60 * 256) seconds
-	 * ~ 64 microseconds
+	 * We want a framerate of 60fps, and the software will spend half its time on each row
+	 * Each row will therefore be shown for 1/120 seconds
+	 * BAM splits that into 8 ticks of 1, 2, 4 ... 128 periods, 255 periods in all, so each
+	 * period needs to be 1 / (120 * 255) seconds ~ 32 microseconds
 	 */
 
 	// Configure the tick timer to tick every 1 millisecond
@@ -243,20 +253,20 @@ MAIN {
 	tickTimer.setListener1(rtc);
 	tickTimer.enable();
 
-	// Configure the tick timer to tick every 64 microseconds
-	ledMatrixTimer.setTimes(64UL, 0UL);
-	ledMatrixTimer.setListener1(ledMatrixTicker);
+	/* Configure the LED matrix timer for the shortest BAM tick, 32 microseconds
+	 * The matrix stretches the timer for the longer ticks itself, and with only 8 ticks per
+	 * row it is cheap enough to be called straight from the interrupt
+	 */
+	ledMatrixTimer.setTimes(32UL, 0UL);
+	if (ledMatrix.setBAMTimer(ledMatrixTimer)) {
+		// The 128 period tick doesn't fit in the timer, pick a shorter period or a bigger prescaler
+		for (;;) {
+		}
+	}
+	ledMatrixTimer.setListener1(ledMatrix);
 	ledMatrixTimer.enable();
 
 	for (;;) {
-/* Timer tick for the LED matrix
- * Note that we call this within the main loop, to avoid delaying interrupts
- */
-		if (tick) {
-			ledMatrix.alarm(AlarmSource::UNKNOWN);
-			tick = false;
-		}
-
 		sleep_mode();
 	}
 
@@ -27,12 +27,16 @@
 
 #include <flame/GammaCorrect.h>
 
+namespace flame {
+
 /* Gamma correct a value via calculation
- * This requires libm.a linked in (-lm on the linker command line)
+ * This evaluates the same curve that DefaultGamma is built from at run time, so it always agrees
+ * with the table, but is much slower. It does not need libm.
  * param	value	the value to gamma correct
  * return the gamma corrected value
  */
 uint8_t CONST calculatedGammaCorrect(uint8_t value) {
-	return (uint8_t) round(255 * pow(value / 256, 2.5));
+	return DefaultGamma::calculate(value);
 }
 
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <flame/Marquee.h>
+#include <stddef.h>
+
+namespace flame {
+
+/**
+ * Create a new marquee
+ * @param	font		the font to render the text in
+ * @param	left		the leftmost column of the region
+ * @param	right		the rightmost column of the region
+ * @param	row			the bottom row of the region, the region is as high as the font
+ * @param	onValue		the pixel value for on pixels
+ * @param	offValue	the pixel value for off pixels
+ */
+Marquee::Marquee(const FONT &font, uint16_t left, uint16_t right, int16_t row,
+		uint8_t onValue, uint8_t offValue) :
+	_font(font),
+	_left(left),
+	_right(right),
+	_row(row),
+	_onValue(onValue),
+	_offValue(offValue),
+	_next(NULL),
+	_progmem(false),
+	_glyph(NULL),
+	_remaining(0),
+	_separator(false),
+	_trailing(0) {}
+
+/**
+ * Start scrolling some text in from the right hand side of the region
+ * @param	text	the text to scroll
+ */
+void Marquee::setText(const char *text) {
+	_next = text;
+	_progmem = false;
+	_remaining = 0;
+	_separator = false;
+	_trailing = _right - _left + 1;
+}
+
+/**
+ * Start scrolling some text in program memory in from the right hand side of the region
+ * @param	text	the text to scroll
+ */
+void Marquee::setText_P(PGM_P text) {
+	setText(text);
+	_progmem = true;
+}
+
+/**
+ * Get the next character of the text without moving past it
+ * @return the character, or '\0' at the end of the text
+ */
+char Marquee::nextCharacter() {
+	return _progmem ? pgm_read_byte(_next) : *_next;
+}
+
+/**
+ * Move the cursor to the next column to be drawn
+ * @param	column	returns the font data for the column in program memory, or NULL for a blank column
+ * @return false if the text has finished scrolling off the region
+ */
+bool Marquee::nextColumn(const uint8_t **column) {
+	if (NULL == _next) {
+		return false;
+	}
+
+	if (!_remaining) {
+		if (_separator) {
+			_separator = false;
+			*column = NULL;
+			return true;
+		}
+
+		uint8_t c = (uint8_t)nextCharacter();
+		if ('\0' == c) {
+			// Blank columns until the end of the text has scrolled off the left
+			if (!_trailing) {
+				_next = NULL;
+				return false;
+			}
+			_trailing--;
+			*column = NULL;
+			return true;
+		}
+		_next++;
+
+		// Normalize the character to the font, and find its data
+		if (c < (uint8_t)_font.firstChar || c >= (uint8_t)_font.firstChar + _font.charCount) {
+			c = _font.unknown;
+		}
+		c -= _font.firstChar;
+		_remaining = pgm_read_byte(_font.widths + c);
+		_glyph = _font.fontData + pgm_read_word(_font.offsets + c);
+		_separator = '\0' != nextCharacter();
+	}
+
+	*column = _glyph;
+	_glyph += _font.columnBytes;
+	_remaining--;
+
+	return true;
+}
+
+}
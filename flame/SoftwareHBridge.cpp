@@ -25,20 +25,22 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#ifdef FLAME_TIMER16_1
-
 #include <flame/SoftwareHBridge.h>
+#include <util/delay_basic.h>
 
 namespace flame {
 
-/* Create a new H bridge where all transistors are controlled by us
+/**
+ * Create a new H bridge where all transistors are controlled by us
  * Bottom transistors are toggled between VCC & ground.
  *
  * *******************************
  * UNTESTED - USE AT YOUR OWN RISK
  * *******************************
  *
- * A timer is required for magnitude control.
+ * The timer must be a 16 bit timer in TimerMode::PWM_PHASE_CORRECT_16, it is used for magnitude control.
+ * The bridge is switched from the timer interrupts for channels 1 & 2, with each pulse centred on the top
+ * of the count. Current sensing requires the timer to be Timer 1, as the ADC is triggered from its compare match B.
  *
  * If the H-bridge voltage is greater than VCC of the microcontroller:
  *   * resistors R1 & R2 and diodes D1 & D2 must be installed
@@ -46,147 +48,367 @@ namespace flame {
  *   * Top transistors are toggled between high impedance & ground
  *
  * If the H bridge voltage is less than or equal to the microcontroller voltage,
- *  * resistors R1 & R2 can be omitted, and D1 and D2 can be shorted.
+ *   * resistors R1 & R2 can be omitted, and D1 and D2 can be shorted.
  *   * Set type to SoftwareHBridgeType::DIRECT
- *   * Top transistors are toggled between high impedance & ground
+ *   * Top transistors are toggled between VCC & ground
+ *
+ * The initial state is coasting, with slow decay and no dead time
  *
- * The initial state is coasting
+ * @param	type		the type of the bridge
+ * @param	timer		the timer used for PWM
+ * @param	top1		the top transistor of side 1
+ * @param	bottom1		the bottom transistor of side 1
+ * @param	top2		the top transistor of side 2
+ * @param	bottom2		the bottom transistor of side 2
  */
-SoftwareHBridge::SoftwareHBridge(FLAME_SoftwareHBridgeType type, FLAME_Timer &timer,
-		FLAME_DECLARE_PIN(dir1Top),
-		FLAME_DECLARE_PIN(dir1Bottom),
-		FLAME_DECLARE_PIN(dir2Top),
-		FLAME_DECLARE_PIN(dir2Bottom)) :
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+SoftwareHBridge::SoftwareHBridge(SoftwareHBridgeType type, Timer &timer,
+		FLAME_DECLARE_PIN(top1),
+		FLAME_DECLARE_PIN(bottom1),
+		FLAME_DECLARE_PIN(top2),
+		FLAME_DECLARE_PIN(bottom2)) :
 		_type(type),
 		_timer(timer),
-		_dir1Top(dir1Top),
-		_out1Top(out1Top),
-		_pin1Top(pin1Top),
-		_out1Bottom(out1Bottom),
-		_pin1Bottom(pin1Bottom),
-		_dir2Top(dir2Top),
-		_out2Top(out2Top),
-		_pin2Top(pin2Top),
-		_out2Bottom(out2Bottom),
-		_pin2Bottom(pin2Bottom),
-		_direction(FLAME_SOFTWAREHBRIDGE_DIR_COAST) {
+		_dir{&_SFR_MEM8(top1Dir), &_SFR_MEM8(bottom1Dir), &_SFR_MEM8(top2Dir), &_SFR_MEM8(bottom2Dir)},
+		_out{&_SFR_MEM8(top1Out), &_SFR_MEM8(bottom1Out), &_SFR_MEM8(top2Out), &_SFR_MEM8(bottom2Out)},
+		_mask{(uint8_t)_BV(top1Pin), (uint8_t)_BV(bottom1Pin), (uint8_t)_BV(top2Pin), (uint8_t)_BV(bottom2Pin)},
+		_direction(SoftwareHBridgeDirection::COAST),
+		_decay(SoftwareHBridgeDecay::SLOW),
+		_deadTime(0),
+		_onState(0),
+		_offState(0),
+		_state(0),
+		_rising(true),
+		_compare(0)
+#ifdef FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+		,
+		_limit(0xffff),
+		_current(0),
+		_skip(false)
+#endif
+{
+	for (uint8_t transistor = 0; transistor < TRANSISTORS; transistor++) {
+		uint8_t mask = _mask[transistor];
+
+		if (TOPS & _BV(transistor)) {
+			// Tops are off when pulled up, or driven high
+			if (SoftwareHBridgeType::PULLUP == _type) {
+				*_out[transistor] &= ~mask;
+				*_dir[transistor] &= ~mask;
+			} else {
+				*_out[transistor] |= mask;
+				*_dir[transistor] |= mask;
+			}
+		} else {
+			*_out[transistor] &= ~mask;
+			*_dir[transistor] |= mask;
+		}
+	}
+
 	_timer.setListener1(this);
+	_timer.setListener2(this);
+}
+#pragma GCC diagnostic warning "-Wunused-parameter"
+
+/**
+ * Switch a single transistor
+ * @param	transistor	the transistor number (the bit number in a bridge state)
+ * @param	on			true to turn the transistor on
+ */
+void SoftwareHBridge::transistor(uint8_t transistor, bool on) {
+	uint8_t mask = _mask[transistor];
+	bool top = TOPS & _BV(transistor);
+
+	if (top && SoftwareHBridgeType::PULLUP == _type) {
+		// The output is always low, the top is switched on by driving the pin
+		if (on) {
+			*_dir[transistor] |= mask;
+		} else {
+			*_dir[transistor] &= ~mask;
+		}
+		return;
+	}
+
+	// Tops are on when low, bottoms are on when high
+	if (on != top) {
+		*_out[transistor] |= mask;
+	} else {
+		*_out[transistor] &= ~mask;
+	}
 }
 
-/* Set up for a new timer pass
- * Care is taken in here to never allow the top and bottom of any side
- * to be on simultaneously
+/**
+ * Drive the bridge to a new state
+ * Transistors are turned off before any are turned on, and the dead time is inserted between them,
+ * so the top and bottom of a side are never on simultaneously
+ * @param	state	the transistors to turn on (TOP_1, BOTTOM_1, TOP_2 & BOTTOM_2 ORed together)
  */
-void SoftwareHBridge::reset() {
+void SoftwareHBridge::drive(uint8_t state) {
+	uint8_t off = _state & ~state;
+	uint8_t on = state & ~_state;
+
+	for (uint8_t bit = 0; bit < TRANSISTORS; bit++) {
+		if (off & _BV(bit)) {
+			transistor(bit, false);
+		}
+	}
+
+	if (off && on && _deadTime) {
+		_delay_loop_1(_deadTime);
+	}
+
+	for (uint8_t bit = 0; bit < TRANSISTORS; bit++) {
+		if (on & _BV(bit)) {
+			transistor(bit, true);
+		}
+	}
+
+	_state = state;
+}
+
+/**
+ * Work out the bridge states during and between pulses
+ * @param	magnitude	the magnitude of the direction, 0 to leave the bridge in the decay state
+ */
+void SoftwareHBridge::setStates(uint16_t magnitude) {
+	uint8_t decayState = (SoftwareHBridgeDecay::SLOW == _decay) ? BOTTOM_1 | BOTTOM_2 : 0;
+
 	switch (_direction) {
 	case SoftwareHBridgeDirection::COAST:
-		// Tops and bottoms are off
-		switch (_type) {
-		case SoftwareHBridgeType::PULLUP:
-			setInput(_dir1Top, _out1Top, NULL, _pin1Top, -1);
-			setInput(_dir2Top, _out2Top, NULL, _pin2Top, -1);
-			break;
-		case SoftwareHBridgeType::DIRECT:
-			pinOn(NULL, _out1Top, NULL, _pin1Top, -1);
-			pinOn(NULL, _out2Top, NULL, _pin2Top, -1);
-			break;
-		}
-		pinOff(NULL, _out1Bottom, NULL, _pin1Bottom, -1);
-		pinOff(NULL, _out2Bottom, NULL, _pin2Bottom, -1);
+		_onState = 0;
+		_offState = 0;
 		break;
 	case SoftwareHBridgeDirection::FORWARD:
-		// Top 1 is on, bottom 2 is on
-		pinOff(NULL, _out1Bottom, NULL, _pin1Bottom, -1);
-		switch (_type) {
-		case SoftwareHBridgeType::PULLUP:
-			setInput(_dir2Top, _out2Top, NULL, _pin2Top, -1);
-			setOutput(_dir1Top, _out1Top, NULL, _pin1Top, -1);
-			pinOff(_dir1Top, _out1Top, NULL, _pin1Top, -1);
-			break;
-		case SoftwareHBridgeType::DIRECT:
-			pinOn(NULL, _out2Top, NULL, _pin2Top, -1);
-			pinOff(NULL, _out1Top, NULL, _pin1Top, -1);
-			break;
-		}
-		pinOn(NULL, _out2Bottom, NULL, _pin2Bottom, -1);
+		_onState = TOP_1 | BOTTOM_2;
+		_offState = decayState;
 		break;
 	case SoftwareHBridgeDirection::BACKWARD:
-		// Top 2 is on, bottom 1 is on
-		pinOff(NULL, _out2Bottom, NULL, _pin2Bottom, -1);
-		switch (_type) {
-		case SoftwareHBridgeType::PULLUP:
-			setInput(_dir1Top, _out1Top, NULL, _pin1Top, -1);
-			setOutput(_dir2Top, _out2Top, NULL, _pin2Top, -1);
-			pinOff(_dir2Top, _out2Top, NULL, _pin2Top, -1);
-			break;
-		case SoftwareHBridgeType::DIRECT:
-			pinOn(NULL, _out1Top, NULL, _pin1Top, -1);
-			pinOff(NULL, _out2Top, NULL, _pin2Top, -1);
-			break;
-		}
-		pinOn(NULL, _out1Bottom, NULL, _pin1Bottom, -1);
+		_onState = TOP_2 | BOTTOM_1;
+		_offState = decayState;
 		break;
 	case SoftwareHBridgeDirection::BRAKE:
-		// Bottoms are on
-		switch (_type) {
-		case SoftwareHBridgeType::PULLUP:
-			setInput(_dir1Top, _out1Top, NULL, _pin1Top, -1);
-			setInput(_dir2Top, _out2Top, NULL, _pin2Top, -1);
-			break;
-		case SoftwareHBridgeType::DIRECT:
-			pinOn(NULL, _out1Top, NULL, _pin1Top, -1);
-			pinOn(NULL, _out2Top, NULL, _pin2Top, -1);
-			break;
-		}
-		pinOn(NULL, _out1Bottom, NULL, _pin1Bottom, -1);
-		pinOn(NULL, _out2Bottom, NULL, _pin2Bottom, -1);
+		_onState = BOTTOM_1 | BOTTOM_2;
+		_offState = BOTTOM_1 | BOTTOM_2;
 		break;
 	}
+
+	if (0 == magnitude) {
+		_onState = _offState;
+	}
+}
+
+/**
+ * Set how the motor current decays between pulses, takes effect on the next call to set()
+ * @param	decay	SoftwareHBridgeDecay::SLOW to short the motor through the bottom transistors,
+ * 					SoftwareHBridgeDecay::FAST to turn all transistors off
+ */
+void SoftwareHBridge::setDecay(SoftwareHBridgeDecay decay) {
+	_decay = decay;
+}
+
+/**
+ * Set the minimum time between turning a transistor off and turning its partner on
+ * The time taken to switch the pins is added to this
+ * @param	nanoseconds		the dead time in nanoseconds (up to 765 CPU cycles)
+ */
+void SoftwareHBridge::setDeadTime(uint16_t nanoseconds) {
+	// _delay_loop_1 takes 3 cycles per iteration
+	uint32_t loops = ((uint32_t)nanoseconds * (F_CPU / 1000000UL) + 2999) / 3000;
+
+	_deadTime = (loops > 255) ? 255 : loops;
 }
 
-/* Set the H bridge to coasting after the end of a timer cycle for PWM
- * This should be called from the trigger of the associated timer
+/**
+ * Start the PWM cycle
+ * @pre the timer must be in TimerMode::PWM_PHASE_CORRECT_16, with its prescaler and top set
  */
-void SoftwareHBridge::alarm() {
-	// Set to coasting until the next reset
-	switch (_type) {
-	case SoftwareHBridgeType::PULLUP:
-		setInput(_dir1Top, _out1Top, NULL, _pin1Top, -1);
-		setInput(_dir2Top, _out2Top, NULL, _pin2Top, -1);
+void SoftwareHBridge::start() {
+	// Channel 2 marks the top of the count, the middle of each pulse
+	_timer.setOutput2(_timer.getTop());
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		drive(_offState);
+
+		// The count starts at the bottom, so the first compare match starts a pulse
+		_rising = true;
+#ifdef FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+		_skip = false;
+#endif
+		_timer.enable();
+	}
+}
+
+/**
+ * Is the count within a pulse?
+ * The pulse is the part of the count above the compare value. The counter has moved on from a match by the time
+ * its interrupt runs, upwards for the start of a pulse and downwards for the end, so this tells them apart even
+ * when the interrupts are serviced late or out of order
+ * @return true if the count is within a pulse
+ */
+bool SoftwareHBridge::inPulse() {
+	uint16_t current = _timer.current();
+
+	if (current == _compare) {
+		// The interrupt was quicker than a timer tick, so the match is the one expected
+		return _rising;
+	}
+	return current > _compare;
+}
+
+/**
+ * Switch the bridge on a compare match of the timer
+ * Channel 1 matches at the start and end of each pulse, channel 2 at the top of the count
+ * @param	source	the timer channel that triggered the alarm
+ */
+void SoftwareHBridge::alarm(AlarmSource source) {
+	switch (source) {
+	case AlarmSource::TIMER_OUTPUT_1:
+		if (!inPulse()) {
+			drive(_offState);
+			_rising = true;
+#ifdef FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+		} else if (_skip) {
+			_skip = false;
+			_rising = false;
+#endif
+		} else {
+			drive(_onState);
+			_rising = false;
+		}
 		break;
-	case SoftwareHBridgeType::DIRECT:
-		pinOn(NULL, _out1Top, NULL, _pin1Top, -1);
-		pinOn(NULL, _out2Top, NULL, _pin2Top, -1);
+
+	case AlarmSource::TIMER_OUTPUT_2:
+		// The top of the count, the next match on channel 1 ends the pulse unless it already has
+		_rising = !inPulse();
+		break;
+
+	default:
 		break;
 	}
-	pinOff(NULL, _out1Bottom, NULL, _pin1Bottom, -1);
-	pinOff(NULL, _out2Bottom, NULL, _pin2Bottom, -1);
 }
 
-/* Set the direction and magnitude of the H bridge
- * Requires a timer to be specified
- * param:	direction	the direction of the bridge
- * param:	magnitude	the magnitude of the direction (from 0 to TOP of the timer)
+/**
+ * Set the direction and magnitude of the H bridge
+ * The pulse width takes effect from the next PWM cycle, a change of direction stops the current pulse.
+ * Pulses shorter than the interrupt takes to switch the bridge (FLAME_SOFTWAREHBRIDGE_ISR_CYCLES and the
+ * dead time) are left off, as the interrupt could not end them in time.
+ * Narrowing the pulse before this cycle's pulse has started drops that pulse
+ * @pre start() must be called to begin the PWM cycle
+ * @param	direction	the direction of the bridge
+ * @param	magnitude	the magnitude of the direction (from 0 to TOP of the timer)
  */
 void SoftwareHBridge::set(SoftwareHBridgeDirection direction, uint16_t magnitude) {
-	_direction = direction;
+	uint16_t top = _timer.getTop();
+	uint16_t compare;
 
-	if (SoftwareHBridgeDirection::COAST == direction ||
-			SoftwareHBridgeDirection::BRAKE == direction) {
-		reset();
+	// The pulse lasts from the match counting up to the match counting down, 2 * magnitude ticks
+	uint32_t minimum = (FLAME_SOFTWAREHBRIDGE_ISR_CYCLES + 3UL * _deadTime) / _timer.getPrescalerMultiplier();
+	if (2UL * magnitude < minimum) {
+		magnitude = 0;
 	}
 
-	_timer->setOutput(_timerChannel, magnitude);
+	// Keep the compare match away from the top & bottom of the count, so there are 2 matches per cycle
+	if (0 == magnitude) {
+		compare = top - 1;
+	} else if (magnitude >= top) {
+		compare = 1;
+	} else {
+		compare = top - magnitude;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_direction = direction;
+		setStates(magnitude);
+		_compare = compare;
+		_timer.setOutput1(compare);
+
+		if (_state != _onState) {
+			drive(_offState);
+		}
+	}
 }
 
-/* Set the direction of the H bridge
- * Does not require a timer to be specified
- * param:	direction	the direction of the H bridge
+/**
+ * Set the direction of the H bridge at full magnitude
+ * Does not require the timer to be running
+ * @param	direction	the direction of the H bridge
  */
 void SoftwareHBridge::set(SoftwareHBridgeDirection direction) {
-	_direction = direction;
-	reset();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_direction = direction;
+		setStates(1);
+		_offState = _onState;
+		drive(_onState);
+	}
+}
+
+#ifdef FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+/**
+ * Sample the motor current in the middle of every pulse
+ * The ADC is auto triggered by compare match B of Timer 1 (at the top of the count),
+ * FLAME_SOFTWAREHBRIDGE_ASSIGN_ADC_INTERRUPT must be used to pass the results to the bridge
+ *
+ * @param	channel		the ADC channel the current sense amplifier is connected to
+ * @param	reference	the ADC reference
+ * @param	prescaler	the ADC prescaler, the conversion takes 13.5 ADC clocks from the trigger
+ * @param	limit		the highest allowed reading, a pulse is cut short if it is exceeded
+ */
+void SoftwareHBridge::senseCurrent(ADCChannel channel, ADCReference reference, ADCPrescaler prescaler, uint16_t limit) {
+	setCurrentLimit(limit);
+
+	FLAME_AD_ENABLE;
+	ad_setPrescaler(prescaler);
+
+	ADMUX = reference | (channel & 0x0F);
+#ifdef MUX5
+	ADCSRB = (ADCSRB & ~_BV(MUX5)) | ((channel & _BV(5)) >> (5 - MUX5));
+#endif
+
+	// Trigger on Timer 1 compare match B
+	ADCSRB = (ADCSRB & ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | _BV(ADTS2) | _BV(ADTS0);
+	ADCSRA |= _BV(ADATE) | _BV(ADIE);
+}
+
+/**
+ * Set the current limit
+ * @param	limit	the highest allowed ADC reading, 0xffff for no limit
+ */
+void SoftwareHBridge::setCurrentLimit(uint16_t limit) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_limit = limit;
+	}
+}
+
+/**
+ * Get the most recent current sample
+ * @return the ADC reading taken in the middle of the last pulse
+ */
+uint16_t SoftwareHBridge::getCurrent() {
+	uint16_t current;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		current = _current;
+	}
+
+	return current;
+}
+
+/**
+ * Interrupt handler for the ADC, applies the cycle by cycle current limit
+ * If the limit is exceeded the pulse is ended, or if it has already ended, the next pulse is dropped
+ */
+void SoftwareHBridge::adc() {
+	uint16_t current = ADC;
+
+	_current = current;
+	if (current > _limit) {
+		if (_rising) {
+			_skip = true;
+		} else {
+			drive(_offState);
+		}
+	}
 }
+#endif
 
 }
-#endif // FLAME_TIMER16_1
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <flame/StepperController.h>
+#include <util/atomic.h>
+
+namespace flame {
+
+/**
+ * Create a new StepperController
+ * @param	timer	the timer to take steps from, this controller becomes its listener
+ * @param	motor	the motor to move
+ */
+StepperController::StepperController(Timer &timer, StepperMotor &motor) :
+		_timer(timer),
+		_motor(motor),
+		_maxSpeed(1000),
+		_nextDelay(0),
+		_forward(true),
+		_moving(false),
+		_stepperListener(NULL) {
+	_timer.setListener1(this);
+}
+
+/**
+ * Set the acceleration and deceleration of moves
+ * @param	acceleration	the acceleration in steps/second/second
+ */
+void StepperController::setAcceleration(uint32_t acceleration) {
+	_profile.setAcceleration(acceleration);
+}
+
+/**
+ * Set the cruising speed of moves
+ * @param	maxSpeed	the speed in steps/second
+ */
+void StepperController::setMaxSpeed(uint16_t maxSpeed) {
+	_maxSpeed = maxSpeed;
+}
+
+/**
+ * Move the motor relative to its current position
+ * @param	steps	the number of steps to move, negative to move backwards
+ * @return false if the motor is already moving
+ */
+bool StepperController::move(int32_t steps) {
+	if (_moving) {
+		return false;
+	}
+	if (!steps) {
+		return true;
+	}
+
+	// The prescaler is only readable while the timer is running, so capture it on the first move
+	if (!_profile.getFrequency()) {
+		_profile.setFrequency(F_CPU / _timer.getPrescalerMultiplier());
+	}
+
+	_forward = steps > 0;
+	_profile.start((_forward) ? steps : -steps, 0, _maxSpeed, 0);
+	_moving = true;
+
+	_timer.setTop(_profile.delay() - 1);
+	_nextDelay = _profile.next();
+	_timer.enable();
+
+	return true;
+}
+
+/**
+ * Move the motor to an absolute position
+ * @param	position	the position to move to
+ * @return false if the motor is already moving
+ */
+bool StepperController::moveTo(int32_t position) {
+	return move(position - _motor.getPosition());
+}
+
+/**
+ * Decelerate to a stop as quickly as the acceleration allows
+ */
+void StepperController::stop() {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_profile.stop();
+	}
+}
+
+/**
+ * Is the motor moving?
+ * @return true if the motor is moving
+ */
+bool StepperController::isMoving() {
+	return _moving;
+}
+
+/**
+ * Take a step and schedule the next one
+ * The interval to the next step was calculated at the step before, so it is set before the timer can pass it,
+ * and the interval after is calculated while waiting
+ * @return true if the counter was already past the next step's top, so that step is due now
+ */
+bool StepperController::step() {
+	_motor.advance(_forward);
+
+	uint16_t delay = _nextDelay;
+	if (delay) {
+		_timer.setTop(delay - 1);
+		bool late = _timer.current() > delay - 1;
+
+		_nextDelay = _profile.next();
+		return late;
+	}
+
+	// We are done
+	_timer.disable();
+	_moving = false;
+	_motor.idle();
+	if (_stepperListener) {
+		_stepperListener->moveComplete(_motor.getPosition());
+	}
+	return false;
+}
+
+/**
+ * Take a step and schedule the next one
+ */
+void StepperController::alarm(UNUSED AlarmSource source) {
+	if (!_moving) {
+		_timer.disable();
+		return;
+	}
+
+	while (step()) {
+		// The compare match was missed, take the step now and time the next from here
+		_timer.setCurrent(0);
+	}
+}
+
+/**
+ * Register a listener to be notified when moves are complete (called from the timer interrupt)
+ * @param	listener	the listener to notify
+ */
+void StepperController::registerListener(StepperListener &listener) {
+	_stepperListener = &listener;
+}
+
+/**
+ * Deregister the listener
+ */
+void StepperController::deregisterListener() {
+	_stepperListener = NULL;
+}
+
+}
@@ -28,16 +28,39 @@
 
 namespace flame {
 
+/**
+ * Create a new StepperMotor that is stepped by another controller (rotate() is not available)
+ */
+StepperMotor::StepperMotor() :
+		_position(0),
+		_rtc(NULL),
+		_moving(false),
+		_stepperListener(NULL) {}
+
 /**
  * Create a new StepperMotor
  * @param	rtc		an RTC we will use to trigger events
  */
 StepperMotor::StepperMotor(RTC &rtc) :
 		_position(0),
-		_rtc(rtc),
+		_rtc(&rtc),
 		_moving(false),
 		_stepperListener(NULL) {}
 
+/**
+ * Take a single step and track the position
+ * @param	forward		true to step forward
+ */
+void StepperMotor::advance(bool forward) {
+	step(forward);
+	_position += (forward) ? 1 : -1;
+}
+
+/**
+ * Called when the motor has stopped, drivers may override this to reduce the holding current
+ */
+void StepperMotor::idle() {}
+
 /**
  * Mark the current position of the motor.
  * This simply changes where we think we are, it does not move the motor
@@ -71,21 +94,25 @@ bool StepperMotor::isMoving() {
  * @param	until		the position to stop at
  */
 void StepperMotor::rotate(bool forward, float speed, int32_t until) {
+	if (!_rtc) {
+		return;
+	}
+
 	_forward = forward;
 	_speed = speed;
 	_until = until;
 
 // Remove any current alarms
-	_rtc.removeAlarm(this);
+	_rtc->removeAlarm(this);
 
 // Register the alarm with the RTC
-	_rtc.current(_started);
+	_rtc->current(_started);
 
 	_startPosition = _position;
 
 	_moving = true;
 
-	_rtc.addAlarm(this, 0, 0, 0, 1);
+	_rtc->addAlarm(this, 0, 0, 0, 1);
 }
 
 /**
@@ -97,7 +124,7 @@ void StepperMotor::alarm(UNUSED AlarmSource source) {
 	}
 
 	TIMESTAMP elapsed;
-	_rtc.elapsed(_started, elapsed);
+	_rtc->elapsed(_started, elapsed);
 // Reuse elapsed.timestamp to represent milliseconds elapsed
 	elapsed.timestamp *= 1000;
 	elapsed.timestamp += elapsed.milliseconds;
@@ -105,15 +132,15 @@ void StepperMotor::alarm(UNUSED AlarmSource source) {
 	int32_t expectedPosition = _startPosition + elapsed.timestamp * _speed / ((_forward) ? 1000 : -1000);
 
 	if (expectedPosition != _position) {
-		step(_forward);
-		_position += (_forward) ? 1 : -1;
+		advance(_forward);
 	}
 
 	if (_until == _position) {
 // We are done
 		_speed = 0;
 		_moving = false;
-		_rtc.removeAlarm(this);
+		_rtc->removeAlarm(this);
+		idle();
 		if (_stepperListener) {
 			_stepperListener->moveComplete(_position);
 		}
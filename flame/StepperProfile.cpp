@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <flame/StepperProfile.h>
+#include <math.h>
+
+namespace flame {
+
+/**
+ * Create a new StepperProfile
+ * setFrequency and setAcceleration must be called before start
+ */
+StepperProfile::StepperProfile() :
+		_frequency(0),
+		_acceleration(0),
+		_firstDelay(0xffff),
+		_steps(0),
+		_step(0),
+		_decelStart(0),
+		_accelCount(0),
+		_peakCount(0),
+		_exitCount(0),
+		_delay(0xffff),
+		_minDelay(1),
+		_rest(0),
+		_state(StepperProfileState::IDLE) {}
+
+/**
+ * Set the rate the step timer counts at
+ * @param	frequency	the timer ticks per second
+ */
+void StepperProfile::setFrequency(uint32_t frequency) {
+	_frequency = frequency;
+	setAcceleration(_acceleration);
+}
+
+/**
+ * Set the acceleration and deceleration
+ * @param	acceleration	the acceleration in steps/second/second
+ */
+void StepperProfile::setAcceleration(uint32_t acceleration) {
+	_acceleration = acceleration;
+
+	if (!_frequency || !_acceleration) {
+		return;
+	}
+
+	// c0 = 0.676 * f * sqrt(2 / a), the 0.676 corrects the error of the approximation for the first step
+	float firstDelay = 0.676f * _frequency * sqrt(2.0f / _acceleration);
+	_firstDelay = (firstDelay > 65535.0f) ? 0xffff : (uint16_t)firstDelay;
+	if (!_firstDelay) {
+		_firstDelay = 1;
+	}
+}
+
+/**
+ * Get the rate the step timer counts at
+ * @return the timer ticks per second
+ */
+uint32_t StepperProfile::getFrequency() {
+	return _frequency;
+}
+
+/**
+ * Get the acceleration
+ * @return the acceleration in steps/second/second
+ */
+uint32_t StepperProfile::getAcceleration() {
+	return _acceleration;
+}
+
+/**
+ * Get the number of steps needed to accelerate from rest to a speed
+ * @param	speed	the speed in steps/second
+ * @return the number of steps
+ */
+uint32_t StepperProfile::speedCount(uint16_t speed) {
+	return ((uint32_t)speed * speed) / (2 * _acceleration);
+}
+
+/**
+ * Get the interval between steps at a speed
+ * @param	speed	the speed in steps/second
+ * @return the interval in timer ticks
+ */
+uint16_t StepperProfile::speedDelay(uint16_t speed) {
+	if (!speed) {
+		return _firstDelay;
+	}
+
+	uint32_t delay = _frequency / speed;
+	if (delay > 0xffff) {
+		return 0xffff;
+	}
+	return delay ? delay : 1;
+}
+
+/**
+ * Find the position of a speed on the acceleration ramp, to start a move from without dividing
+ * @param	speed	the speed in steps/second
+ * @return the position on the ramp
+ */
+StepperSpeed StepperProfile::speed(uint16_t speed) {
+	StepperSpeed result;
+
+	result.count = speedCount(speed);
+	result.delay = speedDelay(speed);
+	return result;
+}
+
+/**
+ * Start a move
+ * @param	steps		the number of steps to take
+ * @param	entrySpeed	the speed at the first step, in steps/second
+ * @param	maxSpeed	the speed to cruise at, in steps/second
+ * @param	exitSpeed	the speed at the last step, in steps/second
+ */
+void StepperProfile::start(uint32_t steps, uint16_t entrySpeed, uint16_t maxSpeed, uint16_t exitSpeed) {
+	start(steps, speed(entrySpeed), speed(maxSpeed), speed(exitSpeed));
+}
+
+/**
+ * Start a move from speeds found with speed()
+ * @param	steps		the number of steps to take
+ * @param	entry		the speed at the first step
+ * @param	cruise		the speed to cruise at
+ * @param	exit		the speed at the last step, only its count is used
+ */
+void StepperProfile::start(uint32_t steps, const StepperSpeed &entry, const StepperSpeed &cruise, const StepperSpeed &exit) {
+	uint32_t entryCount = entry.count;
+	uint32_t cruiseCount = cruise.count;
+	uint16_t entryDelay = entry.delay;
+	_exitCount = exit.count;
+
+	if (entryCount > cruiseCount) {
+		entryCount = cruiseCount;
+		entryDelay = cruise.delay;
+	}
+	if (_exitCount > entryCount + steps) {
+		_exitCount = entryCount + steps;
+	}
+
+	// Peak where the acceleration and deceleration ramps meet if the move is too short to cruise
+	_peakCount = cruiseCount;
+	if ((_peakCount - entryCount) + (_peakCount - _exitCount) > steps) {
+		_peakCount = (steps + entryCount + _exitCount) / 2;
+	}
+	if (_peakCount < entryCount) {
+		// Too fast to slow to the exit speed in time, so decelerate from the first step
+		_peakCount = entryCount;
+	}
+
+	_steps = steps;
+	_step = 0;
+	_rest = 0;
+	_minDelay = cruise.delay;
+	_decelStart = (_peakCount - _exitCount < steps) ? steps - (_peakCount - _exitCount) : 0;
+	_accelCount = entryCount;
+	_delay = entryDelay;
+
+	if (!steps) {
+		_state = StepperProfileState::IDLE;
+	} else if (0 == _decelStart) {
+		decelerate(entryCount);
+	} else if (_peakCount > entryCount && _delay > _minDelay) {
+		_state = StepperProfileState::ACCELERATE;
+	} else {
+		_peakCount = entryCount;
+		_state = StepperProfileState::CRUISE;
+	}
+}
+
+/**
+ * Decelerate to rest as quickly as possible, the number of steps is shortened to suit
+ */
+void StepperProfile::stop() {
+	uint32_t count;
+
+	switch (_state) {
+	case StepperProfileState::ACCELERATE:
+	case StepperProfileState::CRUISE:
+		count = (StepperProfileState::ACCELERATE == _state) ? _accelCount : _peakCount;
+		_exitCount = 0;
+		_steps = _step + count;
+		decelerate(count);
+		break;
+	case StepperProfileState::DECELERATE:
+		_exitCount = 0;
+		_steps = _step - _accelCount;
+		break;
+	case StepperProfileState::EXIT:
+		_steps = _step + 1;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Switch to the deceleration ramp
+ * @param	count	the number of steps taken to accelerate from rest to the current speed
+ */
+void StepperProfile::decelerate(uint32_t count) {
+	_rest = 0;
+	if (count <= _exitCount) {
+		_state = StepperProfileState::EXIT;
+	} else {
+		_accelCount = -(int32_t)count;
+		_state = StepperProfileState::DECELERATE;
+	}
+}
+
+/**
+ * Apply one step of the ramp: c(n) = c(n-1) - 2c(n-1) / (4n + 1), carrying the remainder
+ */
+void StepperProfile::ramp() {
+	int32_t numerator = 2 * (int32_t)_delay + _rest;
+	int32_t denominator = 4 * _accelCount + 1;
+	int32_t quotient;
+
+	// Near the end of a long ramp the change is less than a tick, which needs no divide
+	if ((numerator < 0 ? -numerator : numerator) < (denominator < 0 ? -denominator : denominator)) {
+		_rest = numerator;
+		return;
+	}
+
+	// Most steps at high speed fit in 16 bits, which divides several times faster
+	if (numerator < 0x8000 && numerator > -0x8000 && denominator < 0x8000 && denominator > -0x8000) {
+		quotient = (int16_t)numerator / (int16_t)denominator;
+		_rest = (int16_t)numerator % (int16_t)denominator;
+	} else {
+		quotient = numerator / denominator;
+		_rest = numerator % denominator;
+	}
+
+	int32_t delay = (int32_t)_delay - quotient;
+	if (delay > 0xffff) {
+		delay = 0xffff;
+	} else if (delay < 1) {
+		delay = 1;
+	}
+	_delay = delay;
+}
+
+/**
+ * Get the interval to the next step
+ * @return the interval in timer ticks
+ */
+uint16_t StepperProfile::delay() {
+	return _delay;
+}
+
+/**
+ * Account for a step being taken and calculate the interval to the following step
+ * @return the interval in timer ticks, or 0 if the move is complete
+ */
+uint16_t StepperProfile::next() {
+	if (++_step >= _steps) {
+		_state = StepperProfileState::IDLE;
+		return 0;
+	}
+
+	switch (_state) {
+	case StepperProfileState::ACCELERATE:
+		_accelCount++;
+		ramp();
+		if (_step >= _decelStart) {
+			decelerate(_accelCount);
+		} else if (_delay <= _minDelay) {
+			// Reached cruising speed before the planned peak, so deceleration starts later
+			_delay = _minDelay;
+			_peakCount = _accelCount;
+			_decelStart = _steps - (_peakCount - _exitCount);
+			_state = StepperProfileState::CRUISE;
+		}
+		break;
+	case StepperProfileState::CRUISE:
+		if (_step >= _decelStart) {
+			decelerate(_peakCount);
+		}
+		break;
+	case StepperProfileState::DECELERATE:
+		_accelCount++;
+		ramp();
+		if (_accelCount >= -(int32_t)_exitCount) {
+			_state = StepperProfileState::EXIT;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return _delay;
+}
+
+/**
+ * Is a move in progress?
+ * @return true if there are steps remaining
+ */
+bool StepperProfile::active() {
+	return StepperProfileState::IDLE != _state;
+}
+
+/**
+ * Get the number of steps remaining in the move
+ * @return the number of steps
+ */
+uint32_t StepperProfile::remaining() {
+	return _steps - _step;
+}
+
+}
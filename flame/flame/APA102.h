@@ -0,0 +1,464 @@
+/* Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAME_APA102_H_
+#define FLAME_APA102_H_
+
+#include <flame/RGBLEDStrip.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/**
+ * Assign the SPI interrupt to an APA102_SPI strip
+ * @param	flameAPA102		the strip
+ */
+#define FLAME_APA102_SPI_ASSIGN_INTERRUPTS(flameAPA102) \
+ISR(SPI_STC_vect) { \
+	flameAPA102.transmitted(); \
+}
+
+/**
+ * Assign the USART data register empty interrupt to an APA102_USART strip
+ * @param	flameAPA102		the strip
+ * @param	flameUdreVect	the data register empty vector for the USART, eg. USART_UDRE_vect
+ */
+#define FLAME_APA102_USART_ASSIGN_INTERRUPTS(flameAPA102, flameUdreVect) \
+ISR(flameUdreVect) { \
+	flameAPA102.transmitted(); \
+}
+
+namespace flame {
+
+/**
+ * A listener which will be notified when an asynchronous flush has finished
+ */
+class APA102Listener {
+public:
+	/**
+	 * Called from the interrupt handler once the last byte of a frame has been sent
+	 * The strip may be modified and flushed again from here
+	 */
+	virtual void flushComplete() =0;
+	virtual ~APA102Listener() {};
+};
+
+/**
+ * The parts of an APA102 (or SK9822) strip that don't depend on how the bytes are sent
+ *
+ * Each frame is a start frame of 32 zero bits, then a brightness byte (0xe0 | 5 bit brightness)
+ * and blue, green & red for each LED, then an end frame. The end frame is 32 zero bits to latch
+ * the SK9822, followed by enough zero bits to clock the data through to the end of the string
+ * (each LED delays the clock by half a bit).
+ *
+ * Asynchronous flushes take an interrupt for every byte, of the order of 100 cycles each with
+ * the register saves. A frame of n LEDs is 4 * n + 8 + n / 16 bytes, and each byte takes the
+ * longer of 8 * divider cycles on the wire or the interrupt time, so at a divider of 2 to 8 the
+ * interrupt sets the frame rate and there is little CPU time left over. Asynchronous flushes pay
+ * off from a divider of 32 up, where most of each byte time is free; below that, the
+ * synchronous flush() is faster.
+ *
+ * @tparam	length		the number of LEDs in the string
+ * @tparam	gamma		the gamma exponent for the LEDs, in hundredths
+ */
+template <uint16_t length, uint16_t gamma = FLAME_GAMMA_DEFAULT>
+class APA102 : public RGBLEDStrip<length, false, gamma> {
+	typedef RGBLEDStrip<length, false, gamma> Strip;
+
+private:
+	uint8_t						_brightness[length];	// the 5 bit global brightness of each LED
+	volatile uint16_t			_pixel;					// the logical pixel being sent
+	volatile uint8_t			_pixelByte;				// the byte within the LED frame being sent
+	volatile uint16_t			_framing;				// zero bytes left in the start or end frame
+	volatile bool				_busy;
+	APA102Listener * volatile	_listener;
+
+	static const uint16_t		ENDFRAME_LENGTH = 4 + (length + 15) / 16;
+
+protected:
+	/**
+	 * Get the next byte of the frame to send
+	 * @param	byte	returns the byte to send
+	 * @return true if there was a byte to send, false if the frame is finished
+	 */
+	INLINE bool nextByte(uint8_t *byte) {
+		if (_framing) {
+			_framing--;
+			*byte = 0;
+			return true;
+		}
+
+		if (_pixel == length) {
+			return false;
+		}
+
+		uint16_t index = Strip::offset(_pixel);
+
+		switch (_pixelByte) {
+		case 0:
+			*byte = 0xe0 | _brightness[index];
+			break;
+		case 1:
+			*byte = Strip::_data[index].get(RGBChannel::BLUE);
+			break;
+		case 2:
+			*byte = Strip::_data[index].get(RGBChannel::GREEN);
+			break;
+		default:
+			*byte = Strip::_data[index].get(RGBChannel::RED);
+			_pixelByte = 0;
+			if (++_pixel == length) {
+				_framing = ENDFRAME_LENGTH;
+			}
+			return true;
+		}
+
+		_pixelByte++;
+		return true;
+	}
+
+	/**
+	 * Rewind to the start of the frame
+	 * @param	listener	the listener to notify when an asynchronous flush is complete
+	 * @return true if the strip was idle, false if a flush is already running
+	 */
+	bool startFrame(APA102Listener *listener) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (_busy) {
+				return false;
+			}
+			_busy = true;
+		}
+
+		_listener = listener;
+		_pixel = 0;
+		_pixelByte = 0;
+		_framing = 4;
+
+		return true;
+	}
+
+	/**
+	 * Finish the frame, notifying the listener if there is one
+	 */
+	void endFrame() {
+		APA102Listener *listener = _listener;
+
+		_busy = false;
+		if (NULL != listener) {
+			listener->flushComplete();
+		}
+	}
+
+public:
+	/**
+	 * Constructor
+	 */
+	APA102() :
+		_pixel(0), _pixelByte(0), _framing(0), _busy(false), _listener(NULL) {
+		memset(_brightness, 31, sizeof(_brightness));
+	}
+
+	/**
+	 * Is a flush in progress?
+	 * @return true if a flush is in progress, the buffer should not be changed until it completes
+	 */
+	bool busy() {
+		return _busy;
+	}
+
+	/**
+	 * Set the 5 bit global brightness of a pixel
+	 * @param	pixel		the pixel to set
+	 * @param	brightness	the brightness, 0-31
+	 */
+	void setBrightness(uint16_t pixel, uint8_t brightness) {
+		_brightness[Strip::offset(pixel)] = brightness & 0x1f;
+	}
+
+	/**
+	 * Get the 5 bit global brightness of a pixel
+	 * @param	pixel		the pixel to get
+	 * @return the brightness, 0-31
+	 */
+	uint8_t getBrightness(uint16_t pixel) {
+		return _brightness[Strip::offset(pixel)];
+	}
+
+	/**
+	 * Set the 5 bit global brightness of the whole strip
+	 * @param	brightness	the brightness, 0-31
+	 */
+	void setAllBrightness(uint8_t brightness) {
+		memset(_brightness, brightness & 0x1f, sizeof(_brightness));
+	}
+
+	/**
+	 * Set a pixel to a gamma corrected value, using the global brightness to extend the range
+	 * The value is corrected to 16 bits, then split into the lowest global brightness that can
+	 * hold the brightest channel, and 8 bit channels at that brightness. Dim colours keep their
+	 * hue and smoothness rather than collapsing to a few steps.
+	 * @param	pixel	the pixel to set
+	 * @param	red		the red value
+	 * @param	green	the green value
+	 * @param	blue	the blue value
+	 */
+	void setPixelHighRange(uint16_t pixel, uint8_t red, uint8_t green, uint8_t blue) {
+		typedef GammaTable<gamma, 8, 16> Gamma16;
+
+		uint16_t red16 = Gamma16::correct(red);
+		uint16_t green16 = Gamma16::correct(green);
+		uint16_t blue16 = Gamma16::correct(blue);
+		uint16_t brightest = red16;
+
+		if (green16 > brightest) {
+			brightest = green16;
+		}
+		if (blue16 > brightest) {
+			brightest = blue16;
+		}
+
+		// The smallest brightness where brightest fits in 8 bits, channel = value * 31 / (257 * brightness)
+		uint8_t brightness = ((uint32_t)brightest * 31 + 65534) / 65535;
+		if (0 == brightness) {
+			brightness = 31;
+		}
+		uint16_t divisor = 257 * brightness;
+
+		uint16_t index = Strip::offset(pixel);
+		_brightness[index] = brightness;
+		Strip::_data[index].set(
+				((uint32_t)red16 * 31 + divisor / 2) / divisor,
+				((uint32_t)green16 * 31 + divisor / 2) / divisor,
+				((uint32_t)blue16 * 31 + divisor / 2) / divisor);
+	}
+};
+
+/**
+ * An APA102 or SK9822 strip driven by the hardware SPI port
+ * The clock and data pins are the SCK and MOSI pins of the SPI port. The SS pin must be an output,
+ * or held high, for the port to stay in master mode.
+ * For asynchronous flushes, the interrupt must be assigned with FLAME_APA102_SPI_ASSIGN_INTERRUPTS
+ *
+ * @tparam	clock...	the SCK pin
+ * @tparam	data...		the MOSI pin
+ * @tparam	length		the number of LEDs in the string
+ * @tparam	divider		the SPI clock divider, 2, 4, 8, 16, 32, 64 or 128
+ * @tparam	gamma		the gamma exponent for the LEDs, in hundredths
+ */
+template <FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), uint16_t length, uint8_t divider = 2,
+		uint16_t gamma = FLAME_GAMMA_DEFAULT>
+class APA102_SPI : public APA102<length, gamma> {
+	typedef APA102<length, gamma> Base;
+
+	static_assert(divider == 2 || divider == 4 || divider == 8 || divider == 16 ||
+			divider == 32 || divider == 64 || divider == 128, "Invalid SPI clock divider");
+
+public:
+	/**
+	 * Create a new driver for a string of APA102 LEDs on the SPI port
+	 */
+	APA102_SPI() {
+		setOutput(FLAME_PIN_PARMS(clock));
+		setOutput(FLAME_PIN_PARMS(data));
+
+		// Mode 0, MSB first, master
+		uint8_t rate;
+		switch (divider) {
+		case 2:
+		case 4:
+			rate = 0;
+			break;
+		case 8:
+		case 16:
+			rate = _BV(SPR0);
+			break;
+		case 32:
+		case 64:
+			rate = _BV(SPR1);
+			break;
+		default:
+			rate = _BV(SPR1) | _BV(SPR0);
+			break;
+		}
+		SPCR = _BV(SPE) | _BV(MSTR) | rate;
+		SPSR = (divider == 2 || divider == 8 || divider == 32) ? _BV(SPI2X) : 0;
+	}
+
+	/**
+	 * Write the current buffer to the string of chips, waiting until it has been sent
+	 * Interrupts are left enabled, the LEDs don't care about gaps in the clock
+	 * Each byte is worked out while the one before is still being shifted out
+	 */
+	void flush() {
+		uint8_t byte;
+
+		while (!Base::startFrame(NULL)) {}
+
+		// The start frame means there is always a first byte
+		Base::nextByte(&byte);
+		SPDR = byte;
+		while (Base::nextByte(&byte)) {
+			loop_until_bit_is_set(SPSR, SPIF);
+			SPDR = byte;
+		}
+		loop_until_bit_is_set(SPSR, SPIF);
+
+		Base::endFrame();
+	}
+
+	/**
+	 * Start writing the current buffer to the string of chips in the background
+	 * The buffer must not be changed until the flush completes
+	 * @param	listener	notified when the flush is complete, may be NULL
+	 * @return true if the flush was started, false if one is already in progress
+	 */
+	bool flushAsync(APA102Listener *listener) {
+		uint8_t byte;
+
+		if (!Base::startFrame(listener)) {
+			return false;
+		}
+
+		Base::nextByte(&byte);
+		SPCR |= _BV(SPIE);
+		SPDR = byte;
+
+		return true;
+	}
+
+	/**
+	 * SPI transfer complete interrupt handler
+	 */
+	void transmitted() {
+		uint8_t byte;
+
+		if (Base::nextByte(&byte)) {
+			SPDR = byte;
+			return;
+		}
+
+		SPCR &= ~_BV(SPIE);
+		Base::endFrame();
+	}
+};
+
+/**
+ * An APA102 or SK9822 strip driven by a USART in master SPI mode
+ * The clock and data pins are the XCK and TXD pins of the USART.
+ * For asynchronous flushes, the interrupt must be assigned with FLAME_APA102_USART_ASSIGN_INTERRUPTS.
+ * The data register empty interrupt refills the transmit buffer while the byte before is still
+ * being shifted out, so the clock runs back to back as long as the interrupt keeps up.
+ *
+ * @tparam	usart		the serial port parameters, eg. FLAME_USART0
+ * @tparam	clock...	the XCK pin
+ * @tparam	data...		the TXD pin
+ * @tparam	length		the number of LEDs in the string
+ * @tparam	divider		the clock divider, any even number from 2 to 512
+ * @tparam	gamma		the gamma exponent for the LEDs, in hundredths
+ */
+template <FLAME_DECLARE_USART(usart), FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data),
+		uint16_t length, uint16_t divider = 2, uint16_t gamma = FLAME_GAMMA_DEFAULT>
+class APA102_USART : public APA102<length, gamma> {
+	typedef APA102<length, gamma> Base;
+
+	static_assert(divider >= 2 && divider <= 512 && !(divider & 1), "Invalid USART clock divider");
+
+	INLINE void waitForDataEmpty() {
+		while (!(_MMIO_BYTE(usartStatus) & _BV(usartDataEmpty))) {}
+	}
+
+public:
+	/**
+	 * Create a new driver for a string of APA102 LEDs on a USART
+	 */
+	APA102_USART() {
+		setOutput(FLAME_PIN_PARMS(clock));
+		setOutput(FLAME_PIN_PARMS(data));
+
+		// The baud rate must be zero while the port is set up
+		_MMIO_BYTE(usartBaud) = 0;
+		_MMIO_BYTE(usartControlC) = 0xc0;	// Master SPI, mode 0, MSB first
+		_MMIO_BYTE(usartControlB) = _BV(usartTxEnable);
+		_MMIO_BYTE(usartBaud) = divider / 2 - 1;
+	}
+
+	/**
+	 * Write the current buffer to the string of chips, waiting until it has been sent
+	 * The transmit buffer keeps the clock running back to back
+	 */
+	void flush() {
+		uint8_t byte;
+
+		while (!Base::startFrame(NULL)) {}
+
+		while (Base::nextByte(&byte)) {
+			waitForDataEmpty();
+			_MMIO_BYTE(usartIO) = byte;
+		}
+
+		Base::endFrame();
+	}
+
+	/**
+	 * Start writing the current buffer to the string of chips in the background
+	 * The buffer must not be changed until the flush completes
+	 * @param	listener	notified when the flush is complete, may be NULL
+	 * @return true if the flush was started, false if one is already in progress
+	 */
+	bool flushAsync(APA102Listener *listener) {
+		uint8_t byte;
+
+		if (!Base::startFrame(listener)) {
+			return false;
+		}
+
+		// UDRIEn is the same bit in UCSRnB as UDREn is in UCSRnA
+		Base::nextByte(&byte);
+		waitForDataEmpty();
+		_MMIO_BYTE(usartIO) = byte;
+		_MMIO_BYTE(usartControlB) |= _BV(usartDataEmpty);
+
+		return true;
+	}
+
+	/**
+	 * USART data register empty interrupt handler
+	 */
+	void transmitted() {
+		uint8_t byte;
+
+		if (Base::nextByte(&byte)) {
+			_MMIO_BYTE(usartIO) = byte;
+			return;
+		}
+
+		_MMIO_BYTE(usartControlB) &= ~_BV(usartDataEmpty);
+		Base::endFrame();
+	}
+};
+
+}
+#endif /* FLAME_APA102_H_ */
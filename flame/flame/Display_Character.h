@@ -27,6 +27,7 @@
 #ifndef FLAME_DISPLAY_CHARACTER_H_
 #define FLAME_DISPLAY_CHARACTER_H_
 
+#include <string.h>
 #include <flame/Device_TX.h>
 
 namespace flame {
@@ -34,6 +35,8 @@ namespace flame {
 /**
  * A generic text display
  * Origin (0,0) is bottom left
+ * A RAM shadow of the display contents is kept, so only characters that change are sent to the display,
+ * and scrolling does not need to read the display back
  * @tparam	cols		the number of columns
  * @tparam	rows		the number of rows
  * @tparam	txBuffers	the number of output buffers
@@ -46,6 +49,73 @@ protected:
 	bool			_scroll;
 	uint16_t		_currentRow;
 	uint16_t		_currentCol;
+	char			_shadow[rows][cols];	// what the display is showing
+	uint8_t			_displayRow;			// where the display will write the next character
+	uint8_t			_displayCol;
+	bool			_displayCursorValid;	// false if the display's address is unknown
+
+	/**
+	 * Fill the shadow, after the display has been filled with a character by other means
+	 * @param	character	the character the display now holds in every cell
+	 */
+	void fillShadow(char character) {
+		memset(_shadow, character, sizeof(_shadow));
+	}
+
+	/**
+	 * Forget where the display will write the next character
+	 * Subclasses must call this after anything that moves the display's address (eg. clearing, CGRAM writes)
+	 */
+	void invalidateCursor() {
+		_displayCursorValid = false;
+	}
+
+	/**
+	 * Put a character in a cell, sending it to the display only if it differs from what is there
+	 * Writes to consecutive cells are sent as a single run, relying on the display auto-incrementing its address
+	 * @param	col			the column of the cell
+	 * @param	row			the row of the cell
+	 * @param	character	the character to put
+	 */
+	void putChar(uint16_t col, uint16_t row, char character) {
+		if (col >= cols || row >= rows) {
+			return;
+		}
+
+		char *cell = &_shadow[row][col];
+		if (*cell == character) {
+			return;
+		}
+		cellChanged(*cell, character);
+		*cell = character;
+
+		if (!_displayCursorValid || _displayCol != col || _displayRow != row) {
+			_setCursor(col, row);
+			_displayRow = row;
+			_displayCursorValid = true;
+		}
+
+		_writeChar(character);
+		_displayCol = col + 1;
+	}
+
+	/**
+	 * Move the current position to the start of the next line, scrolling if needed
+	 * @return false if the position is still on the same line
+	 */
+	bool nextLine() {
+		_currentCol = 0;
+
+		if (_currentRow > 0) {
+			_currentRow--;
+		} else if (_scroll) {
+			scrollVertically();
+		} else {
+			return false;
+		}
+
+		return true;
+	}
 
 public:
 	/**
@@ -55,7 +125,12 @@ public:
 		_wrap(true),
 		_scroll(true),
 		_currentRow(0),
-		_currentCol(0) {}
+		_currentCol(0),
+		_displayRow(0),
+		_displayCol(0),
+		_displayCursorValid(false) {
+		fillShadow(' ');
+	}
 
 
 	/**
@@ -395,13 +470,42 @@ public:
 
 	/**
 	 * Position the cursor
+	 * The display's address is only moved when a changed character is written
 	 * @param	col		the column to set
 	 * @param	row		the row to set
 	 */
 	void setCursor(uint16_t col, uint16_t row) {
 		_currentRow = row;
 		_currentCol = col;
-		_setCursor(col, row);
+	}
+
+	/**
+	 * Get a character from the shadow of the display
+	 * @param	col		the column of the character
+	 * @param	row		the row of the character
+	 * @return the character, or a space if the position is off the display
+	 */
+	char getChar(uint16_t col, uint16_t row) {
+		if (col >= cols || row >= rows) {
+			return ' ';
+		}
+
+		return _shadow[row][col];
+	}
+
+	/**
+	 * Resend the whole shadow to the display
+	 * Use this if the display contents may no longer match the shadow (eg. after a brownout)
+	 */
+	void redraw() {
+		for (uint8_t y = 0; y < rows; y++) {
+			_setCursor(0, y);
+			for (uint8_t x = 0; x < cols; x++) {
+				_writeChar(_shadow[y][x]);
+			}
+		}
+
+		invalidateCursor();
 	}
 
 	/**
@@ -430,65 +534,44 @@ public:
 			_currentCol = (_currentCol + 4) & ~(4 - 1);
 			if (_currentCol >= cols) {
 				if (_wrap) {
-					if (_currentRow > 0) {
-						_currentRow--;
-					} else if (_scroll) {
-						scrollVertically();
-						break;
-					}
-					_currentCol = 0;
+					nextLine();
 				} else {
 					_currentCol = cols - 1;
 				}
 			}
-			setCursor(_currentCol, _currentRow);
 			break;
 		case '\n':
-			if (_currentRow > 0) {
-				_currentRow--;
-			} else if (_scroll) {
-				scrollVertically();
-			}
-			_currentCol = 0;
-			setCursor(_currentCol, _currentRow);
+			nextLine();
 			break;
 		default:
-			if (_currentCol++ >= cols - 1 && _wrap) {
-				_currentCol = 0;
-				if (_currentRow > 0) {
-					_currentRow--;
-				} else if (_scroll) {
-					scrollVertically();
-				} else {
-					setCursor(_currentCol, _currentRow);
+			putChar(_currentCol, _currentRow, character);
+			if (++_currentCol >= cols && _wrap) {
+				if (!nextLine()) {
+	// Nowhere to go, overwrite the start of this line
+					_currentCol = 0;
 				}
 			}
-			_writeChar(character);
 			break;
 		}
 	}
 
 	/**
 	 * Scroll the display up, leaving a blank line at the bottom
+	 * This is computed from the shadow, only characters that change are sent to the display
 	 */
 	void scrollVertically() {
 		uint16_t x, y;
-		char	c;
 
-		for (y = rows - 2; y > 0; y--) {
-	// Copy each character in this row to the row above
+	// Copy each row to the row above, starting at the top so the source row is still intact
+		for (y = rows - 1; y > 0; y--) {
 			for (x = 0; x < cols; ++x) {
-				_setCursor(x, y + 1);
-				c = _readChar();
-				_setCursor(x, y);
-				_writeChar(c);
+				putChar(x, y, _shadow[y - 1][x]);
 			}
 		}
 
 	// Blank the last row
-		_setCursor(0, 0);
 		for (x = 0; x < cols; ++x) {
-			_writeChar(' ');
+			putChar(x, 0, ' ');
 		}
 
 	// Set the cursor ready to write another line
@@ -497,6 +580,14 @@ public:
 
 
 
+	/**
+	 * Called when a cell is about to change, subclasses may override this to track what is on the display
+	 * @param	oldCharacter	the character that was in the cell
+	 * @param	newCharacter	the character that will be in the cell
+	 */
+	virtual void cellChanged(UNUSED char oldCharacter, UNUSED char newCharacter) {
+	}
+
 // Subclasses must implement these
 	virtual void _writeChar(char character)=0;
 	virtual char _readChar()=0;
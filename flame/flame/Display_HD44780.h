@@ -28,8 +28,17 @@
 #define FLAME_DISPLAY_HD44780_H_
 
 #include <flame/Display_Character.h>
+#include <flame/CharRingBuffer.h>
 #define HD44780_TINIT	300		// ms
 
+// The number of custom glyphs the controller can hold (5x8 font)
+#define HD44780_GLYPH_SLOTS	8
+// Character codes 8-15 show the same glyphs as 0-7, and avoid using NUL in the shadow
+#define HD44780_GLYPH_CHAR	8
+
+// Above this many non-blank characters, the clear command (1.52ms) is quicker than blanking them one by one (37us each)
+#define HD44780_CLEAR_CELLS	40
+
 
 namespace flame {
 
@@ -59,13 +68,27 @@ INLINE uint8_t operator| (HD44780Command command, uint8_t oredWith) {
 	return(myCommand | oredWith);
 }
 
+/**
+ * A class which will be notified when the HD44780 command queue has been emptied
+ */
+class HD44780Listener {
+public:
+	/**
+	 * Called from tick() once the last queued byte has been sent to the display
+	 */
+	virtual void frameComplete() =0;
+	virtual ~HD44780Listener() {};
+};
+
 /**
  * A class for operating HD44780 based LCD displays (and compatible)
  * @tparam	cols		the number of columns
  * @tparam	rows		the number of rows
  * @tparam	txBuffers	the number of output buffers
+ * @tparam	queueLength	the number of commands & characters that can be queued for tick() to send,
+ * 						0 to send them immediately, waiting for the display
  */
-template<uint16_t cols, uint16_t rows, uint8_t txBuffers>
+template<uint16_t cols, uint16_t rows, uint8_t txBuffers, uint8_t queueLength = 0>
 class Display_HD44780 : public Display_Character<cols, rows, txBuffers> {
 protected:
 	uint16_t			_ticks;
@@ -73,6 +96,87 @@ protected:
 	bool 				_mustDelay;
 	bool				_byteMode;
 
+	// Each queue entry is the HD44780Command (WRITE_CHAR for data) followed by the byte to write
+	CharRingBufferImplementation<queueLength ? queueLength * 2 : 1>
+						_queue;
+	bool				_queueing;		// true once init has completed, if there is a queue
+	volatile bool		_queuePending;	// true until frameComplete is called for the queued bytes
+	uint8_t				_holdTicks;		// ticks to wait for the last command to complete
+	uint16_t			_tickPeriod;	// us
+	HD44780Listener		*_listener;
+
+	// The glyph cache
+	const uint8_t		*_glyphs[HD44780_GLYPH_SLOTS];		// the PROGMEM glyph loaded into each CGRAM slot
+	uint8_t				_glyphRefs[HD44780_GLYPH_SLOTS];	// the number of cells showing each slot
+	uint8_t				_glyphOrder[HD44780_GLYPH_SLOTS];	// the slots, most recently used first
+
+	/**
+	 * Get the glyph slot a character shows
+	 * @param	character	the character
+	 * @return the slot, or HD44780_GLYPH_SLOTS if the character is not a custom glyph
+	 */
+	static uint8_t glyphSlot(char character) {
+		uint8_t slot = (uint8_t)character & ~HD44780_GLYPH_CHAR;
+
+		return ((uint8_t)character & ~(HD44780_GLYPH_CHAR | (HD44780_GLYPH_SLOTS - 1))) ?
+				HD44780_GLYPH_SLOTS : slot;
+	}
+
+	/**
+	 * Keep the glyph reference counts up to date as cells change
+	 * @param	oldCharacter	the character that was in the cell
+	 * @param	newCharacter	the character that will be in the cell
+	 */
+	void cellChanged(char oldCharacter, char newCharacter) {
+		uint8_t slot = glyphSlot(oldCharacter);
+		if (slot < HD44780_GLYPH_SLOTS && _glyphRefs[slot]) {
+			_glyphRefs[slot]--;
+		}
+
+		slot = glyphSlot(newCharacter);
+		if (slot < HD44780_GLYPH_SLOTS) {
+			_glyphRefs[slot]++;
+		}
+	}
+
+	/**
+	 * Forget the contents of CGRAM
+	 */
+	void forgetGlyphs() {
+		for (uint8_t slot = 0; slot < HD44780_GLYPH_SLOTS; slot++) {
+			_glyphs[slot] = NULL;
+			_glyphRefs[slot] = 0;
+			_glyphOrder[slot] = slot;
+		}
+	}
+
+	/**
+	 * Send a byte to the display, or queue it if there is a queue
+	 * @param	command		the command, or WRITE_CHAR for a character
+	 * @param	byte		the byte to write, including the command bits
+	 */
+	void send(HD44780Command command, uint8_t byte) {
+		if (!_queueing) {
+			while (isBusy()) {};
+
+			if (_mustDelay) {
+				_delay_us(19);
+				_mustDelay = false;
+			}
+
+			writeByte(byte, HD44780Command::WRITE_CHAR == command);
+			delay(command);
+			return;
+		}
+
+		uint8_t entry[2] = { (uint8_t)command, byte };
+
+		// Wait for tick() to make room
+		while (_queue.append(entry, 2)) {};
+
+		_queuePending = true;
+	}
+
 	/**
 	 * Send a command to the display
 	 */
@@ -112,9 +216,7 @@ protected:
 	 * @param	address	the CGRAM address
 	 */
 	void addressCGRAM(uint8_t address) {
-		while (isBusy()) {};
-
-		writeCommand(HD44780Command::SET_CG_ADDR, address);
+		send(HD44780Command::SET_CG_ADDR, HD44780Command::SET_CG_ADDR | address);
 	}
 
 	/**
@@ -122,9 +224,7 @@ protected:
 	 * @param	address	the DDRAM address
 	 */
 	void addressDDRAM(uint8_t address) {
-		while (isBusy()) {};
-
-		writeCommand(HD44780Command::SET_DD_ADDR, address);
+		send(HD44780Command::SET_DD_ADDR, HD44780Command::SET_DD_ADDR | address);
 	}
 
 	virtual void writeByte(uint8_t byte, bool rs)=0;
@@ -156,8 +256,6 @@ protected:
 #endif
 		address += col;
 
-		while (isBusy()) {};
-
 		addressDDRAM(address);
 	}
 
@@ -166,16 +264,16 @@ protected:
 	 * @param	character	the character to write
 	 */
 	void _writeChar(char character) {
-		while (isBusy()) {};
-		writeByte(character, true);
-		delay(HD44780Command::WRITE_CHAR);
+		send(HD44780Command::WRITE_CHAR, character);
 	}
 
 	/**
 	 * Read a character from the display at the current location, incrementing the location by 1
+	 * Waits for the queue to be sent first
 	 * @return	the character at the current location
 	 */
 	char _readChar() {
+		while (_queuePending) {};
 		while (isBusy()) {};
 		return readByte(true);
 	}
@@ -183,6 +281,26 @@ protected:
 	virtual bool isBusy()=0;
 	virtual void delay(HD44780Command command)=0;
 
+	/**
+	 * Get how long a command takes to execute, for displays which can't report when they are busy
+	 * @param	command		the command
+	 * @return the time in microseconds that tick() must wait before sending anything else, 0 if isBusy() can be used
+	 */
+	virtual uint16_t commandTime(HD44780Command command)=0;
+
+	/**
+	 * Clear the display with the clear command, regardless of what is on it
+	 */
+	void clearController() {
+		send(HD44780Command::CLEAR, HD44780Command::CLEAR | 0);
+		Display_Character<cols, rows, txBuffers>::fillShadow(' ');
+		Display_Character<cols, rows, txBuffers>::invalidateCursor();
+
+		for (uint8_t slot = 0; slot < HD44780_GLYPH_SLOTS; slot++) {
+			_glyphRefs[slot] = 0;
+		}
+	}
+
 public:
 	/**
 	 * Create a new display
@@ -191,6 +309,75 @@ public:
 		_ticks = 0;
 		_animateTicks = 64;
 		_mustDelay = false;
+		_queueing = false;
+		_queuePending = false;
+		_holdTicks = 0;
+		_tickPeriod = 500;
+		_listener = NULL;
+		forgetGlyphs();
+	}
+
+	/**
+	 * Set the listener to notify when the queue has been sent
+	 * @param	listener	the listener, or NULL for none
+	 */
+	void setListener(HD44780Listener *listener) {
+		_listener = listener;
+	}
+
+	/**
+	 * Tell the display how often tick() is called, so it can time commands on displays without a busy flag
+	 * @param	usec	the period between calls to tick(), in microseconds (default 500)
+	 */
+	void setTickPeriod(uint16_t usec) {
+		_tickPeriod = usec;
+	}
+
+	/**
+	 * Check if there are queued bytes that have not been sent to the display yet
+	 * @return true if the queue has not been sent
+	 */
+	bool pending() {
+		return _queuePending;
+	}
+
+	/**
+	 * Send the next queued byte to the display, if it is ready for it
+	 * Call this periodically from a timer (at least every tick period, each call sends at most 1 byte)
+	 */
+	void tick() {
+		if (_holdTicks) {
+			_holdTicks--;
+			return;
+		}
+
+		int command = _queue.peek();
+		if (-1 == command) {
+			if (_queuePending) {
+				_queuePending = false;
+				if (_listener) {
+					_listener->frameComplete();
+				}
+			}
+			return;
+		}
+
+		if (isBusy()) {
+			return;
+		}
+
+		if (_mustDelay) {
+			_delay_us(19);
+			_mustDelay = false;
+		}
+
+		_queue.consume();
+		writeByte(_queue.consume(), HD44780Command::WRITE_CHAR == (HD44780Command)command);
+
+		uint16_t time = commandTime((HD44780Command)command);
+		if (time) {
+			_holdTicks = (time - 1) / _tickPeriod;
+		}
 	}
 
 	/**
@@ -210,6 +397,12 @@ public:
 	 */
 		_delay_ms(HD44780_TINIT);
 
+	// Anything still queued is discarded, the display is about to be reset
+		_queueing = false;
+		_queue.flush();
+		_queuePending = false;
+		_holdTicks = 0;
+
 	// hardware initialization always set 8 bits mode
 		_byteMode = true;
 		uint8_t resetData = 1 << 4 | multiLine << 3 | bigFont << 2 | 1;
@@ -223,23 +416,128 @@ public:
 		function(byteMode, multiLine, bigFont);
 		_delay_us(39);
 		control(true, cursorOn, cursorBlink);
-		clear();
+	// The contents are unknown, so the shadow & CGRAM can't be trusted yet
+		forgetGlyphs();
+		clearController();
 		entryMode(left2right, scroll);
 		Display_Character<cols, rows, txBuffers>::_currentRow = rows - 1;
 		Display_Character<cols, rows, txBuffers>::_currentCol = 0;
+
+	// From here on, writes are queued for tick() to send
+		_queueing = queueLength > 0;
 	}
 
 	/**
 	 * Clear the display
+	 * If only a few characters are showing, they are blanked individually, otherwise the clear command is used
 	 */
 	void clear() {
-		while (isBusy()) {};
+		uint8_t used = 0;
+		uint8_t x, y;
+
+		for (y = 0; y < rows; y++) {
+			for (x = 0; x < cols; x++) {
+				if (' ' != Display_Character<cols, rows, txBuffers>::_shadow[y][x]) {
+					used++;
+				}
+			}
+		}
+
+		if (used > HD44780_CLEAR_CELLS) {
+			clearController();
+		} else if (used) {
+			for (y = 0; y < rows; y++) {
+				for (x = 0; x < cols; x++) {
+					Display_Character<cols, rows, txBuffers>::putChar(x, y, ' ');
+				}
+			}
+		}
 
-		writeCommand(HD44780Command::CLEAR, 0);
 		Display_Character<cols, rows, txBuffers>::_currentRow = rows - 1;
 		Display_Character<cols, rows, txBuffers>::_currentCol = 0;
 	}
 
+	/**
+	 * Load a glyph into CGRAM, unless it is already there
+	 * The least recently used slot that is not on the display is replaced
+	 * @param	glyph	the glyph in PROGMEM, 8 rows from the top, with the pixels in the lower 5 bits
+	 * @return the character that shows the glyph, or '\0' if all slots are on the display
+	 */
+	char loadGlyph(const uint8_t *glyph) {
+		uint8_t position;
+		uint8_t slot;
+
+		for (position = 0; position < HD44780_GLYPH_SLOTS; position++) {
+			if (_glyphs[_glyphOrder[position]] == glyph) {
+				break;
+			}
+		}
+
+		if (HD44780_GLYPH_SLOTS == position) {
+	// Not loaded, find the least recently used slot that is not on the display
+			do {
+				if (0 == position) {
+					return '\0';
+				}
+				position--;
+			} while (_glyphRefs[_glyphOrder[position]]);
+
+			slot = _glyphOrder[position];
+			_glyphs[slot] = glyph;
+
+			addressCGRAM(slot * 8);
+			for (uint8_t line = 0; line < 8; line++) {
+				send(HD44780Command::WRITE_CHAR, pgm_read_byte(glyph + line));
+			}
+
+	// The address counter now points into CGRAM
+			Display_Character<cols, rows, txBuffers>::invalidateCursor();
+		}
+
+	// Move the slot to the front
+		slot = _glyphOrder[position];
+		for (; position > 0; position--) {
+			_glyphOrder[position] = _glyphOrder[position - 1];
+		}
+		_glyphOrder[0] = slot;
+
+		return HD44780_GLYPH_CHAR + slot;
+	}
+
+	/**
+	 * Show a custom glyph in a cell
+	 * CGRAM is only written if the glyph is not already loaded, so many glyphs can share the 8 slots
+	 * as long as no more than 8 different ones are on the display at once
+	 * @param	col		the column of the cell
+	 * @param	row		the row of the cell
+	 * @param	glyph	the glyph in PROGMEM, 8 rows from the top, with the pixels in the lower 5 bits
+	 * @return true if the glyph was shown, false if all slots are on the display or the cell is off the display
+	 */
+	bool putGlyph(uint16_t col, uint16_t row, const uint8_t *glyph) {
+		if (col >= cols || row >= rows) {
+			return false;
+		}
+
+	// The glyph in this cell is about to be replaced, so its slot may be reused
+		uint8_t oldSlot = glyphSlot(Display_Character<cols, rows, txBuffers>::getChar(col, row));
+		if (oldSlot < HD44780_GLYPH_SLOTS) {
+			_glyphRefs[oldSlot]--;
+		}
+
+		char character = loadGlyph(glyph);
+
+		if (oldSlot < HD44780_GLYPH_SLOTS) {
+			_glyphRefs[oldSlot]++;
+		}
+
+		if ('\0' == character) {
+			return false;
+		}
+
+		Display_Character<cols, rows, txBuffers>::putChar(col, row, character);
+		return true;
+	}
+
 	/**
 	 * Set the entry mode - allows for left or right printing, allows for scrolling display or moving cursor
 	 * @param	left2Right	true for text reading left to right
@@ -248,9 +546,7 @@ public:
 	void entryMode(bool left2Right, bool scroll) {
 		uint8_t data = left2Right << 1 | scroll;
 
-		while (isBusy()) {};
-
-		writeCommand(HD44780Command::SET_ENTRY_MODE, data);
+		send(HD44780Command::SET_ENTRY_MODE, HD44780Command::SET_ENTRY_MODE | data);
 	}
 
 	/**
@@ -262,9 +558,7 @@ public:
 	void control(bool displayOn, bool cursorOn, bool cursorBlink) {
 		uint8_t data = displayOn << 2 | cursorOn << 1 | cursorBlink;
 
-		while (isBusy()) {};
-
-		writeCommand(HD44780Command::SET_DISPLAY_MODE, data);
+		send(HD44780Command::SET_DISPLAY_MODE, HD44780Command::SET_DISPLAY_MODE | data);
 	}
 };
 
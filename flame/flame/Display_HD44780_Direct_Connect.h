@@ -79,10 +79,11 @@ namespace flame {
  * @tparam	data...		pin declaration for the first bit of the data port DB4..DB7 (will use a nibble starting at this bit)
  * @tparam	control...	pin declaration for the first bit of the control port (will use 3 bits)
  * @tparam	visual...	pin declaration for the first bit of the visual port (will use 2 bits)
+ * @tparam	queueLength	the number of commands & characters that can be queued for alarm() to send, 0 for none
  */
 template<uint16_t cols, uint16_t rows, uint8_t txBuffers, FLAME_DECLARE_PIN(data),
-FLAME_DECLARE_PIN(control), FLAME_DECLARE_PIN(visual)>
-class Display_HD44780_Direct_Connect : public Display_HD44780<cols, rows, txBuffers>,
+FLAME_DECLARE_PIN(control), FLAME_DECLARE_PIN(visual), uint8_t queueLength = 0>
+class Display_HD44780_Direct_Connect : public Display_HD44780<cols, rows, txBuffers, queueLength>,
 	public TimerListener {
 protected:
 	uint8_t			_brightness;
@@ -174,7 +175,7 @@ protected:
 		_SFR_IO8(controlOut) &= ~(HD44780_E | HD44780_RW);
 		_SFR_IO8(dataDir) |= HD44780_DB7;
 
-		Display_HD44780<cols, rows, txBuffers>::_mustDelay = true;
+		Display_HD44780<cols, rows, txBuffers, queueLength>::_mustDelay = true;
 
 		return busy;
 	}
@@ -187,6 +188,14 @@ protected:
 		return;
 	}
 
+	/**
+	 * Command timing for the queue
+	 * Not required as we can check whether the display is busy
+	 */
+	uint16_t CONST commandTime(UNUSED HD44780Command command) {
+		return 0;
+	}
+
 public:
 	/**
 	 * Create a new driver for a directly connected HD44780 display
@@ -234,9 +243,11 @@ public:
 	}
 
 	/**
-	 * Tick the display for PWM - this should be called every 500 microseconds
+	 * Tick the display for PWM & send the next queued byte - this should be called every 500 microseconds
 	 */
 	void alarm(UNUSED AlarmSource source) {
+		Display_HD44780<cols, rows, txBuffers, queueLength>::tick();
+
 		if (0 == _ticks) {
 			_SFR_IO8(visualOut) |= HD44780_LED;
 			_SFR_IO8(visualOut) |= HD44780_CONTRAST;
@@ -266,7 +277,7 @@ public:
 	 */
 	void init(bool multiLine, bool bigFont, bool cursorOn, bool cursorBlink,
 					bool left2right, bool scroll) {
-		Display_HD44780<cols, rows, txBuffers>::init(
+		Display_HD44780<cols, rows, txBuffers, queueLength>::init(
 				false, multiLine, bigFont, cursorOn, cursorBlink, left2right, scroll);
 	}
 
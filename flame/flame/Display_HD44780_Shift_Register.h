@@ -28,6 +28,7 @@
 #define DISPLAY_HD44780_SHIFT_REGISTER_H_
 
 #include <flame/Display_HD44780.h>
+#include <flame/Timer.h>
 #define FLAME_SHIFT_ORDER_MSB
 #define FLAME_SHIFT_WRITECLOCK NULL,_clockOut,NULL,_clockPin,-1
 #define FLAME_SHIFT_WRITEDATA NULL,_dataOut,NULL,_dataPin,-1
@@ -48,10 +49,12 @@ namespace flame {
  * @tparam clock...		the clock pin
  * @tparam data...		the data pin (should be on the same port as clock)
  * @tparam enable...	the enable pin
+ * @tparam	queueLength	the number of commands & characters that can be queued for alarm() to send, 0 for none
  */
 template<uint16_t cols, uint16_t rows, uint8_t txBuffers,
-	FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), FLAME_DECLARE_PIN(enable)>
-class Display_HD44780_Shift_Register : public Display_HD44780<cols, rows, txBuffers> {
+	FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), FLAME_DECLARE_PIN(enable), uint8_t queueLength = 0>
+class Display_HD44780_Shift_Register : public Display_HD44780<cols, rows, txBuffers, queueLength>,
+	public TimerListener {
 private:
 	ShifterImplementation<FLAME_PIN_PARMS(clock), FLAME_PIN_PARMS(data)> _shifter;
 
@@ -82,7 +85,7 @@ protected:
 	 * @param	rs		true to set the RS pin (aka data pin )
 	 */
 	void writeByte(uint8_t byte, bool rs) {
-		if (Display_HD44780<cols, rows, txBuffers>::_byteMode) {
+		if (Display_HD44780<cols, rows, txBuffers, queueLength>::_byteMode) {
 	// 8 bits interface mode
 			pushBits(byte, rs);
 		} else {
@@ -132,6 +135,21 @@ protected:
 		}
 	}
 
+	/**
+	 * Command timing for the queue, matching delay()
+	 * @param	command		the command
+	 * @return the time in microseconds to wait before sending anything else
+	 */
+	uint16_t CONST commandTime(HD44780Command command) {
+		switch (command) {
+		case HD44780Command::CLEAR:
+		case HD44780Command::HOME:
+			return 2000;
+		default:
+			return 39;
+		}
+	}
+
 public:
 	/**
 	 * A class for operating HD44780 based LCD displays via a shift register such as a 74HC164
@@ -154,9 +172,16 @@ public:
 	 */
 	void init(bool multiLine, bool bigFont, bool cursorOn, bool cursorBlink,
 					bool left2right, bool scroll) {
-		Display_HD44780<cols, rows, txBuffers>::init(
+		Display_HD44780<cols, rows, txBuffers, queueLength>::init(
 				false, multiLine, bigFont, cursorOn, cursorBlink, left2right, scroll);
 	}
+
+	/**
+	 * Send the next queued byte - call this from a timer, and tell the display the period with setTickPeriod()
+	 */
+	void alarm(UNUSED AlarmSource source) {
+		Display_HD44780<cols, rows, txBuffers, queueLength>::tick();
+	}
 };
 
 }
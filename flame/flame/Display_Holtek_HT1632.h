@@ -28,6 +28,7 @@
 
 #include <flame/Display_Monochrome.h>
 #include <flame/Shifter.h>
+#include <flame/Timer.h>
 
 #define FLAME_HT1632_BRIGHTNESS_MIN	0
 #define FLAME_HT1632_BRIGHTNESS_MED	7
@@ -48,6 +49,19 @@ enum class HT1632Mode : uint8_t {
 	PMOS_24x16	=	0b11
 };
 
+/**
+ * A class which will be notified when a background frame transfer completes
+ */
+class HT1632Listener {
+public:
+	/**
+	 * Called from the interrupt handler once the last module of a frame has been written
+	 * The next frame may be swapped in from here
+	 */
+	virtual void frameComplete() =0;
+	virtual ~HT1632Listener() {};
+};
+
 /**
  * Create a new HT1632 driver to control an array of displays
  *
@@ -74,20 +88,34 @@ enum class HT1632Mode : uint8_t {
  * @tparam	arrayX			the width of the array in number of displays
  * @tparam	arrayY			the height of the array in number of displays
  * @tparam	txBuffers		the number of output buffers
+ * @tparam	doubleBuffered	true to keep a front buffer that is sent in the background by swap()
  */
 #define MODULE_X ((mode == HT1632Mode::NMOS_32x8 || mode == HT1632Mode::PMOS_32x8) ? 32 : 24)
 #define MODULE_Y ((mode == HT1632Mode::NMOS_32x8 || mode == HT1632Mode::PMOS_32x8) ? 8 : 16)
 #define DISPLAY_X (arrayX * MODULE_X)
 #define DISPLAY_Y (arrayY * MODULE_Y)
 template <FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), HT1632Mode mode,
-		uint8_t arrayX, uint8_t arrayY, uint8_t txBuffers>
-class Display_Holtek_HT1632 : public Display_Monochrome<DISPLAY_Y, DISPLAY_X, txBuffers> {
+		uint8_t arrayX, uint8_t arrayY, uint8_t txBuffers, bool doubleBuffered = false>
+class Display_Holtek_HT1632 : public Display_Monochrome<DISPLAY_X, DISPLAY_Y, txBuffers>,
+	public TimerListener {
 private:
 	ShifterImplementation<FLAME_PIN_PARMS(clock), FLAME_PIN_PARMS(data)>
 							_shifter;
 	Display_Selector	&_selector;
 #define DISPLAY_BYTES ((mode == HT1632Mode::NMOS_32x8 || mode == HT1632Mode::PMOS_32x8) ? 32 : 48)
 	uint8_t					_frameBuffer[arrayX * arrayY * DISPLAY_BYTES];
+	uint8_t					_dirty[arrayX * arrayY * DISPLAY_BYTES / 8];	// 1 bit per framebuffer byte
+
+	// The frame being sent in the background, only allocated if doubleBuffered
+	// Outside of a swap, this always matches the display RAM, as runs may bridge clean bytes
+#define FRONT_BYTES (doubleBuffered ? arrayX * arrayY * DISPLAY_BYTES : 1)
+	uint8_t					_front[FRONT_BYTES];
+	uint8_t					_frontDirty[(FRONT_BYTES + 7) / 8];
+	HT1632Listener			*_listener;
+	volatile bool			_txBusy;
+	uint8_t					_txModule;		// the module being sent
+	uint8_t					_txOffset;		// the next byte of the module to send
+	uint8_t					_txEnd;			// the end of the run being sent, 0 if between runs
 
 	/**
 	 *  Send a command to the display module
@@ -110,13 +138,128 @@ private:
 	}
 
 	/**
-	 * Set up the display to stream output
+	 * Set up the display to stream output from a RAM address
 	 * @param moduleX	the module to write to
 	 * @param moduleY	the module to write to
+	 * @param address	the nibble address in the module RAM to start writing at
 	 */
-	void outputStart(uint8_t moduleX, uint8_t moduleY) {
+	void outputStart(uint8_t moduleX, uint8_t moduleY, uint8_t address) {
 		sendCommand(moduleX, moduleY, HT1632Command::WRITE);
-		_shifter.shiftOut((uint8_t)0b0, (uint8_t)7);
+		_shifter.shiftOut(address, (uint8_t)7);
+	}
+
+	/**
+	 * Write a framebuffer byte, marking it dirty if it changes
+	 * @param data		the framebuffer byte
+	 * @param value		the new value
+	 */
+	INLINE void update(uint8_t *data, uint8_t value) {
+		if (*data != value) {
+			*data = value;
+
+			uint16_t offset = data - _frameBuffer;
+			_dirty[offset >> 3] |= 1 << (offset & 7);
+		}
+	}
+
+	/**
+	 * Check if a framebuffer byte needs to be sent to the display
+	 * @param dirty		the dirty bitmap
+	 * @param offset	the offset of the byte in the framebuffer
+	 * @return true if the byte is dirty
+	 */
+	INLINE static bool isDirty(const uint8_t *dirty, uint16_t offset) {
+		return dirty[offset >> 3] & (1 << (offset & 7));
+	}
+
+	/**
+	 * Check if any byte of a module needs to be sent to the display
+	 * @param dirty		the dirty bitmap
+	 * @param module	the index of the module (moduleY * arrayX + moduleX)
+	 * @return true if the module is dirty
+	 */
+	static bool moduleDirty(const uint8_t *dirty, uint8_t module) {
+		uint8_t any = 0;
+		dirty += (uint16_t)module * (DISPLAY_BYTES / 8);
+
+		for (uint8_t i = 0; i < DISPLAY_BYTES / 8; i++) {
+			any |= dirty[i];
+		}
+
+		return any;
+	}
+
+	/**
+	 * Find the next run of dirty bytes in a module
+	 * A single clean byte between 2 dirty runs is included in the run rather than starting a new write,
+	 * as it costs fewer clocks than another command and address
+	 * @param dirty		the dirty bitmap
+	 * @param module	the index of the module (moduleY * arrayX + moduleX)
+	 * @param start		input: the byte of the module to start searching from, output: the start of the run
+	 * @return the end of the run (exclusive), 0 if there are no more dirty bytes in the module
+	 */
+	static uint8_t nextRun(const uint8_t *dirty, uint8_t module, uint8_t *start) {
+		uint16_t moduleStart = (uint16_t)module * DISPLAY_BYTES;
+
+		while (*start < DISPLAY_BYTES && !isDirty(dirty, moduleStart + *start)) {
+			(*start)++;
+		}
+
+		if (*start >= DISPLAY_BYTES) {
+			return 0;
+		}
+
+		uint8_t end = *start + 1;
+		while (end < DISPLAY_BYTES && (isDirty(dirty, moduleStart + end) ||
+				(end + 1 < DISPLAY_BYTES && isDirty(dirty, moduleStart + end + 1)))) {
+			end++;
+		}
+
+		return end;
+	}
+
+	/**
+	 * Clear the dirty bits of a module
+	 * @param dirty		the dirty bitmap
+	 * @param module	the index of the module (moduleY * arrayX + moduleX)
+	 */
+	static void moduleClean(uint8_t *dirty, uint8_t module) {
+		dirty += (uint16_t)module * (DISPLAY_BYTES / 8);
+
+		for (uint8_t i = 0; i < DISPLAY_BYTES / 8; i++) {
+			dirty[i] = 0;
+		}
+	}
+
+	/**
+	 * Send the dirty bytes of a module to the display
+	 * When double buffered, the bytes sent are copied to the front buffer too
+	 * @param moduleX		the module to write to
+	 * @param moduleY		the module to write to
+	 */
+	void flushModule(uint8_t moduleX, uint8_t moduleY) {
+		uint8_t module = moduleY * arrayX + moduleX;
+		uint8_t start = 0;
+		uint8_t end;
+
+		while ((end = nextRun(_dirty, module, &start))) {
+			uint16_t offset = (uint16_t)module * DISPLAY_BYTES + start;
+
+			// Each byte holds 2 nibble addresses
+			outputStart(moduleX, moduleY, start * 2);
+			_shifter.shiftOut(_frameBuffer + offset, end - start);
+			commandComplete(moduleX, moduleY);
+
+			if (doubleBuffered) {
+				for (uint8_t i = 0; i < end - start; i++) {
+					_front[offset + i] = _frameBuffer[offset + i];
+				}
+			}
+
+			start = end;
+		}
+
+		moduleClean(_dirty, module);
 	}
 
 	/**
@@ -166,6 +309,37 @@ private:
 		commandComplete(moduleX, moduleY);
 	}
 
+	/**
+	 * Find the framebuffer byte holding a pixel
+	 * Each byte holds 8 rows of a column, aligned to multiples of 8, with the lowest row in bit 0
+	 * @param	col		the column of the pixel
+	 * @param	row		the row of the pixel
+	 * @return the byte holding the pixel
+	 */
+	INLINE uint8_t *columnByte(uint16_t col, uint16_t row) {
+		// Coordinates of the display module
+		uint8_t moduleX = col / MODULE_X;
+		uint8_t moduleY = row / MODULE_Y;
+
+		// offsets within the module
+		col -= moduleX * MODULE_X;
+		row -= moduleY * MODULE_Y;
+
+		uint16_t offset = col;
+		switch (mode) {
+		case HT1632Mode::NMOS_32x8:
+		case HT1632Mode::PMOS_32x8:
+			break;
+		case HT1632Mode::NMOS_24x16:
+		case HT1632Mode::PMOS_24x16:
+			offset = offset * 2 + (row >> 3);
+			break;
+		}
+
+		// Change offset from the start of the display to the start of the framebuffer
+		return _frameBuffer + offset + (uint16_t)(moduleY * arrayX + moduleX) * DISPLAY_BYTES;
+	}
+
 
 public:
 	/**
@@ -174,7 +348,12 @@ public:
 	 */
 	Display_Holtek_HT1632(
 			Display_Selector &selector) :
-				_selector(selector) {
+				_selector(selector),
+				_listener(NULL),
+				_txBusy(false),
+				_txModule(0),
+				_txOffset(0),
+				_txEnd(0) {
 		uint8_t x, y;
 
 		for (y = 0; y < arrayY; y++) {
@@ -201,6 +380,22 @@ public:
 		for (uint16_t i = 0; i < bufSize; i++) {
 			_frameBuffer[i] = 0x0;
 		}
+		for (uint16_t i = 0; i < sizeof(_front); i++) {
+			_front[i] = 0x0;
+		}
+
+		// The display RAM is undefined at power on, so the first flush must send everything
+		invalidate();
+	}
+
+	/**
+	 * Mark the whole framebuffer as dirty, so the next flush sends all of it
+	 * Use this if the display RAM may no longer match the framebuffer (eg, after a brownout)
+	 */
+	void invalidate() {
+		for (uint16_t i = 0; i < sizeof(_dirty); i++) {
+			_dirty[i] = 0xff;
+		}
 	}
 
 	/**
@@ -289,28 +484,114 @@ public:
 	}
 
 	/**
-	 * Flush the framebuffer to the displays
+	 * Flush the changed parts of the framebuffer to the displays
+	 * Each run of dirty bytes is sent with its own write command, modules with nothing dirty are skipped
+	 * If a swapped frame is still being sent, this waits for it to complete
 	 */
 	void flush() {
 		uint8_t x, y;
-		uint8_t bytes;
-		uint8_t *data;
 
-		bytes = (HT1632Mode::NMOS_32x8 == mode || HT1632Mode::PMOS_32x8 == mode) ? 32 : 48;
+		while (_txBusy) {
+		}
+
+		for (y = 0; y < arrayY; y++) {
+			for (x = 0; x < arrayX; x++) {
+				if (moduleDirty(_dirty, y * arrayX + x)) {
+					flushModule(x, y);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Set the listener to notify when a swapped frame has been sent
+	 * @param listener	the listener, or NULL for none
+	 */
+	void setListener(HT1632Listener *listener) {
+		_listener = listener;
+	}
+
+	/**
+	 * Check if a swapped frame is still being sent
+	 * @return true if the frame is still being sent
+	 */
+	bool busy() {
+		return _txBusy;
+	}
+
+	/**
+	 * Queue the framebuffer to be sent to the displays in the background, one byte per timer alarm
+	 * The framebuffer may be drawn on as soon as this returns. If the previous frame is still
+	 * being sent, this waits for it to complete.
+	 * Only the bytes changed since the last swap are copied and sent.
+	 * Requires doubleBuffered, and alarm() to be called from a timer (eg. via setListener1)
+	 */
+	void swap() {
+		static_assert(doubleBuffered, "swap() requires a doubleBuffered display");
+
+		while (_txBusy) {
+		}
+
+		// The front buffer matches the framebuffer except where it is dirty
+		for (uint16_t i = 0; i < sizeof(_dirty); i++) {
+			uint8_t dirty = _dirty[i];
+			_frontDirty[i] = dirty;
+			_dirty[i] = 0;
 
-		for (x = 0; x < arrayX; x++) {
-			for (y = 0; y < arrayY; y++) {
-				data = _frameBuffer + (uint16_t)bytes * (y * arrayY + x);
+			for (uint8_t bit = 0; dirty; bit++, dirty >>= 1) {
+				if (dirty & 1) {
+					_front[i * 8 + bit] = _frameBuffer[i * 8 + bit];
+				}
 			}
 		}
 
-		for (x = 0; x < arrayX; x++) {
-			for (y = 0; y < arrayY; y++) {
-				data = _frameBuffer + (uint16_t)bytes * (y * arrayY + x);
-				outputStart(x, y);
-				_shifter.shiftOut(data, bytes);
-				commandComplete(x, y);
+		_txModule = 0;
+		_txOffset = 0;
+		_txEnd = 0;
+		_txBusy = true;
+	}
+
+// Implements TimerListener
+	/**
+	 * Send the next part of a swapped frame
+	 * Each call sends either the command & address of a run, or one byte of it
+	 * @param	source	the timer alarm that triggered
+	 */
+	void alarm(UNUSED AlarmSource source) {
+		if (!_txBusy) {
+			return;
+		}
+
+		uint8_t moduleX = _txModule % arrayX;
+		uint8_t moduleY = _txModule / arrayX;
+
+		if (_txEnd) {
+			if (_txOffset < _txEnd) {
+				_shifter.shiftOut(_front[(uint16_t)_txModule * DISPLAY_BYTES + _txOffset++]);
+				return;
 			}
+
+			commandComplete(moduleX, moduleY);
+			_txEnd = 0;
+		}
+
+		// Start the next run
+		while (_txModule < arrayX * arrayY) {
+			if (moduleDirty(_frontDirty, _txModule)) {
+				_txEnd = nextRun(_frontDirty, _txModule, &_txOffset);
+				if (_txEnd) {
+					outputStart(_txModule % arrayX, _txModule / arrayX, _txOffset * 2);
+					return;
+				}
+			}
+
+			_txModule++;
+			_txOffset = 0;
+		}
+
+		_txBusy = false;
+		if (_listener) {
+			_listener->frameComplete();
 		}
 	}
 
@@ -323,39 +604,12 @@ public:
 	 */
 	void setPixel(uint16_t col, uint16_t row, uint8_t value) {
 		if (row < DISPLAY_Y && col < DISPLAY_X) {
-			// Coordinates of the display module
-			uint8_t moduleX, moduleY;
-
-			moduleX = col / MODULE_X;
-			moduleY = row / MODULE_Y;
-
-			// offsets within the module
-			col -= moduleX * MODULE_X;
-			row -= moduleY * MODULE_Y;
-
-			uint8_t offset = col;
-			uint8_t bit = row;
-			switch (mode) {
-			case HT1632Mode::NMOS_32x8:
-			case HT1632Mode::PMOS_32x8:
-				break;
-			case HT1632Mode::NMOS_24x16:
-			case HT1632Mode::PMOS_24x16:
-				offset *= 2;
-				if (bit > 7) {
-					bit -= 8;
-					offset++;
-				}
-				break;
-			}
-
-			// Change offset from the start of the display to the start of the framebuffer
-			offset += (moduleY * arrayX + moduleX) * DISPLAY_BYTES;
+			uint8_t *data = columnByte(col, row);
 
 			if (value) {
-				_frameBuffer[offset] |= 1 << bit;
+				update(data, *data | (1 << (row & 7)));
 			} else {
-				_frameBuffer[offset] &= ~(1 << bit);
+				update(data, *data & ~(1 << (row & 7)));
 			}
 		}
 	}
@@ -368,41 +622,134 @@ public:
 	 */
 	uint8_t getPixel(uint16_t col, uint16_t row) {
 		if (row < DISPLAY_Y && col < DISPLAY_X) {
-			// Coordinates of the display module
-			uint8_t moduleX, moduleY;
-
-			moduleX = row / MODULE_X;
-			moduleY = col / MODULE_Y;
-
-			// offsets within the module
-			row -= moduleX * MODULE_X;
-			col -= moduleY * MODULE_Y;
-
-			uint8_t offset = col;
-			uint8_t bit = row;
-			switch (mode) {
-			case HT1632Mode::NMOS_32x8:
-			case HT1632Mode::PMOS_32x8:
-				break;
-			case HT1632Mode::NMOS_24x16:
-			case HT1632Mode::PMOS_24x16:
-				offset *= 2;
-				if (bit > 7) {
-					bit -= 8;
-					offset++;
-				}
-				break;
+			if (*columnByte(col, row) & (1 << (row & 7))) {
+				return 1;
 			}
+		}
 
-			// Change offset from the start of the display to the start of the framebuffer
-			offset += (moduleY * arrayX + moduleX) * DISPLAY_BYTES;
+		return 0;
+	}
 
-			if (_frameBuffer[offset] & (1 << bit)) {
-				return 1;
+	/**
+	 * Move part of the display one column to the left
+	 * This is a masked byte move per column for each block of 8 rows
+	 * @param	left	the leftmost column to move, already clipped to the display
+	 * @param	right	the rightmost column to move, already clipped to the display
+	 * @param	row		the bottom row to move, already clipped to the display
+	 * @param	height	the number of rows to move, already clipped to the display
+	 */
+	void scrollLeft(uint16_t left, uint16_t right, uint16_t row, uint16_t height) {
+		// Neighbouring columns in a module are this far apart in the framebuffer
+		const uint8_t step = (HT1632Mode::NMOS_32x8 == mode || HT1632Mode::PMOS_32x8 == mode) ? 1 : 2;
+
+		for (uint16_t block = row & ~7; block < row + height; block += 8) {
+			// The rows of this block that are inside the region
+			uint8_t low = row > block ? row - block : 0;
+			uint8_t high = row + height < block + 8 ? row + height - block : 8;
+			uint8_t mask = ((1 << high) - 1) & ~((1 << low) - 1);
+
+			uint8_t *data = columnByte(left, block);
+			uint8_t untilEdge = MODULE_X - 1 - left % MODULE_X;
+			for (uint16_t x = left; x < right; x++) {
+				uint8_t *next;
+				if (untilEdge) {
+					next = data + step;
+					untilEdge--;
+				} else {
+					next = columnByte(x + 1, block);
+					untilEdge = MODULE_X - 1;
+				}
+
+				update(data, (*data & ~mask) | (*next & mask));
+				data = next;
 			}
 		}
+	}
 
-		return 0;
+	/**
+	 * Draw up to 8 pixels of a column in one go
+	 * This is a masked write to at most 2 framebuffer bytes
+	 * @param	col			the column, already clipped to the display
+	 * @param	row			the row of the lowest pixel, already clipped to the display
+	 * @param	pixels		the pixels, the lowest row in bit 0, set bits are on
+	 * @param	mask		which pixels to draw, already clipped to the top of the display
+	 * @param	onValue		the pixel value to use for on
+	 * @param	offValue	the pixel value to use for off
+	 */
+	void blitColumn(uint16_t col, uint16_t row, uint8_t pixels, uint8_t mask,
+			uint8_t onValue, uint8_t offValue) {
+		uint8_t set = (onValue ? pixels : 0) | (offValue ? ~pixels : 0);
+		uint8_t shift = row & 7;
+		uint8_t *data = columnByte(col, row);
+
+		update(data, (*data & ~(mask << shift)) | ((set & mask) << shift));
+
+		// The rest of the pixels are in the next byte up, which may be in the next module
+		if (shift && (mask >> (8 - shift))) {
+			data = columnByte(col, row + 8 - shift);
+			update(data, (*data & ~(mask >> (8 - shift))) | ((set & mask) >> (8 - shift)));
+		}
+	}
+
+	/**
+	 * XOR up to 8 pixels of a column with a value
+	 * This is an XOR of at most 2 framebuffer bytes
+	 * @param	col			the column, already clipped to the display
+	 * @param	row			the row of the lowest pixel, already clipped to the display
+	 * @param	pixels		the pixels to change, the lowest row in bit 0, already clipped to the top of the display
+	 * @param	value		the value to XOR the pixels with
+	 */
+	void xorColumn(uint16_t col, uint16_t row, uint8_t pixels, uint8_t value) {
+		if (!value) {
+			return;
+		}
+
+		uint8_t shift = row & 7;
+		uint8_t *data = columnByte(col, row);
+
+		update(data, *data ^ (pixels << shift));
+
+		// The rest of the pixels are in the next byte up, which may be in the next module
+		if (shift && (pixels >> (8 - shift))) {
+			data = columnByte(col, row + 8 - shift);
+			update(data, *data ^ (pixels >> (8 - shift)));
+		}
+	}
+
+	/**
+	 * Fill a rectangle
+	 * This is a masked byte write per column for each block of 8 rows
+	 * @param	col		the left column, already clipped to the display
+	 * @param	row		the bottom row, already clipped to the display
+	 * @param	width	the width, already clipped to the display
+	 * @param	height	the height, already clipped to the display
+	 * @param	value	the pixel value to fill with
+	 */
+	void fillArea(uint16_t col, uint16_t row, uint16_t width, uint16_t height, uint8_t value) {
+		// Neighbouring columns in a module are this far apart in the framebuffer
+		const uint8_t step = (HT1632Mode::NMOS_32x8 == mode || HT1632Mode::PMOS_32x8 == mode) ? 1 : 2;
+
+		for (uint16_t block = row & ~7; block < row + height; block += 8) {
+			// The rows of this block that are inside the rectangle
+			uint8_t low = row > block ? row - block : 0;
+			uint8_t high = row + height < block + 8 ? row + height - block : 8;
+			uint8_t mask = ((1 << high) - 1) & ~((1 << low) - 1);
+			uint8_t set = value ? mask : 0;
+
+			uint8_t *data = columnByte(col, block);
+			uint8_t untilEdge = MODULE_X - 1 - col % MODULE_X;
+			for (uint16_t x = col; x < col + width; x++) {
+				update(data, (*data & ~mask) | set);
+
+				if (untilEdge) {
+					data += step;
+					untilEdge--;
+				} else if (x + 1 < col + width) {
+					data = columnByte(x + 1, block);
+					untilEdge = MODULE_X - 1;
+				}
+			}
+		}
 	}
 
 };
@@ -32,6 +32,7 @@
 #include <flame/Device_TX.h>
 #include <flame/io.h>
 #include <flame/Font.h>
+#include <flame/Marquee.h>
 
 namespace flame {
 
@@ -40,6 +41,15 @@ public:
 	virtual void select(uint8_t displayX, uint8_t displayY, bool active) =0;
 };
 
+/**
+ * How the pixels of a bitmap are combined with the display
+ */
+enum class BlitMode : uint8_t {
+	OPAQUE,			// on pixels are drawn with the on value, off pixels with the off value
+	TRANSPARENT,	// on pixels are drawn with the on value, off pixels are left alone
+	XOR				// on pixels are XORed with the on value, off pixels are left alone
+};
+
 /**
  * A monochrome bitmap display
  * Origin (0,0) is bottom left
@@ -52,6 +62,112 @@ class Display_Monochrome : public Device_TXImplementation<txBuffers> {
 protected:
 	int16_t			_txOffset;
 
+	/**
+	 * Reverse the bits in a byte
+	 * Font columns have the bottom pixel in the most significant bit, blitColumn wants it in the least
+	 * @param	value	the byte to reverse
+	 * @return the reversed byte
+	 */
+	static INLINE CONST uint8_t reverseBits(uint8_t value) {
+		value = (value >> 4) | (value << 4);
+		value = ((value & 0xcc) >> 2) | ((value & 0x33) << 2);
+		return ((value & 0xaa) >> 1) | ((value & 0x55) << 1);
+	}
+
+	/**
+	 * Draw a glyph, clipped to the display
+	 * The clipping is worked out once for the whole glyph, then each visible column is drawn
+	 * 8 rows at a time with blitColumn.
+	 * @param	glyph		the glyph in program memory, in font layout (each column is columnBytes
+	 * 						bytes from the bottom up, the bottom pixel in the most significant bit),
+	 * 						or NULL for a blank glyph
+	 * @param	width		the width of the glyph
+	 * @param	height		the height of the glyph
+	 * @param	columnBytes	the number of bytes in each column of the glyph
+	 * @param	col			the column of the left side of the glyph
+	 * @param	row			the row of the bottom of the glyph
+	 * @param	onValue		the pixel value to use for on
+	 * @param	offValue	the pixel value to use for off
+	 * @param	mode		how to combine the glyph with the display
+	 * @return true if any of the glyph was visible
+	 */
+	bool blitGlyph(const uint8_t *glyph, uint8_t width, uint8_t height, uint8_t columnBytes,
+			int16_t col, int16_t row, uint8_t onValue, uint8_t offValue,
+			BlitMode mode = BlitMode::OPAQUE) {
+		// Clip the columns
+		uint8_t first = 0;
+		if (col < 0) {
+			if (-col >= width) {
+				return false;
+			}
+			first = -col;
+		}
+		if (col >= (int16_t)cols) {
+			return false;
+		}
+		uint8_t last = width;
+		if (col + width > (int16_t)cols) {
+			last = cols - col;
+		}
+
+		bool ret = false;
+		for (uint8_t band = 0; band < columnBytes && height > band * 8; band++) {
+			// Clip the rows of this band of 8
+			int16_t bandRow = row + band * 8;
+			uint8_t bandHeight = height - band * 8;
+			uint8_t mask = bandHeight >= 8 ? 0xff : (1 << bandHeight) - 1;
+			uint8_t shift = 0;
+
+			if (bandRow < 0) {
+				if (bandRow <= -8) {
+					continue;
+				}
+				shift = -bandRow;
+				mask >>= shift;
+				bandRow = 0;
+			}
+			if (bandRow >= (int16_t)rows) {
+				break;
+			}
+			if (rows - bandRow < 8) {
+				mask &= (1 << (rows - bandRow)) - 1;
+			}
+			if (!mask) {
+				continue;
+			}
+
+			ret = true;
+			const uint8_t *data = glyph + first * columnBytes + band;
+			for (uint8_t x = first; x < last; x++, data += columnBytes) {
+				uint8_t pixels = 0;
+				if (NULL != glyph) {
+#ifdef __FLASH
+					pixels = reverseBits(*data) >> shift;
+#else
+					pixels = reverseBits(pgm_read_byte(data)) >> shift;
+#endif
+				}
+				switch (mode) {
+				case BlitMode::OPAQUE:
+					blitColumn(col + x, bandRow, pixels, mask, onValue, offValue);
+					break;
+				case BlitMode::TRANSPARENT:
+					if (pixels & mask) {
+						blitColumn(col + x, bandRow, pixels, pixels & mask, onValue, offValue);
+					}
+					break;
+				case BlitMode::XOR:
+					if (pixels & mask) {
+						xorColumn(col + x, bandRow, pixels & mask, onValue);
+					}
+					break;
+				}
+			}
+		}
+
+		return ret;
+	}
+
 	/**
 	 * Write a character to the display
 	 * @param	font		the font to use
@@ -81,41 +197,8 @@ protected:
 		const uint8_t *fontChar = font.fontData + pgm_read_word(font.offsets + c);
 #endif
 
-	// Render each column
-		bool ret = false;
-		do {
-			int8_t bit = 7;
-			uint8_t y = 0;
-#ifdef __FLASH
-			uint8_t data = *(fontChar++);
-#else
-			uint8_t data = pgm_read_byte(fontChar++);
-#endif
-
-			if (*offsetX >= 0) {
-	// Start at the bottom of the column and work up
-				for (; y < font.maxHeight; y++, bit--) {
-					ret = true;
-
-					if (data & (1 << bit)) {
-						setPixel(*offsetX, offsetY + y, onValue);
-					} else {
-						setPixel(*offsetX, offsetY + y, offValue);
-					}
-
-	// Support multiple-byte font images - fetch the next byte of data if we exhaust the current one
-					if (-1 == bit && (font.maxHeight - y) > 0) {
-						bit = 7;
-#ifdef __FLASH
-						data = *(fontChar++);
-#else
-						data = pgm_read_byte(fontChar++);
-#endif
-					}
-				}
-			}
-		} while (++(*offsetX) < (int16_t)cols && --charWidth);
-
+		bool ret = blitGlyph(fontChar, charWidth, font.maxHeight, font.columnBytes,
+				*offsetX, offsetY, onValue, offValue);
 		*offsetX += charWidth;
 
 		return ret;
@@ -131,24 +214,45 @@ protected:
 	 */
 	bool writeSeperator(const FONT &font, int16_t *offsetX, int16_t offsetY,
 			uint8_t offValue) {
-		bool ret = false;
+		bool ret = blitGlyph(NULL, 1, font.maxHeight, font.columnBytes,
+				*offsetX, offsetY, offValue, offValue);
 
-		if (*offsetX >= 0 && *offsetX < (int16_t)cols) {
-	// Start at the bottom of the column and work up
-			uint8_t y = 0;
-			uint8_t row;
+		(*offsetX)++;
+		return ret;
+	}
 
-			while (y++ < font.maxHeight) {
-				row = offsetY + y;
-				if (row < rows) {
-					setPixel(*offsetX, row, offValue);
-					ret = true;
-				}
-			}
+	/**
+	 * Clip a span to the display
+	 * @param	start	input: the first position of the span, output: the first position on the display
+	 * @param	length	input: the length of the span, output: the length on the display
+	 * @param	limit	the size of the display in this direction
+	 * @return true if any of the span is on the display
+	 */
+	static bool clip(int16_t *start, int16_t *length, uint16_t limit) {
+		if (*start < 0) {
+			*length += *start;
+			*start = 0;
+		}
+		if (*start >= (int16_t)limit || *length <= 0) {
+			return false;
+		}
+		if (*length > (int16_t)limit - *start) {
+			*length = limit - *start;
 		}
 
-		(*offsetX)++;
-		return ret;
+		return true;
+	}
+
+	/**
+	 * Set a pixel, ignoring pixels off the display
+	 * @param	col		the column
+	 * @param	row		the row
+	 * @param	value	the pixel value
+	 */
+	INLINE void plot(int16_t col, int16_t row, uint8_t value) {
+		if (col >= 0 && row >= 0) {
+			setPixel(col, row, value);
+		}
 	}
 
 	/**
@@ -179,15 +283,213 @@ public:
 	 * @param	value	the value to fill the display with
 	 */
 	void clear(uint8_t value) {
-		uint16_t x, y;
+		fillArea(0, 0, cols, rows, value);
+	}
 
-		for (x = 0; x < cols; ++x) {
-			for (y = 0; y < rows; ++y) {
-				setPixel(x, y, value);
+	/**
+	 * Fill a rectangle, clipped to the display
+	 * @param	col		the left column
+	 * @param	row		the bottom row
+	 * @param	width	the width of the rectangle
+	 * @param	height	the height of the rectangle
+	 * @param	value	the pixel value to fill with
+	 */
+	void fillRect(int16_t col, int16_t row, int16_t width, int16_t height, uint8_t value) {
+		if (clip(&col, &width, cols) && clip(&row, &height, rows)) {
+			fillArea(col, row, width, height, value);
+		}
+	}
+
+	/**
+	 * Draw the outline of a rectangle, clipped to the display
+	 * @param	col		the left column
+	 * @param	row		the bottom row
+	 * @param	width	the width of the rectangle
+	 * @param	height	the height of the rectangle
+	 * @param	value	the pixel value to draw with
+	 */
+	void drawRect(int16_t col, int16_t row, int16_t width, int16_t height, uint8_t value) {
+		if (width <= 0 || height <= 0) {
+			return;
+		}
+
+		fillRect(col, row, width, 1, value);
+		fillRect(col, row + height - 1, width, 1, value);
+		fillRect(col, row + 1, 1, height - 2, value);
+		fillRect(col + width - 1, row + 1, 1, height - 2, value);
+	}
+
+	/**
+	 * Draw a horizontal line, clipped to the display
+	 * @param	col		the left column
+	 * @param	row		the row
+	 * @param	width	the length of the line
+	 * @param	value	the pixel value to draw with
+	 */
+	void drawHorizontalLine(int16_t col, int16_t row, int16_t width, uint8_t value) {
+		fillRect(col, row, width, 1, value);
+	}
+
+	/**
+	 * Draw a vertical line, clipped to the display
+	 * @param	col		the column
+	 * @param	row		the bottom row
+	 * @param	height	the length of the line
+	 * @param	value	the pixel value to draw with
+	 */
+	void drawVerticalLine(int16_t col, int16_t row, int16_t height, uint8_t value) {
+		fillRect(col, row, 1, height, value);
+	}
+
+	/**
+	 * Draw a line between 2 points, clipped to the display
+	 * This is Bresenham's algorithm, but rather than setting a pixel at a time, each run of pixels
+	 * along the major axis is drawn as a single span, so shallow and steep lines both get the
+	 * displays' span fills.
+	 * @param	col0	the column of the first point
+	 * @param	row0	the row of the first point
+	 * @param	col1	the column of the second point
+	 * @param	row1	the row of the second point
+	 * @param	value	the pixel value to draw with
+	 */
+	void drawLine(int16_t col0, int16_t row0, int16_t col1, int16_t row1, uint8_t value) {
+		// Always draw left to right
+		if (col0 > col1) {
+			int16_t tmp = col0;
+			col0 = col1;
+			col1 = tmp;
+			tmp = row0;
+			row0 = row1;
+			row1 = tmp;
+		}
+
+		int16_t dx = col1 - col0;
+		int16_t dy = row1 - row0;
+		int8_t step = 1;
+		if (dy < 0) {
+			dy = -dy;
+			step = -1;
+		}
+
+		if (dx >= dy) {
+			// Mostly horizontal, a run of columns for each row
+			int16_t err = dx / 2;
+			int16_t start = col0;
+			int16_t row = row0;
+			for (int16_t col = col0; col < col1; col++) {
+				err -= dy;
+				if (err < 0) {
+					fillRect(start, row, col - start + 1, 1, value);
+					start = col + 1;
+					row += step;
+					err += dx;
+				}
+			}
+			fillRect(start, row, col1 - start + 1, 1, value);
+		} else {
+			// Mostly vertical, a run of rows for each column
+			int16_t err = dy / 2;
+			int16_t start = row0;
+			int16_t col = col0;
+			for (int16_t row = row0; row != row1; row += step) {
+				err -= dx;
+				if (err < 0) {
+					fillRect(col, step > 0 ? start : row, 1, (row - start) * step + 1, value);
+					start = row + step;
+					col++;
+					err += dy;
+				}
 			}
+			fillRect(col, step > 0 ? start : row1, 1, (row1 - start) * step + 1, value);
 		}
 	}
 
+	/**
+	 * Draw the outline of a circle, clipped to the display
+	 * @param	col		the column of the centre
+	 * @param	row		the row of the centre
+	 * @param	radius	the radius
+	 * @param	value	the pixel value to draw with
+	 */
+	void drawCircle(int16_t col, int16_t row, int16_t radius, uint8_t value) {
+		int16_t x = radius;
+		int16_t y = 0;
+		int16_t err = 1 - radius;
+
+		while (x >= y) {
+			plot(col + x, row + y, value);
+			plot(col - x, row + y, value);
+			plot(col + x, row - y, value);
+			plot(col - x, row - y, value);
+			plot(col + y, row + x, value);
+			plot(col - y, row + x, value);
+			plot(col + y, row - x, value);
+			plot(col - y, row - x, value);
+
+			y++;
+			if (err < 0) {
+				err += 2 * y + 1;
+			} else {
+				x--;
+				err += 2 * (y - x) + 1;
+			}
+		}
+	}
+
+	/**
+	 * Draw a filled circle, clipped to the display
+	 * The circle is filled with vertical spans, which are whole bytes on displays packed in columns
+	 * @param	col		the column of the centre
+	 * @param	row		the row of the centre
+	 * @param	radius	the radius
+	 * @param	value	the pixel value to fill with
+	 */
+	void fillCircle(int16_t col, int16_t row, int16_t radius, uint8_t value) {
+		int16_t x = radius;
+		int16_t y = 0;
+		int16_t err = 1 - radius;
+
+		while (x >= y) {
+			// The columns y either side of the centre
+			fillRect(col - y, row - x, 1, 2 * x + 1, value);
+			if (y) {
+				fillRect(col + y, row - x, 1, 2 * x + 1, value);
+			}
+
+			if (err >= 0 && x > y) {
+				// x is about to move in, so the columns x either side of the centre are as tall as they get
+				fillRect(col - x, row - y, 1, 2 * y + 1, value);
+				fillRect(col + x, row - y, 1, 2 * y + 1, value);
+			}
+
+			y++;
+			if (err < 0) {
+				err += 2 * y + 1;
+			} else {
+				x--;
+				err += 2 * (y - x) + 1;
+			}
+		}
+	}
+
+	/**
+	 * Draw a bitmap, clipped to the display
+	 * @param	bitmap		the bitmap in program memory, in font layout (each column is (height + 7) / 8
+	 * 						bytes from the bottom up, the bottom pixel in the most significant bit)
+	 * @param	width		the width of the bitmap
+	 * @param	height		the height of the bitmap
+	 * @param	col			the column of the left side of the bitmap
+	 * @param	row			the row of the bottom of the bitmap
+	 * @param	onValue		the pixel value to use for on
+	 * @param	offValue	the pixel value to use for off (only used by BlitMode::OPAQUE)
+	 * @param	mode		how to combine the bitmap with the display
+	 * @return true if any of the bitmap was visible
+	 */
+	bool drawBitmap(const uint8_t *bitmap, uint8_t width, uint8_t height, int16_t col, int16_t row,
+			uint8_t onValue, uint8_t offValue, BlitMode mode) {
+		return blitGlyph(bitmap, width, height, (height + 7) / 8, col, row, onValue, offValue, mode);
+	}
+
 	/**
 	 * Write a TX Buffer to the display
 	 * @param	font		the font to use
@@ -453,8 +755,116 @@ public:
 		return true;
 	}
 
-	virtual void setPixel(uint16_t row, uint16_t col, uint8_t value)=0;
-	virtual uint8_t getPixel(uint16_t row, uint16_t col)=0;
+	virtual void setPixel(uint16_t col, uint16_t row, uint8_t value)=0;
+	virtual uint8_t getPixel(uint16_t col, uint16_t row)=0;
+
+	/**
+	 * Move part of the display one column to the left
+	 * The leftmost column is lost, and the rightmost column is left as it was. Displays should
+	 * override this to move their framebuffer directly. This version goes pixel by pixel.
+	 * @param	left	the leftmost column to move, already clipped to the display
+	 * @param	right	the rightmost column to move, already clipped to the display
+	 * @param	row		the bottom row to move, already clipped to the display
+	 * @param	height	the number of rows to move, already clipped to the display
+	 */
+	virtual void scrollLeft(uint16_t left, uint16_t right, uint16_t row, uint16_t height) {
+		for (uint16_t y = row; y < row + height; y++) {
+			for (uint16_t x = left; x < right; x++) {
+				setPixel(x, y, getPixel(x + 1, y));
+			}
+		}
+	}
+
+	/**
+	 * Scroll a marquee along by one column
+	 * @param	marquee		the marquee to scroll
+	 * @return true if the marquee moved, false if it has finished
+	 */
+	bool scroll(Marquee &marquee) {
+		const uint8_t *column;
+
+		if (!marquee.nextColumn(&column)) {
+			return false;
+		}
+
+		// Clip the region to the display
+		const FONT &font = marquee.getFont();
+		uint16_t right = marquee.getRight();
+		if (right >= cols) {
+			right = cols - 1;
+		}
+		int16_t row = marquee.getRow();
+		int16_t top = row + font.maxHeight;
+		if (top > (int16_t)rows) {
+			top = rows;
+		}
+		int16_t bottom = row < 0 ? 0 : row;
+
+		if (marquee.getLeft() > right || bottom >= top) {
+			return true;
+		}
+
+		scrollLeft(marquee.getLeft(), right, bottom, top - bottom);
+		blitGlyph(column, 1, font.maxHeight, font.columnBytes, right, row,
+				marquee.getOnValue(), marquee.getOffValue());
+
+		return true;
+	}
+
+	/**
+	 * Draw up to 8 pixels of a column in one go
+	 * Displays should override this to write straight into their framebuffer. This version
+	 * falls back to setPixel.
+	 * @param	col			the column, already clipped to the display
+	 * @param	row			the row of the lowest pixel, already clipped to the display
+	 * @param	pixels		the pixels, the lowest row in bit 0, set bits are on
+	 * @param	mask		which pixels to draw, already clipped to the top of the display
+	 * @param	onValue		the pixel value to use for on
+	 * @param	offValue	the pixel value to use for off
+	 */
+	virtual void blitColumn(uint16_t col, uint16_t row, uint8_t pixels, uint8_t mask,
+			uint8_t onValue, uint8_t offValue) {
+		for (; mask; mask >>= 1, pixels >>= 1, row++) {
+			if (mask & 1) {
+				setPixel(col, row, (pixels & 1) ? onValue : offValue);
+			}
+		}
+	}
+
+	/**
+	 * XOR up to 8 pixels of a column with a value
+	 * Displays should override this to write straight into their framebuffer. This version
+	 * falls back to getPixel and setPixel.
+	 * @param	col			the column, already clipped to the display
+	 * @param	row			the row of the lowest pixel, already clipped to the display
+	 * @param	pixels		the pixels to change, the lowest row in bit 0, already clipped to the top of the display
+	 * @param	value		the value to XOR the pixels with
+	 */
+	virtual void xorColumn(uint16_t col, uint16_t row, uint8_t pixels, uint8_t value) {
+		for (; pixels; pixels >>= 1, row++) {
+			if (pixels & 1) {
+				setPixel(col, row, getPixel(col, row) ^ value);
+			}
+		}
+	}
+
+	/**
+	 * Fill a rectangle
+	 * Displays should override this to fill their framebuffer a byte at a time. This version
+	 * falls back to setPixel.
+	 * @param	col		the left column, already clipped to the display
+	 * @param	row		the bottom row, already clipped to the display
+	 * @param	width	the width, already clipped to the display
+	 * @param	height	the height, already clipped to the display
+	 * @param	value	the pixel value to fill with
+	 */
+	virtual void fillArea(uint16_t col, uint16_t row, uint16_t width, uint16_t height, uint8_t value) {
+		for (uint16_t x = col; x < col + width; x++) {
+			for (uint16_t y = row; y < row + height; y++) {
+				setPixel(x, y, value);
+			}
+		}
+	}
 };
 
 }
@@ -32,28 +32,142 @@
 #include <string.h>
 #include <math.h>
 
-#define pixel(pixelRow, pixelCol) Display_Monochrome_Buffered<cols, rows, txBuffers>::_frameBuffer[pixelRow * cols + pixelCol]
-
 namespace flame {
 
+/**
+ * Passes framebuffer writes on to the display built on a Display_Monochrome_Buffered
+ * The display's changed() is called directly, so it can be inlined into each write
+ * @tparam	Display		the display class, which must make this a friend if changed() is not public
+ */
+template<class Display>
+class Display_Monochrome_BufferedChanges {
+public:
+	template<class Buffer>
+	static INLINE void changed(Buffer *buffer, uint16_t byteRow, uint16_t left, uint16_t right) {
+		static_cast<Display *>(buffer)->changed(byteRow, left, right);
+	}
+};
+
+/**
+ * Displays that don't need to know about framebuffer writes pay nothing for them
+ */
+template<>
+class Display_Monochrome_BufferedChanges<void> {
+public:
+	template<class Buffer>
+	static INLINE void changed(UNUSED Buffer *buffer, UNUSED uint16_t byteRow, UNUSED uint16_t left,
+			UNUSED uint16_t right) {
+	}
+};
+
 /**
  * A monochrome bitmap display
  * Origin (0,0) is bottom left
+ *
+ * With 8 bits per pixel, the framebuffer is one byte per pixel, row by row. With fewer bits per
+ * pixel, the pixels are packed into bytes running up the display: each byte holds a vertical
+ * strip of 8 (1 bit), 4 (2 bits) or 2 (4 bits) pixels, with the lowest row in the least
+ * significant bits, and the bytes for each strip of rows run left to right. A 1 bit 64x32 display
+ * takes 256 bytes rather than 2K.
+ *
+ * Pixel values are always 0-255 intensities, the low bits are dropped when they are stored. With 1
+ * bit, any non-zero value is on, and on pixels read back as 255.
+ *
  * @tparam	cols		the number of columns
  * @tparam	rows		the number of rows
  * @tparam	txBuffers	the number of output buffers
+ * @tparam	bits		the number of bits per pixel, 1, 2, 4 or 8
+ * @tparam	Display		the display class derived from this one, if it has a changed(byteRow, left, right)
+ * 						method to be told which parts of the framebuffer have been written
  */
-template<uint16_t cols, uint16_t rows, uint8_t txBuffers>
+template<uint16_t cols, uint16_t rows, uint8_t txBuffers, uint8_t bits = 8, class Display = void>
 class Display_Monochrome_Buffered : public Display_Monochrome<cols, rows, txBuffers> {
+	static_assert(1 == bits || 2 == bits || 4 == bits || 8 == bits,
+			"Display_Monochrome_Buffered supports 1, 2, 4 or 8 bits per pixel");
+
 protected:
-	uint8_t		_frameBuffer[cols * rows];
+	static const uint8_t	PIXELS_PER_BYTE = 8 / bits;
+	static const uint8_t	PIXEL_MASK = (1 << bits) - 1;
+	static const uint16_t	BYTE_ROWS = (rows + PIXELS_PER_BYTE - 1) / PIXELS_PER_BYTE;
+
+	uint8_t		_frameBuffer[cols * BYTE_ROWS];
+
+	/* Get the intensity of a pixel, without checking bounds
+	 * param:	col		the column
+	 * param:	row		the row
+	 * return	the intensity of the pixel, 0-255
+	 */
+	INLINE uint8_t pixelValue(uint16_t col, uint16_t row) {
+		if (8 == bits) {
+			return _frameBuffer[row * cols + col];
+		}
+
+		uint8_t shift = (row % PIXELS_PER_BYTE) * bits;
+		uint8_t stored = (_frameBuffer[(row / PIXELS_PER_BYTE) * cols + col] >> shift) & PIXEL_MASK;
+
+		// Scale back up to 0-255, 255 / PIXEL_MASK is exact for 1, 2 and 4 bits
+		return stored * (255 / PIXEL_MASK);
+	}
+
+	/* Set the intensity of a pixel, without checking bounds
+	 * param:	col		the column
+	 * param:	row		the row
+	 * param:	value	the intensity of the pixel, 0-255
+	 */
+	INLINE void setPixelValue(uint16_t col, uint16_t row, uint8_t value) {
+		if (8 == bits) {
+			_frameBuffer[row * cols + col] = value;
+			return;
+		}
+
+		uint8_t shift = (row % PIXELS_PER_BYTE) * bits;
+		uint8_t *data = _frameBuffer + (row / PIXELS_PER_BYTE) * cols + col;
+		uint8_t stored = (1 == bits) ? (0 != value) : (value >> (8 - bits));
+
+		*data = (*data & ~(PIXEL_MASK << shift)) | (stored << shift);
+	}
+
+	/* Get a byte filled with a pixel value
+	 * param:	value	the intensity of the pixels, 0-255
+	 * return	the byte with every pixel set to value
+	 */
+	static INLINE uint8_t fillByte(uint8_t value) {
+		if (8 == bits) {
+			return value;
+		}
+
+		uint8_t stored = (1 == bits) ? (0 != value) : (value >> (8 - bits));
+		uint8_t fill = 0;
+		for (uint8_t i = 0; i < PIXELS_PER_BYTE; i++) {
+			fill = (fill << bits) | stored;
+		}
+
+		return fill;
+	}
+
+	/* Called after part of the framebuffer has been written, passed on to the Display's changed()
+	 * param:	byteRow		the strip of rows written (the row with 8 bits per pixel)
+	 * param:	left		the leftmost column written
+	 * param:	right		the rightmost column written
+	 */
+	INLINE void changed(uint16_t byteRow, uint16_t left, uint16_t right) {
+		Display_Monochrome_BufferedChanges<Display>::changed(this, byteRow, left, right);
+	}
+
+	/* Mark the whole framebuffer as written
+	 */
+	void changedAll() {
+		for (uint16_t byteRow = 0; byteRow < BYTE_ROWS; byteRow++) {
+			changed(byteRow, 0, cols - 1);
+		}
+	}
 
 public:
 	/**
 	 * Create a new monochrome display
 	 */
 	Display_Monochrome_Buffered() {
-		memset(_frameBuffer, 0, rows * cols);
+		memset(_frameBuffer, 0, sizeof(_frameBuffer));
 	}
 
 	/* Set a pixel
@@ -63,7 +177,8 @@ public:
 	 */
 	void setPixel(uint16_t col, uint16_t row, uint8_t value) {
 		if (row < rows && col < cols) {
-			pixel(row, col) = value;
+			setPixelValue(col, row, value);
+			changed(row / PIXELS_PER_BYTE, col, col);
 		}
 	}
 
@@ -74,11 +189,233 @@ public:
 	 */
 	uint8_t getPixel(uint16_t col, uint16_t row) {
 		if (row < rows && col < cols) {
-			return pixel(row, col);
+			return pixelValue(col, row);
 		} else {
 			return 0;
 		}
 	}
+
+	/* Clear the display to a particular value
+	 * This fills the framebuffer directly rather than going pixel by pixel
+	 * param:	value	the value to fill the display with
+	 */
+	void clear(uint8_t value) {
+		memset(_frameBuffer, fillByte(value), sizeof(_frameBuffer));
+		changedAll();
+	}
+
+	/* Fill a rectangle
+	 * Each strip of rows is filled with memset where the rectangle covers the whole strip, or
+	 * a masked write per column at the top and bottom edges
+	 * param:	col		the left column, already clipped to the display
+	 * param:	row		the bottom row, already clipped to the display
+	 * param:	width	the width, already clipped to the display
+	 * param:	height	the height, already clipped to the display
+	 * param:	value	the pixel value to fill with
+	 */
+	void fillArea(uint16_t col, uint16_t row, uint16_t width, uint16_t height, uint8_t value) {
+		uint8_t fill = fillByte(value);
+
+		for (uint16_t byteRow = row / PIXELS_PER_BYTE; byteRow * PIXELS_PER_BYTE < row + height; byteRow++) {
+			// The pixels in this strip that are inside the rectangle
+			uint16_t first = byteRow * PIXELS_PER_BYTE;
+			uint8_t low = row > first ? row - first : 0;
+			uint8_t high = row + height < first + PIXELS_PER_BYTE ? row + height - first : PIXELS_PER_BYTE;
+			uint8_t mask = ((1 << (high * bits)) - 1) & ~((1 << (low * bits)) - 1);
+
+			uint8_t *data = _frameBuffer + byteRow * cols + col;
+			if (0xff == mask) {
+				memset(data, fill, width);
+			} else {
+				for (uint16_t x = 0; x < width; x++, data++) {
+					*data = (*data & ~mask) | (fill & mask);
+				}
+			}
+			changed(byteRow, col, col + width - 1);
+		}
+	}
+
+	/* Draw up to 8 pixels of a column in one go
+	 * On 1 bit displays this is a masked write to at most 2 framebuffer bytes
+	 * param:	col			the column, already clipped to the display
+	 * param:	row			the row of the lowest pixel, already clipped to the display
+	 * param:	pixels		the pixels, the lowest row in bit 0, set bits are on
+	 * param:	mask		which pixels to draw, already clipped to the top of the display
+	 * param:	onValue		the pixel value to use for on
+	 * param:	offValue	the pixel value to use for off
+	 */
+	void blitColumn(uint16_t col, uint16_t row, uint8_t pixels, uint8_t mask,
+			uint8_t onValue, uint8_t offValue) {
+		if (1 != bits) {
+			for (; mask; mask >>= 1, pixels >>= 1, row++) {
+				if (mask & 1) {
+					setPixelValue(col, row, (pixels & 1) ? onValue : offValue);
+					changed(row / PIXELS_PER_BYTE, col, col);
+				}
+			}
+			return;
+		}
+
+		uint8_t set = (onValue ? pixels : 0) | (offValue ? ~pixels : 0);
+		uint8_t shift = row % 8;
+		uint8_t *data = _frameBuffer + (row / 8) * cols + col;
+
+		*data = (*data & ~(mask << shift)) | ((set & mask) << shift);
+		changed(row / 8, col, col);
+		if (shift && (mask >> (8 - shift))) {
+			data += cols;
+			*data = (*data & ~(mask >> (8 - shift))) | ((set & mask) >> (8 - shift));
+			changed(row / 8 + 1, col, col);
+		}
+	}
+
+	/* XOR up to 8 pixels of a column with a value
+	 * On 1 bit displays this is an XOR of at most 2 framebuffer bytes
+	 * param:	col			the column, already clipped to the display
+	 * param:	row			the row of the lowest pixel, already clipped to the display
+	 * param:	pixels		the pixels to change, the lowest row in bit 0, already clipped to the top of the display
+	 * param:	value		the value to XOR the pixels with
+	 */
+	void xorColumn(uint16_t col, uint16_t row, uint8_t pixels, uint8_t value) {
+		if (1 != bits) {
+			for (; pixels; pixels >>= 1, row++) {
+				if (pixels & 1) {
+					setPixelValue(col, row, pixelValue(col, row) ^ value);
+					changed(row / PIXELS_PER_BYTE, col, col);
+				}
+			}
+			return;
+		}
+
+		if (!value) {
+			return;
+		}
+
+		uint8_t shift = row % 8;
+		uint8_t *data = _frameBuffer + (row / 8) * cols + col;
+
+		*data ^= pixels << shift;
+		changed(row / 8, col, col);
+		if (shift && (pixels >> (8 - shift))) {
+			data += cols;
+			*data ^= pixels >> (8 - shift);
+			changed(row / 8 + 1, col, col);
+		}
+	}
+
+	/* Move part of the display one column to the left
+	 * Rows are moved with memmove, or a byte per strip of rows when the pixels are packed
+	 * param:	left	the leftmost column to move, already clipped to the display
+	 * param:	right	the rightmost column to move, already clipped to the display
+	 * param:	row		the bottom row to move, already clipped to the display
+	 * param:	height	the number of rows to move, already clipped to the display
+	 */
+	void scrollLeft(uint16_t left, uint16_t right, uint16_t row, uint16_t height) {
+		if (8 == bits) {
+			for (uint16_t y = row; y < row + height; y++) {
+				uint8_t *data = _frameBuffer + y * cols + left;
+				memmove(data, data + 1, right - left);
+				changed(y, left, right);
+			}
+			return;
+		}
+
+		for (uint16_t byteRow = row / PIXELS_PER_BYTE; byteRow * PIXELS_PER_BYTE < row + height; byteRow++) {
+			// The pixels in this strip that are inside the region
+			uint16_t first = byteRow * PIXELS_PER_BYTE;
+			uint8_t low = row > first ? row - first : 0;
+			uint8_t high = row + height < first + PIXELS_PER_BYTE ? row + height - first : PIXELS_PER_BYTE;
+			uint8_t mask = ((1 << (high * bits)) - 1) & ~((1 << (low * bits)) - 1);
+
+			uint8_t *data = _frameBuffer + byteRow * cols + left;
+			if (0xff == mask) {
+				memmove(data, data + 1, right - left);
+			} else {
+				for (uint16_t x = left; x < right; x++, data++) {
+					*data = (*data & ~mask) | (data[1] & mask);
+				}
+			}
+			changed(byteRow, left, right);
+		}
+	}
+
+	/* Get 8 vertical pixels of a 1 bit display in one go
+	 * param:	col		the column
+	 * param:	page	which strip of 8 rows, rows page * 8 to page * 8 + 7
+	 * return	the pixels, the lowest row in bit 0
+	 */
+	uint8_t getColumnByte(uint16_t col, uint16_t page) {
+		static_assert(1 == bits, "Column bytes are only available on 1 bit displays");
+
+		if (col < cols && page < BYTE_ROWS) {
+			return _frameBuffer[page * cols + col];
+		}
+		return 0;
+	}
+
+	/* Set 8 vertical pixels of a 1 bit display in one go
+	 * param:	col		the column
+	 * param:	page	which strip of 8 rows, rows page * 8 to page * 8 + 7
+	 * param:	pixels	the pixels, the lowest row in bit 0
+	 */
+	void setColumnByte(uint16_t col, uint16_t page, uint8_t pixels) {
+		static_assert(1 == bits, "Column bytes are only available on 1 bit displays");
+
+		if (col < cols && page < BYTE_ROWS) {
+			_frameBuffer[page * cols + col] = pixels;
+			changed(page, col, col);
+		}
+	}
+
+	/* Get 8 horizontal pixels of a 1 bit display in one go
+	 * param:	col		the leftmost column
+	 * param:	row		the row
+	 * return	the pixels, the leftmost column in bit 7, columns past the edge read as off
+	 */
+	uint8_t getRowByte(uint16_t col, uint16_t row) {
+		static_assert(1 == bits, "Row bytes are only available on 1 bit displays");
+
+		uint8_t pixels = 0;
+		if (row < rows) {
+			uint8_t mask = 1 << (row % 8);
+			const uint8_t *data = _frameBuffer + (row / 8) * cols + col;
+
+			for (uint8_t i = 0; i < 8; i++, data++) {
+				pixels <<= 1;
+				if (col + i < cols && (*data & mask)) {
+					pixels |= 1;
+				}
+			}
+		}
+
+		return pixels;
+	}
+
+	/* Set 8 horizontal pixels of a 1 bit display in one go
+	 * param:	col		the leftmost column
+	 * param:	row		the row
+	 * param:	pixels	the pixels, the leftmost column in bit 7, columns past the edge are ignored
+	 */
+	void setRowByte(uint16_t col, uint16_t row, uint8_t pixels) {
+		static_assert(1 == bits, "Row bytes are only available on 1 bit displays");
+
+		if (row < rows) {
+			uint8_t mask = 1 << (row % 8);
+			uint8_t *data = _frameBuffer + (row / 8) * cols + col;
+
+			uint8_t i;
+			for (i = 0; i < 8 && col + i < cols; i++, data++, pixels <<= 1) {
+				if (pixels & 0x80) {
+					*data |= mask;
+				} else {
+					*data &= ~mask;
+				}
+			}
+			if (i) {
+				changed(row / 8, col, col + i - 1);
+			}
+		}
+	}
 };
 
 }
@@ -0,0 +1,687 @@
+/* Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef FLAME_DISPLAY_SSD1306_H_
+#define FLAME_DISPLAY_SSD1306_H_
+
+#include <flame/Display_Monochrome_Buffered.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/**
+ * Assign the SPI interrupt to a Display_SSD1306_SPI
+ * @param	flameDisplay	the display
+ */
+#define FLAME_SSD1306_SPI_ASSIGN_INTERRUPTS(flameDisplay) \
+ISR(SPI_STC_vect) { \
+	flameDisplay.transmitted(); \
+}
+
+/**
+ * Assign the TWI interrupt to a Display_SSD1306_TWI
+ * @param	flameDisplay	the display
+ */
+#define FLAME_SSD1306_TWI_ASSIGN_INTERRUPTS(flameDisplay) \
+ISR(TWI_vect) { \
+	flameDisplay.transmitted(); \
+}
+
+namespace flame {
+
+enum class SSD1306Controller : uint8_t {
+	SSD1306,	// 128 column RAM
+	SH1106		// 132 column RAM, the display is in the middle
+};
+
+/**
+ * A listener which will be notified when an asynchronous flush has finished
+ */
+class SSD1306Listener {
+public:
+	/**
+	 * Called from the interrupt handler once the last changed span has been sent
+	 * The display may be drawn on and flushed again from here
+	 */
+	virtual void flushComplete() =0;
+	virtual ~SSD1306Listener() {};
+};
+
+/**
+ * The parts of an SSD1306 or SH1106 OLED display that don't depend on how the bytes are sent
+ *
+ * The framebuffer is the 1 bit packed layout of Display_Monochrome_Buffered, which is the
+ * controller's own page layout: each byte is 8 rows of a column, the lowest row in bit 0. The
+ * controller is set up with its COM scan reversed, so page 0 is at the bottom of the display.
+ *
+ * Each page keeps the range of columns that have changed since they were sent, and a flush only
+ * sends those spans, using page addressing mode (which both controllers support).
+ *
+ * @tparam	cols		the number of columns (128)
+ * @tparam	rows		the number of rows (32 or 64)
+ * @tparam	txBuffers	the number of output buffers
+ * @tparam	controller	the controller chip
+ */
+template<uint16_t cols, uint16_t rows, uint8_t txBuffers, SSD1306Controller controller>
+class Display_SSD1306 : public Display_Monochrome_Buffered<cols, rows, txBuffers, 1,
+		Display_SSD1306<cols, rows, txBuffers, controller> > {
+	typedef Display_Monochrome_Buffered<cols, rows, txBuffers, 1,
+			Display_SSD1306<cols, rows, txBuffers, controller> > Buffer;
+	friend class Display_Monochrome_BufferedChanges<Display_SSD1306<cols, rows, txBuffers, controller> >;
+
+	static_assert(cols <= 128 && 0 == rows % 8 && rows <= 64, "The display must be at most 128x64, in whole pages");
+
+protected:
+	static const uint8_t		PAGES = rows / 8;
+	static const uint8_t		COLUMN_OFFSET = (SSD1306Controller::SH1106 == controller) ? 2 : 0;
+
+	volatile uint8_t			_dirtyLeft[PAGES];		// the changed columns of each page, none if left > right
+	volatile uint8_t			_dirtyRight[PAGES];
+
+	volatile bool				_busy;
+	SSD1306Listener * volatile	_listener;
+	uint8_t						_page;					// the page being sent
+	uint8_t						_col;					// the next column to send
+	uint8_t						_end;					// the column after the last one to send
+	uint8_t						_command;				// the next addressing command byte to send
+
+	/**
+	 * Track the changed columns of each page
+	 * Interrupts are only disabled to widen a span, as a flush may take the span from under us.
+	 * Writes inside the span that is already dirty just check it: if a flush takes the span
+	 * in the meantime, it still sends the byte, as the framebuffer has already been written.
+	 * @param	page	the page written
+	 * @param	left	the leftmost column written
+	 * @param	right	the rightmost column written
+	 */
+	INLINE void changed(uint16_t page, uint16_t left, uint16_t right) {
+		if (left >= _dirtyLeft[page] && right <= _dirtyRight[page]) {
+			return;
+		}
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (left < _dirtyLeft[page]) {
+				_dirtyLeft[page] = left;
+			}
+			if (right > _dirtyRight[page]) {
+				_dirtyRight[page] = right;
+			}
+		}
+	}
+
+	/**
+	 * Find the next page with changes, starting at _page, and take its span
+	 * @return true if there was a page to send
+	 */
+	bool nextPage() {
+		for (; _page < PAGES; _page++) {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				if (_dirtyLeft[_page] <= _dirtyRight[_page]) {
+					_col = _dirtyLeft[_page];
+					_end = _dirtyRight[_page] + 1;
+					_dirtyLeft[_page] = 0xff;
+					_dirtyRight[_page] = 0;
+					_command = 0;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Get the next byte of the flush to send
+	 * Each changed span is 3 addressing commands followed by the data
+	 * @param	byte	returns the byte to send
+	 * @param	data	returns true if the byte is display data, false if it is a command
+	 * @return true if there was a byte to send, false if the flush is finished
+	 */
+	INLINE bool nextByte(uint8_t *byte, bool *data) {
+		if (_col >= _end) {
+			_page++;
+			if (!nextPage()) {
+				return false;
+			}
+		}
+
+		*data = false;
+		switch (_command) {
+		case 0:
+			*byte = 0xb0 | _page;
+			break;
+		case 1:
+			*byte = 0x00 | ((_col + COLUMN_OFFSET) & 0x0f);
+			break;
+		case 2:
+			*byte = 0x10 | ((_col + COLUMN_OFFSET) >> 4);
+			break;
+		default:
+			*data = true;
+			*byte = Buffer::_frameBuffer[_page * cols + _col++];
+			return true;
+		}
+
+		_command++;
+		return true;
+	}
+
+	/**
+	 * Start a flush
+	 * @param	listener	the listener to notify when an asynchronous flush is complete
+	 * @return true if there is something to send, false if a flush is already running or nothing has changed
+	 */
+	bool startFlush(SSD1306Listener *listener) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (_busy) {
+				return false;
+			}
+			_busy = true;
+		}
+
+		_page = 0;
+		if (!nextPage()) {
+			_busy = false;
+			return false;
+		}
+
+		_listener = listener;
+		return true;
+	}
+
+	/**
+	 * Finish a flush, notifying the listener if there is one
+	 */
+	void endFlush() {
+		SSD1306Listener *listener = _listener;
+
+		_busy = false;
+		if (NULL != listener) {
+			listener->flushComplete();
+		}
+	}
+
+	/**
+	 * Send a command to the display, waiting until it has been sent
+	 * @param	command		the command byte
+	 */
+	virtual void sendCommand(uint8_t command) =0;
+
+	/**
+	 * Send a list of commands to the display, waiting until they have been sent
+	 * @param	commands	the commands, in PROGMEM
+	 * @param	length		the number of bytes
+	 */
+	void sendCommands_P(const uint8_t *commands, uint8_t length) {
+		while (length--) {
+			sendCommand(pgm_read_byte(commands++));
+		}
+	}
+
+public:
+	/**
+	 * Create a new display
+	 * The whole framebuffer will be sent by the first flush
+	 */
+	Display_SSD1306() :
+		_busy(false), _listener(NULL), _page(0), _col(0), _end(0), _command(0) {
+		for (uint8_t page = 0; page < PAGES; page++) {
+			_dirtyLeft[page] = 0;
+			_dirtyRight[page] = cols - 1;
+		}
+	}
+
+	/**
+	 * Set up the controller & turn the display on
+	 * The whole framebuffer will be sent by the next flush
+	 */
+	void init() {
+		static const uint8_t commandsSSD1306[] PROGMEM = {
+			0xae,				// display off
+			0xd5, 0x80,			// clock divider
+			0xa8, rows - 1,		// multiplex ratio
+			0xd3, 0x00,			// display offset
+			0x40,				// start line 0
+			0x8d, 0x14,			// charge pump on
+			0xa1,				// segment remap, column 0 on the left
+			0xc0,				// COM scan from COM0, page 0 at the bottom
+			0xda, (64 == rows) ? 0x12 : 0x02,	// COM pin layout
+			0x81, 0xcf,			// contrast
+			0xd9, 0xf1,			// precharge
+			0xdb, 0x40,			// VCOMH deselect level
+			0xa4,				// show the RAM contents
+			0xa6,				// not inverted
+			0xaf				// display on
+		};
+		static const uint8_t commandsSH1106[] PROGMEM = {
+			0xae,				// display off
+			0xd5, 0x80,			// clock divider
+			0xa8, rows - 1,		// multiplex ratio
+			0xd3, 0x00,			// display offset
+			0x40,				// start line 0
+			0xad, 0x8b,			// DC-DC on
+			0xa1,				// segment remap, column 0 on the left
+			0xc0,				// COM scan from COM0, page 0 at the bottom
+			0xda, 0x12,			// COM pin layout
+			0x81, 0x80,			// contrast
+			0xd9, 0x22,			// precharge
+			0xdb, 0x35,			// VCOM deselect level
+			0xa4,				// show the RAM contents
+			0xa6,				// not inverted
+			0xaf				// display on
+		};
+
+		if (SSD1306Controller::SH1106 == controller) {
+			sendCommands_P(commandsSH1106, sizeof(commandsSH1106));
+		} else {
+			sendCommands_P(commandsSSD1306, sizeof(commandsSSD1306));
+		}
+
+		Buffer::changedAll();
+	}
+
+	/**
+	 * Set the contrast of the display
+	 * @param	contrast	the contrast, 0-255
+	 */
+	void setContrast(uint8_t contrast) {
+		sendCommand(0x81);
+		sendCommand(contrast);
+	}
+
+	/**
+	 * Rotate the display by 180 degrees, for modules mounted upside down
+	 * The framebuffer is resent by the next flush
+	 * @param	rotate	true to rotate the display
+	 */
+	void rotate180(bool rotate) {
+		sendCommand(rotate ? 0xa0 : 0xa1);
+		sendCommand(rotate ? 0xc8 : 0xc0);
+		Buffer::changedAll();
+	}
+
+	/**
+	 * Is a flush in progress?
+	 * @return true if a flush is in progress
+	 */
+	bool busy() {
+		return _busy;
+	}
+};
+
+/**
+ * An SSD1306 or SH1106 OLED display on the hardware SPI port (4 wire)
+ * The clock and data pins are the SCK and MOSI pins of the SPI port. The SS pin must be an output,
+ * or held high, for the port to stay in master mode.
+ * For asynchronous flushes, the interrupt must be assigned with FLAME_SSD1306_SPI_ASSIGN_INTERRUPTS
+ *
+ * @tparam	cols		the number of columns (128)
+ * @tparam	rows		the number of rows (32 or 64)
+ * @tparam	txBuffers	the number of output buffers
+ * @tparam	controller	the controller chip
+ * @tparam	clock...	the SCK pin
+ * @tparam	data...		the MOSI pin
+ * @tparam	dc...		the data/command pin
+ * @tparam	select...	the chip select pin (active low)
+ * @tparam	divider		the SPI clock divider, 2, 4, 8, 16, 32, 64 or 128
+ */
+template<uint16_t cols, uint16_t rows, uint8_t txBuffers, SSD1306Controller controller,
+		FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), FLAME_DECLARE_PIN(dc), FLAME_DECLARE_PIN(select),
+		uint8_t divider = 2>
+class Display_SSD1306_SPI : public Display_SSD1306<cols, rows, txBuffers, controller> {
+	typedef Display_SSD1306<cols, rows, txBuffers, controller> Base;
+
+	static_assert(divider == 2 || divider == 4 || divider == 8 || divider == 16 ||
+			divider == 32 || divider == 64 || divider == 128, "Invalid SPI clock divider");
+
+	/**
+	 * Set the data/command pin for the next byte
+	 * @param	data	true for display data, false for a command
+	 */
+	INLINE void setDataCommand(bool data) {
+		if (data) {
+			pinOn(FLAME_PIN_PARMS(dc));
+		} else {
+			pinOff(FLAME_PIN_PARMS(dc));
+		}
+	}
+
+protected:
+	/**
+	 * Send a command to the display, waiting until it has been sent
+	 * @param	command		the command byte
+	 */
+	void sendCommand(uint8_t command) {
+		while (Base::_busy) {}
+
+		setDataCommand(false);
+		pinOff(FLAME_PIN_PARMS(select));
+		SPDR = command;
+		loop_until_bit_is_set(SPSR, SPIF);
+		pinOn(FLAME_PIN_PARMS(select));
+	}
+
+public:
+	/**
+	 * Create a new driver for an OLED display on the SPI port
+	 */
+	Display_SSD1306_SPI() {
+		setOutput(FLAME_PIN_PARMS(clock));
+		setOutput(FLAME_PIN_PARMS(data));
+		setOutput(FLAME_PIN_PARMS(dc));
+		pinOn(FLAME_PIN_PARMS(select));
+		setOutput(FLAME_PIN_PARMS(select));
+
+		// Mode 0, MSB first, master
+		uint8_t rate;
+		switch (divider) {
+		case 2:
+		case 4:
+			rate = 0;
+			break;
+		case 8:
+		case 16:
+			rate = _BV(SPR0);
+			break;
+		case 32:
+		case 64:
+			rate = _BV(SPR1);
+			break;
+		default:
+			rate = _BV(SPR1) | _BV(SPR0);
+			break;
+		}
+		SPCR = _BV(SPE) | _BV(MSTR) | rate;
+		SPSR = (divider == 2 || divider == 8 || divider == 32) ? _BV(SPI2X) : 0;
+	}
+
+	/**
+	 * Send the changed parts of the framebuffer to the display, waiting until they have been sent
+	 */
+	void flush() {
+		uint8_t byte;
+		bool data;
+
+		while (!Base::startFlush(NULL)) {
+			if (!Base::_busy) {
+				return;
+			}
+		}
+
+		pinOff(FLAME_PIN_PARMS(select));
+		while (Base::nextByte(&byte, &data)) {
+			setDataCommand(data);
+			SPDR = byte;
+			loop_until_bit_is_set(SPSR, SPIF);
+		}
+		pinOn(FLAME_PIN_PARMS(select));
+
+		Base::endFlush();
+	}
+
+	/**
+	 * Start sending the changed parts of the framebuffer to the display in the background
+	 * The framebuffer may be drawn on while this runs, anything changed will be sent by the next flush
+	 * @param	listener	notified when the flush is complete, may be NULL
+	 * @return true if the flush was started, false if one is already in progress or nothing has changed
+	 */
+	bool flushAsync(SSD1306Listener *listener) {
+		uint8_t byte;
+		bool data;
+
+		if (!Base::startFlush(listener)) {
+			return false;
+		}
+
+		Base::nextByte(&byte, &data);
+		pinOff(FLAME_PIN_PARMS(select));
+		setDataCommand(data);
+		SPCR |= _BV(SPIE);
+		SPDR = byte;
+
+		return true;
+	}
+
+	/**
+	 * SPI transfer complete interrupt handler
+	 */
+	void transmitted() {
+		uint8_t byte;
+		bool data;
+
+		if (Base::nextByte(&byte, &data)) {
+			setDataCommand(data);
+			SPDR = byte;
+			return;
+		}
+
+		SPCR &= ~_BV(SPIE);
+		pinOn(FLAME_PIN_PARMS(select));
+		Base::endFlush();
+	}
+};
+
+/**
+ * An SSD1306 or SH1106 OLED display on the TWI (I2C) port
+ * Each changed span is sent as one transaction: a control byte before each addressing command,
+ * then a data control byte and the data.
+ * For asynchronous flushes, the interrupt must be assigned with FLAME_SSD1306_TWI_ASSIGN_INTERRUPTS
+ *
+ * @tparam	cols		the number of columns (128)
+ * @tparam	rows		the number of rows (32 or 64)
+ * @tparam	txBuffers	the number of output buffers
+ * @tparam	controller	the controller chip
+ * @tparam	address		the 7 bit address of the display (0x3c or 0x3d)
+ * @tparam	bitrate		the TWI bit rate in Hz
+ */
+template<uint16_t cols, uint16_t rows, uint8_t txBuffers, SSD1306Controller controller,
+		uint8_t address = 0x3c, uint32_t bitrate = 400000>
+class Display_SSD1306_TWI : public Display_SSD1306<cols, rows, txBuffers, controller> {
+	typedef Display_SSD1306<cols, rows, txBuffers, controller> Base;
+
+	static_assert(F_CPU / bitrate >= 16 && (F_CPU / bitrate - 16) / 2 <= 255, "Invalid TWI bit rate");
+
+	// TWI master transmitter status codes
+	static const uint8_t	TWI_START = 0x08;
+	static const uint8_t	TWI_REPEATED_START = 0x10;
+	static const uint8_t	TWI_ADDRESS_ACK = 0x18;
+	static const uint8_t	TWI_DATA_ACK = 0x28;
+
+	// Control bytes
+	static const uint8_t	CONTROL_COMMAND = 0x80;		// a single command follows, then another control byte
+	static const uint8_t	CONTROL_COMMANDS = 0x00;	// commands follow until the stop
+	static const uint8_t	CONTROL_DATA = 0x40;		// data follows until the stop
+
+	uint8_t			_pending;			// the byte to send after its control byte
+	bool			_pendingData;		// true if _pending is display data
+	bool			_havePending;		// true if _pending is still to be sent
+	bool			_controlSent;		// true if the control byte for _pending has been sent
+	bool			_inData;			// true once the data control byte of the transaction has been sent
+	bool			_interrupts;		// true if the flush is interrupt driven
+
+	/**
+	 * Set the TWI control register, keeping the interrupt enabled if we are interrupt driven
+	 * @param	flags	the flags to set as well as TWINT & TWEN
+	 */
+	INLINE void control(uint8_t flags) {
+		TWCR = _BV(TWINT) | _BV(TWEN) | (_interrupts ? _BV(TWIE) : 0) | flags;
+	}
+
+	/**
+	 * Wait for the current TWI operation to complete
+	 * @return the TWI status
+	 */
+	INLINE uint8_t wait() {
+		loop_until_bit_is_set(TWCR, TWINT);
+		return TWSR & 0xf8;
+	}
+
+	/**
+	 * Send a stop condition, waiting for it to complete
+	 */
+	INLINE void stop() {
+		TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+		loop_until_bit_is_clear(TWCR, TWSTO);
+	}
+
+protected:
+	/**
+	 * Send a command to the display, waiting until it has been sent
+	 * @param	command		the command byte
+	 */
+	void sendCommand(uint8_t command) {
+		while (Base::_busy) {}
+
+		TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTA);
+		if (TWI_START == wait()) {
+			TWDR = address << 1;
+			TWCR = _BV(TWINT) | _BV(TWEN);
+			if (TWI_ADDRESS_ACK == wait()) {
+				TWDR = CONTROL_COMMANDS;
+				TWCR = _BV(TWINT) | _BV(TWEN);
+				if (TWI_DATA_ACK == wait()) {
+					TWDR = command;
+					TWCR = _BV(TWINT) | _BV(TWEN);
+					wait();
+				}
+			}
+		}
+		stop();
+	}
+
+	/**
+	 * Start the transaction for the next span
+	 */
+	INLINE void start() {
+		_inData = false;
+		loop_until_bit_is_clear(TWCR, TWSTO);
+		control(_BV(TWSTA));
+	}
+
+public:
+	/**
+	 * Create a new driver for an OLED display on the TWI port
+	 */
+	Display_SSD1306_TWI() :
+		_pending(0), _pendingData(false), _havePending(false), _controlSent(false), _inData(false),
+		_interrupts(false) {
+		TWSR = 0;
+		TWBR = (F_CPU / bitrate - 16) / 2;
+		TWCR = _BV(TWEN);
+	}
+
+	/**
+	 * Send the changed parts of the framebuffer to the display, waiting until they have been sent
+	 */
+	void flush() {
+		while (!Base::startFlush(NULL)) {
+			if (!Base::_busy) {
+				return;
+			}
+		}
+
+		_interrupts = false;
+		_havePending = false;
+		start();
+		while (Base::_busy) {
+			loop_until_bit_is_set(TWCR, TWINT);
+			transmitted();
+		}
+	}
+
+	/**
+	 * Start sending the changed parts of the framebuffer to the display in the background
+	 * The framebuffer may be drawn on while this runs, anything changed will be sent by the next flush
+	 * @param	listener	notified when the flush is complete, may be NULL
+	 * @return true if the flush was started, false if one is already in progress or nothing has changed
+	 */
+	bool flushAsync(SSD1306Listener *listener) {
+		if (!Base::startFlush(listener)) {
+			return false;
+		}
+
+		_interrupts = true;
+		_havePending = false;
+		start();
+
+		return true;
+	}
+
+	/**
+	 * TWI interrupt handler, also called when polling a synchronous flush
+	 */
+	void transmitted() {
+		switch (TWSR & 0xf8) {
+		case TWI_START:
+		case TWI_REPEATED_START:
+			TWDR = address << 1;
+			control(0);
+			return;
+
+		case TWI_ADDRESS_ACK:
+		case TWI_DATA_ACK:
+			if (!_havePending) {
+				if (!Base::nextByte(&_pending, &_pendingData)) {
+					TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+					Base::endFlush();
+					return;
+				}
+				_havePending = true;
+				_controlSent = false;
+			}
+
+			if (_pendingData) {
+				if (!_inData) {
+					TWDR = CONTROL_DATA;
+					_inData = true;
+				} else {
+					TWDR = _pending;
+					_havePending = false;
+				}
+			} else if (_inData) {
+				// A command after data is the start of the next span
+				start();
+				return;
+			} else if (!_controlSent) {
+				TWDR = CONTROL_COMMAND;
+				_controlSent = true;
+			} else {
+				TWDR = _pending;
+				_havePending = false;
+			}
+			control(0);
+			return;
+
+		default:
+			// No acknowledgement or lost arbitration, give up and resend everything next time
+			TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+			Base::changedAll();
+			Base::endFlush();
+			return;
+		}
+	}
+};
+
+}
+#endif /* FLAME_DISPLAY_SSD1306_H_ */
@@ -34,79 +34,189 @@
 
 namespace flame {
 
-#if 0 && defined __FLASH
-const uint8_t __flash gammaValues[] = {
-#else
-const uint8_t gammaValues[] PROGMEM = {
-#endif
-	0,		0,		0,		0,		0,		0,		0,		0,
-	0,		0,		0,		0,		0,		0,		0,		0,
-	0,		0,		0,		0,		0,		0,		1,		1,
-	1,		1,		1,		1,		1,		1,		1,		1,
-	1,		2,		2,		2,		2,		2,		2,		2,
-	2,		3,		3,		3,		3,		3,		4,		4,
-	4,		4,		4,		5,		5,		5,		5,		6,
-	6,		6,		6,		7,		7,		7,		7,		8,
-	8,		8,		9,		9,		9,		10,		10,		10,
-	11,		11,		12,		12,		12,		13,		13,		14,
-	14,		15,		15,		15,		16,		16,		17,		17,
-	18,		18,		19,		19,		20,		20,		21,		22,
-	22,		23,		23,		24,		25,		25,		26,		26,
-	27,		28,		28,		29,		30,		30,		31,		32,
-	33,		33,		34,		35,		36,		36,		37,		38,
-	39,		40,		40,		41,		42,		43,		44,		45,
-	46,		46,		47,		48,		49,		50,		51,		52,
-	53,		54,		55,		56,		57,		58,		59,		60,
-	61,		62,		63,		64,		65,		67,		68,		69,
-	70,		71,		72,		73,		75,		76,		77,		78,
-	80,		81,		82,		83,		85,		86,		87,		89,
-	90,		91,		93,		94,		95,		97,		98,		99,
-	101,	102,	104,	105,	107,	108,	110,	111,
-	113,	114,	116,	117,	119,	121,	122,	124,
-	125,	127,	129,	130,	132,	134,	135,	137,
-	139,	141,	142,	144,	146,	148,	150,	151,
-	153,	155,	157,	159,	161,	163,	165,	166,
-	168,	170,	172,	174,	176,	178,	180,	182,
-	184,	186,	189,	191,	193,	195,	197,	199,
-	201,	204,	206,	208,	210,	212,	215,	217,
-	219,	221,	224,	226,	228,	231,	233,	235,
-	238,	240,	243,	245,	248,	250,	253,	255
+/* The default gamma exponent, in hundredths */
+#define FLAME_GAMMA_DEFAULT		250
+
+/* Compile time maths for building gamma tables
+ * These are written as single expression recursions so they work as C++11 constexpr, and are
+ * only ever evaluated by the compiler
+ */
+constexpr double gammaLogSeries(double z2, double term, uint8_t n) {
+	return n == 12 ? 0 : term / (2 * n + 1) + gammaLogSeries(z2, term * z2, n + 1);
+}
+
+/* ln(x) for 0 < x <= 1, halving the range until the atanh series converges quickly */
+constexpr double gammaLog(double x) {
+	return x < 0.5 ? gammaLog(x * 2) - 0.69314718055994531 :
+			2 * gammaLogSeries(((x - 1) / (x + 1)) * ((x - 1) / (x + 1)), (x - 1) / (x + 1), 0);
+}
+
+constexpr double gammaExpSeries(double y, double term, uint8_t n) {
+	return n == 12 ? term : term + gammaExpSeries(y, term * y / n, n + 1);
+}
+
+constexpr double gammaSquare(double x) {
+	return x * x;
+}
+
+/* e^y for y <= 0, squaring the result of e^(y/2) until the Taylor series converges quickly */
+constexpr double gammaExp(double y) {
+	return y < -0.5 ? gammaSquare(gammaExp(y / 2)) : gammaExpSeries(y, 1, 1);
+}
+
+/* x^exponent for 0 <= x <= 1 */
+constexpr double gammaPow(double x, double exponent) {
+	return x <= 0 ? 0 : gammaExp(exponent * gammaLog(x));
+}
+
+/* Choose the smallest type for a table entry */
+template <uint8_t bits, bool narrow = (bits <= 8)>
+struct GammaType {
+	typedef uint8_t type;
+};
+
+template <uint8_t bits>
+struct GammaType<bits, false> {
+	typedef uint16_t type;
+};
+
+/* A list of table indices, and a way to make one with logarithmic template depth */
+template <uint16_t... indices>
+struct GammaIndices {
+};
+
+template <class first, class second>
+struct GammaJoinIndices;
+
+template <uint16_t... first, uint16_t... second>
+struct GammaJoinIndices<GammaIndices<first...>, GammaIndices<second...> > {
+	typedef GammaIndices<first..., (sizeof...(first) + second)...> type;
+};
+
+template <uint16_t count>
+struct GammaMakeIndices {
+	typedef typename GammaJoinIndices<typename GammaMakeIndices<count / 2>::type,
+			typename GammaMakeIndices<count - count / 2>::type>::type type;
 };
 
-const uint8_t inverseGammaValues[] PROGMEM = {
-	0,		28,		37,		43,		48,		53,		57,		61,
-	64,		67,		70,		73,		75,		78,		80,		82,
-	84,		86,		88,		90,		92,		94,		96,		97,
-	99,		101,	102,	104,	105,	107,	108,	110,
-	111,	113,	114,	115,	117,	118,	119,	120,
-	122,	123,	124,	125,	126,	127,	129,	130,
-	131,	132,	133,	134,	135,	136,	137,	138,
-	139,	140,	141,	142,	143,	144,	145,	146,
-	147,	148,	149,	149,	150,	151,	152,	153,
-	154,	155,	155,	156,	157,	158,	159,	160,
-	160,	161,	162,	163,	164,	164,	165,	166,
-	167,	167,	168,	169,	170,	170,	171,	172,
-	173,	173,	174,	175,	175,	176,	177,	177,
-	178,	179,	179,	180,	181,	182,	182,	183,
-	183,	184,	185,	185,	186,	187,	187,	188,
-	189,	189,	190,	190,	191,	192,	192,	193,
-	194,	194,	195,	195,	196,	197,	197,	198,
-	198,	199,	199,	200,	201,	201,	202,	202,
-	203,	203,	204,	205,	205,	206,	206,	207,
-	207,	208,	208,	209,	209,	210,	211,	211,
-	212,	212,	213,	213,	214,	214,	215,	215,
-	216,	216,	217,	217,	218,	218,	219,	219,
-	220,	220,	221,	221,	222,	222,	223,	223,
-	224,	224,	225,	225,	226,	226,	227,	227,
-	228,	228,	229,	229,	230,	230,	230,	231,
-	231,	232,	232,	233,	233,	234,	234,	235,
-	235,	235,	236,	236,	237,	237,	238,	238,
-	239,	239,	240,	240,	240,	241,	241,	242,
-	242,	243,	243,	243,	244,	244,	245,	245,
-	246,	246,	246,	247,	247,	248,	248,	248,
-	249,	249,	250,	250,	251,	251,	251,	252,
-	252,	253,	253,	253,	254,	254,	255,	255
+template <>
+struct GammaMakeIndices<1> {
+	typedef GammaIndices<0> type;
 };
+
+/* The program memory tables for a curve, filled in by the compiler */
+template <class Curve, class ForwardIndices, class InverseIndices>
+struct GammaTableData;
+
+template <class Curve, uint16_t... forwardIndices, uint16_t... inverseIndices>
+struct GammaTableData<Curve, GammaIndices<forwardIndices...>, GammaIndices<inverseIndices...> > {
+	static const typename Curve::Output forward[sizeof...(forwardIndices)] PROGMEM;
+	static const typename Curve::Input inverse[sizeof...(inverseIndices)] PROGMEM;
+};
+
+template <class Curve, uint16_t... forwardIndices, uint16_t... inverseIndices>
+const typename Curve::Output GammaTableData<Curve, GammaIndices<forwardIndices...>,
+		GammaIndices<inverseIndices...> >::forward[sizeof...(forwardIndices)] PROGMEM = {
+	Curve::calculate(forwardIndices)...
+};
+
+template <class Curve, uint16_t... forwardIndices, uint16_t... inverseIndices>
+const typename Curve::Input GammaTableData<Curve, GammaIndices<forwardIndices...>,
+		GammaIndices<inverseIndices...> >::inverse[sizeof...(inverseIndices)] PROGMEM = {
+	Curve::calculateInverse(inverseIndices)...
+};
+
+/**
+ * A gamma correction curve, with its lookup tables generated at compile time
+ * Only the tables for curves that are used end up in program memory, and each is only stored
+ * once however many times it is used.
+ * @tparam	gamma		the gamma exponent, in hundredths (250 is 2.5)
+ * @tparam	inputBits	the width of the values to be corrected, up to 12 bits
+ * @tparam	outputBits	the width of the corrected values, up to 16 bits
+ */
+template <uint16_t gamma = FLAME_GAMMA_DEFAULT, uint8_t inputBits = 8, uint8_t outputBits = 8>
+class GammaTable {
+	static_assert(inputBits >= 1 && inputBits <= 12, "Gamma tables can have 1 to 12 input bits");
+	static_assert(outputBits >= 1 && outputBits <= 16, "Gamma tables can have 1 to 16 output bits");
+	static_assert(gamma > 0, "The gamma exponent must be positive");
+
+public:
+	typedef typename GammaType<inputBits>::type		Input;
+	typedef typename GammaType<outputBits>::type	Output;
+
+	static const uint16_t inputMax = (1UL << inputBits) - 1;
+	static const uint16_t outputMax = (1UL << outputBits) - 1;
+
+	/* The inverse table is indexed by the top bits of a corrected value, so it is no bigger than
+	 * the forward table
+	 */
+	static const uint8_t inverseShift = outputBits > inputBits ? outputBits - inputBits : 0;
+	static const uint16_t inverseMax = outputMax >> inverseShift;
+
+	/**
+	 * Calculate a gamma corrected value, only for use at compile time
+	 * @param	value	the value to correct, 0 - inputMax
+	 * @return the corrected value, 0 - outputMax
+	 */
+	static constexpr Output calculate(uint16_t value) {
+		return (Output)(outputMax * gammaPow((double)value / inputMax, gamma / 100.0) + 0.5);
+	}
+
+	/**
+	 * Calculate an inverse gamma corrected value, only for use at compile time
+	 * This is the smallest value whose corrected value has the given top bits, so it undoes
+	 * calculate() exactly for every value that has its own entry in the inverse table
+	 * @param	index	the corrected value shifted right by inverseShift, 0 - inverseMax
+	 * @return the uncorrected value, 0 - inputMax
+	 */
+	static constexpr Input calculateInverse(uint16_t index) {
+		return inverseSearch(index, 0, inputMax);
+	}
+
+	/**
+	 * Gamma correct a value via the lookup table
+	 * @param	value	the value to correct, 0 - inputMax
+	 * @return the corrected value, 0 - outputMax
+	 */
+	static INLINE Output correct(Input value) {
+		const Output *entry = Data::forward + value;
+		return sizeof(Output) == 1 ? pgm_read_byte(entry) : pgm_read_word(entry);
+	}
+
+	/**
+	 * Get the forward lookup table, for code that reads it directly
+	 * @return the table in program memory, indexed by the value to correct
+	 */
+	static INLINE const Output *table() {
+		return Data::forward;
+	}
+
+	/**
+	 * Inverse gamma correct a value via the lookup table
+	 * @param	value	the corrected value, 0 - outputMax
+	 * @return the uncorrected value, 0 - inputMax
+	 */
+	static INLINE Input inverseCorrect(Output value) {
+		const Input *entry = Data::inverse + (value >> inverseShift);
+		return sizeof(Input) == 1 ? pgm_read_byte(entry) : pgm_read_word(entry);
+	}
+
+private:
+	typedef GammaTableData<GammaTable, typename GammaMakeIndices<inputMax + 1>::type,
+			typename GammaMakeIndices<inverseMax + 1>::type> Data;
+
+	/* Binary search for the smallest value in low - high whose corrected top bits reach index */
+	static constexpr uint16_t inverseSearch(uint16_t index, uint16_t low, uint16_t high) {
+		return low >= high ? low :
+				(calculate((low + high) / 2) >> inverseShift) >= index ?
+						inverseSearch(index, low, (low + high) / 2) :
+						inverseSearch(index, (low + high) / 2 + 1, high);
+	}
+};
+
+/* The curve used by RGB and the LED strips unless they are told otherwise */
+typedef GammaTable<FLAME_GAMMA_DEFAULT>	DefaultGamma;
+
 uint8_t calculatedGammaCorrect(uint8_t value);
 
 /* Gamma correct a value via a lookup table
@@ -115,15 +225,11 @@ uint8_t calculatedGammaCorrect(uint8_t value);
  * return the gamma corrected value
  */
 inline uint8_t precalculatedGammaCorrect(uint8_t value) {
-#if 0 && defined __FLASH
-	return gammaValues[value];
-#else
-	return pgm_read_byte(gammaValues + value);
-#endif
+	return DefaultGamma::correct(value);
 }
 
 inline uint8_t precalculatedInverseGammaCorrect(uint8_t value) {
-	return pgm_read_byte(inverseGammaValues + value);
+	return DefaultGamma::inverseCorrect(value);
 }
 
 }
@@ -0,0 +1,133 @@
+/* Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAME_MARQUEE_H_
+#define FLAME_MARQUEE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <avr/pgmspace.h>
+#include <flame/io.h>
+#include <flame/Font.h>
+
+namespace flame {
+
+/**
+ * A region of a monochrome display that scrolls a line of text from right to left
+ *
+ * The marquee keeps a cursor into the text and into the font data, so each step only needs the
+ * next column of the font. Display_Monochrome::scroll moves the pixels already in the region one
+ * column left and draws the new column at the right hand edge, so the work per frame depends on
+ * the height of the text, not on how long it is. A display can have as many marquees as it has
+ * room for, each stepped independently.
+ *
+ * The text is not copied, it must stay valid until the marquee has finished.
+ */
+class Marquee {
+protected:
+	const FONT		&_font;
+	uint16_t		_left;			// the leftmost column of the region
+	uint16_t		_right;			// the rightmost column of the region
+	int16_t			_row;			// the bottom row of the region
+	uint8_t			_onValue;
+	uint8_t			_offValue;
+
+	const char		*_next;			// the next character of the text
+	bool			_progmem;		// true if the text is in program memory
+	const uint8_t	*_glyph;		// the next column of the current character in the font data
+	uint8_t			_remaining;		// the number of columns left in the current character
+	bool			_separator;		// true if a separator column is due after the current character
+	uint16_t		_trailing;		// the number of blank columns left to scroll the text off
+
+	char nextCharacter();
+
+public:
+	Marquee(const FONT &font, uint16_t left, uint16_t right, int16_t row,
+			uint8_t onValue, uint8_t offValue);
+
+	void setText(const char *text);
+	void setText_P(PGM_P text);
+	bool nextColumn(const uint8_t **column);
+
+	/**
+	 * Has all of the text scrolled off the region?
+	 * @return true if there is nothing more to scroll
+	 */
+	bool finished() {
+		return NULL == _next;
+	}
+
+	/**
+	 * Get the font the marquee uses
+	 * @return the font
+	 */
+	const FONT &getFont() {
+		return _font;
+	}
+
+	/**
+	 * Get the leftmost column of the region
+	 * @return the column
+	 */
+	uint16_t getLeft() {
+		return _left;
+	}
+
+	/**
+	 * Get the rightmost column of the region
+	 * @return the column
+	 */
+	uint16_t getRight() {
+		return _right;
+	}
+
+	/**
+	 * Get the bottom row of the region
+	 * @return the row
+	 */
+	int16_t getRow() {
+		return _row;
+	}
+
+	/**
+	 * Get the pixel value for on pixels
+	 * @return the value
+	 */
+	uint8_t getOnValue() {
+		return _onValue;
+	}
+
+	/**
+	 * Get the pixel value for off pixels
+	 * @return the value
+	 */
+	uint8_t getOffValue() {
+		return _offValue;
+	}
+};
+
+}
+#endif /* FLAME_MARQUEE_H_ */
@@ -32,6 +32,7 @@
 #include <math.h>
 #include <flame/Display_Monochrome_Buffered.h>
 #include <flame/Timer.h>
+#include <util/atomic.h>
 
 namespace flame {
 
@@ -42,12 +43,42 @@ enum class PWMMatrixMode : uint8_t {
 	INDIVIDUAL
 };
 
+/**
+ * How brightness is made from the framebuffer
+ */
+enum class PWMMatrixModulation : uint8_t {
+	THRESHOLD,	// 255 equal ticks per line, each pixel is turned off once the tick passes its value
+	BAM			// bit angle modulation, one tick per framebuffer bit, each twice as long as the last
+};
+
 class PWMMatrixDriver {
 public:
 	virtual void rowOn(uint16_t row) =0;
 	virtual void rowOff(uint16_t row) =0;
 	virtual void colOn(uint16_t col) =0;
 	virtual void colOff(uint16_t col) =0;
+
+	/**
+	 * Compile the pixels of a line into the bytes writeMasks will output
+	 * Only used by matrices with maskBytes set. This is called from the matrix's flush() for each line
+	 * changed since the last one, outside of the interrupt, so it is the place to work out port bits
+	 * or shift register bytes. A matrix
+	 * scanning rows passes the columns, a matrix scanning columns passes the rows.
+	 * @param	pixels	the pixels to turn on, pixel n in bit n % 8 of byte n / 8
+	 * @param	count	the number of pixels
+	 * @param	masks	returns the bytes to output, maskBytes of them
+	 */
+	virtual void compileMasks(UNUSED const uint8_t *pixels, UNUSED uint16_t count, UNUSED uint8_t *masks) {
+	}
+
+	/**
+	 * Set all the pixels of a line at once, from bytes made by compileMasks
+	 * Called from the matrix tick, so this should only write the bytes to the port registers,
+	 * shift registers or SPI port
+	 * @param	masks	the bytes to output
+	 */
+	virtual void writeMasks(UNUSED const uint8_t *masks) {
+	}
 };
 
 
@@ -57,20 +88,299 @@ public:
 
 /**
  * A driver for bitbashed LED matrices
+ *
+ * With THRESHOLD modulation, each line (row, column or pixel) is shown for 255 timer ticks, and
+ * each tick turns off the pixels whose value it has passed.
+ *
+ * With BAM modulation, each line is shown for one tick per framebuffer bit, and each tick is twice
+ * as long as the one before, so an 8 bit framebuffer takes 8 ticks per line rather than 255. Each
+ * tick outputs a bit plane of the line, which is worked out when the framebuffer is written. Give
+ * the matrix its timer with setBAMTimer, and it will stretch the timer period for each tick itself;
+ * otherwise it counts the ticks of a fixed period timer, which is no faster but makes most ticks
+ * trivial.
+ *
+ * When scanning rows or columns, maskBytes lets the driver set a whole line in one go. Each line is
+ * compiled into driver specific bytes (port bits, shift register bytes...): one set for each BAM
+ * bit, or for each level a pixel turns off at with THRESHOLD. The tick then just hands the bytes to
+ * the driver's writeMasks, rather than calling colOn/colOff (or rowOn/rowOff) for every pixel.
+ * Drawing only marks the lines it touches, and flush() compiles them, so call flush() once a frame
+ * has been drawn. Until then, the matrix keeps showing the lines as they were last compiled.
+ *
  * @tparam	cols		the number of columns
  * @tparam	rows		the number of rows
  * @tparam	txBuffers	the number of output buffers
  * @tparam	mode		whether to scan rows, cols, individual pixels or auto
+ * @tparam	bits		the number of bits per pixel in the framebuffer, 1, 2, 4 or 8
+ * @tparam	modulation	how to make brightness from the framebuffer
+ * @tparam	maskBytes	the number of bytes the driver compiles each line into, 0 to set pixels one at a time
  */
-template<uint16_t cols, uint16_t rows, uint8_t txBuffers, PWMMatrixMode mode>
-class PWMMatrix : public Display_Monochrome_Buffered<cols, rows, txBuffers>,
+template<uint16_t cols, uint16_t rows, uint8_t txBuffers, PWMMatrixMode mode, uint8_t bits = 8,
+		PWMMatrixModulation modulation = PWMMatrixModulation::THRESHOLD, uint8_t maskBytes = 0>
+class PWMMatrix : public Display_Monochrome_Buffered<cols, rows, txBuffers, bits,
+		PWMMatrix<cols, rows, txBuffers, mode, bits, modulation, maskBytes> >,
 	public TimerListener {
 private:
+	typedef PWMMatrix<cols, rows, txBuffers, mode, bits, modulation, maskBytes> Matrix;
+	typedef Display_Monochrome_Buffered<cols, rows, txBuffers, bits, Matrix> Buffer;
+	friend class Display_Monochrome_BufferedChanges<Matrix>;
+
 	uint16_t				_currentRow;
 	uint16_t				_currentCol;
 	uint8_t					_currentLevel;
 	PWMMatrixDriver		&_driver;
 
+	static const bool		SCAN_LINES = PWMMatrixMode::ROWS == _MODE || PWMMatrixMode::COLS == _MODE;
+	static const uint16_t	LINES = (PWMMatrixMode::ROWS == _MODE) ? rows : cols;	// the rows or columns scanned
+	static const uint16_t	LENGTH = (PWMMatrixMode::ROWS == _MODE) ? cols : rows;	// the pixels along each line
+	static const bool		USE_MASKS = maskBytes && SCAN_LINES;
+	static const bool		USE_PLANES = PWMMatrixModulation::BAM == modulation && SCAN_LINES && !USE_MASKS;
+	static const bool		USE_LEVELS = PWMMatrixModulation::THRESHOLD == modulation && USE_MASKS;
+	static const uint16_t	MASK_SETS = (PWMMatrixModulation::BAM == modulation) ? bits : LENGTH + 1;
+
+	// BAM state, the current level is the bit being shown
+	uint8_t					_planes[USE_PLANES ? LINES : 1][bits][USE_PLANES ? (LENGTH + 7) / 8 : 1];
+
+	// Compiled lines, and the levels the THRESHOLD sets start at (ending with 255)
+	uint8_t					_masks[USE_MASKS ? LINES : 1][USE_MASKS ? MASK_SETS : 1][maskBytes ? maskBytes : 1];
+	uint8_t					_levels[USE_LEVELS ? LINES : 1][USE_LEVELS ? LENGTH + 2 : 1];
+	uint8_t					_dirtyLines[USE_MASKS ? (LINES + 7) / 8 : 1];	// lines to compile, 1 bit per line
+	uint16_t				_nextSet;		// the next THRESHOLD set to output
+	Timer					*_timer;
+	uint16_t				_baseTop;		// the timer period for the least significant bit
+	uint8_t					_holdTicks;		// ticks left of the current bit when counting fixed period ticks
+
+	/**
+	 * Get the value of a pixel as it is stored in the framebuffer
+	 * @param	col		the column
+	 * @param	row		the row
+	 * @return the value, 0 to 2^bits - 1
+	 */
+	INLINE uint8_t storedValue(uint16_t col, uint16_t row) {
+		return Buffer::pixelValue(col, row) >> (8 - bits);
+	}
+
+	/**
+	 * Get a pixel by its position in a line
+	 * @param	line		the row or column being scanned
+	 * @param	position	the pixel along the line
+	 * @return the intensity of the pixel, 0-255
+	 */
+	INLINE uint8_t linePixel(uint16_t line, uint16_t position) {
+		if (PWMMatrixMode::ROWS == _MODE) {
+			return Buffer::pixelValue(position, line);
+		}
+		return Buffer::pixelValue(line, position);
+	}
+
+	/**
+	 * Compile a line with the driver
+	 * The line is built up on the stack, then copied in with interrupts off so a tick never sees half of it
+	 * @param	line	the row or column to compile
+	 */
+	void compileLine(uint16_t line) {
+		uint8_t		plane[(LENGTH + 7) / 8];
+		uint8_t		masks[USE_MASKS ? MASK_SETS : 1][maskBytes ? maskBytes : 1];
+		uint8_t		levels[USE_LEVELS ? LENGTH + 2 : 1];
+		uint16_t	sets = 0;
+		uint16_t	position;
+
+		if (PWMMatrixModulation::BAM == modulation) {
+			for (; sets < bits; sets++) {
+				memset(plane, 0, sizeof(plane));
+				for (position = 0; position < LENGTH; position++) {
+					if ((linePixel(line, position) >> (8 - bits)) & (1 << sets)) {
+						plane[position / 8] |= 1 << (position & 7);
+					}
+				}
+				_driver.compileMasks(plane, LENGTH, masks[sets]);
+			}
+		} else {
+			// The line goes on at level 0, then each distinct pixel value is a level where some pixels go off
+			levels[sets++] = 0;
+			for (position = 0; position < LENGTH; position++) {
+				uint8_t value = linePixel(line, position);
+				if (0 == value || 255 == value) {
+					continue;
+				}
+
+				uint16_t i = 1;
+				while (i < sets && levels[i] < value) {
+					i++;
+				}
+				if (i < sets && levels[i] == value) {
+					continue;
+				}
+				memmove(levels + i + 1, levels + i, sets - i);
+				levels[i] = value;
+				sets++;
+			}
+			levels[sets] = 255;
+
+			for (uint16_t set = 0; set < sets; set++) {
+				memset(plane, 0, sizeof(plane));
+				for (position = 0; position < LENGTH; position++) {
+					if (linePixel(line, position) > levels[set]) {
+						plane[position / 8] |= 1 << (position & 7);
+					}
+				}
+				_driver.compileMasks(plane, LENGTH, masks[set]);
+			}
+		}
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			memcpy(_masks[line], masks, sets * sizeof(masks[0]));
+			if (USE_LEVELS) {
+				memcpy(_levels[line], levels, sets + 1);
+			}
+		}
+	}
+
+	/**
+	 * Mark a line to be compiled by the next flush
+	 * @param	line	the row or column
+	 */
+	INLINE void lineChanged(uint16_t line) {
+		_dirtyLines[line / 8] |= 1 << (line & 7);
+	}
+
+	/**
+	 * Update the bit planes from the framebuffer, or mark the compiled lines to update
+	 * @param	byteRow		the strip of rows written
+	 * @param	left		the leftmost column written
+	 * @param	right		the rightmost column written
+	 */
+	void changed(uint16_t byteRow, uint16_t left, uint16_t right) {
+		uint16_t bottom = byteRow * (8 / bits);
+		uint16_t top = bottom + 8 / bits;
+		if (top > rows) {
+			top = rows;
+		}
+
+		if (USE_MASKS) {
+			if (PWMMatrixMode::ROWS == _MODE) {
+				for (uint16_t row = bottom; row < top; row++) {
+					lineChanged(row);
+				}
+			} else {
+				for (uint16_t col = left; col <= right; col++) {
+					lineChanged(col);
+				}
+			}
+			return;
+		}
+
+		if (!USE_PLANES) {
+			return;
+		}
+
+		for (uint16_t row = bottom; row < top; row++) {
+			for (uint16_t col = left; col <= right; col++) {
+				uint8_t value = storedValue(col, row);
+
+				// The line is the row or column being scanned, position is the pixel along it
+				uint16_t line = (PWMMatrixMode::ROWS == _MODE) ? row : col;
+				uint16_t position = (PWMMatrixMode::ROWS == _MODE) ? col : row;
+				uint8_t mask = 1 << (position & 7);
+
+				for (uint8_t bit = 0; bit < bits; bit++, value >>= 1) {
+					uint8_t *plane = &_planes[line][bit][position / 8];
+					if (value & 1) {
+						*plane |= mask;
+					} else {
+						*plane &= ~mask;
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Check a pixel in a bit plane
+	 * @param	line		the row or column being scanned
+	 * @param	bit			the framebuffer bit
+	 * @param	position	the pixel along the line
+	 * @return true if the pixel is on for this bit
+	 */
+	INLINE bool planePixel(uint16_t line, uint8_t bit, uint16_t position) {
+		return _planes[line][bit][position / 8] & (1 << (position & 7));
+	}
+
+	/**
+	 * Move on to the next BAM bit, setting the length of the next tick
+	 * @return true if the line has finished
+	 */
+	INLINE bool nextBit() {
+		bool lineDone = false;
+
+		if (++_currentLevel >= bits) {
+			_currentLevel = 0;
+			lineDone = true;
+		}
+
+		// Bit n is shown for 2^n ticks, scaled up so the most significant bit has the same weight whatever the depth
+		uint8_t shift = _currentLevel + 8 - bits;
+		if (NULL != _timer) {
+			_timer->setTop(((uint32_t)_baseTop << shift) - 1);
+		} else {
+			_holdTicks = (1 << shift) - 1;
+		}
+
+		return lineDone;
+	}
+
+	/**
+	 * Turn on a row or column being scanned
+	 * @param	line	the row or column
+	 */
+	INLINE void lineOn(uint16_t line) {
+		if (PWMMatrixMode::ROWS == _MODE) {
+			_driver.rowOn(line);
+		} else {
+			_driver.colOn(line);
+		}
+	}
+
+	/**
+	 * Turn off a row or column being scanned
+	 * @param	line	the row or column
+	 */
+	INLINE void lineOff(uint16_t line) {
+		if (PWMMatrixMode::ROWS == _MODE) {
+			_driver.rowOff(line);
+		} else {
+			_driver.colOff(line);
+		}
+	}
+
+	/**
+	 * Render the display a row or column at a time from the compiled lines
+	 */
+	inline void tickLine(void) {
+		uint16_t &line = (PWMMatrixMode::ROWS == _MODE) ? _currentRow : _currentCol;
+
+		if (0 == _currentLevel) {
+			// Turn on the current line
+			_driver.writeMasks(_masks[line][0]);
+			lineOn(line);
+			_nextSet = 1;
+		} else {
+			// Turn off pixels that get switched off on this pass
+			while (_nextSet < MASK_SETS && _levels[line][_nextSet] <= _currentLevel) {
+				_driver.writeMasks(_masks[line][_nextSet++]);
+			}
+		}
+
+		if (255 == ++_currentLevel) {
+			// Turn off the current line & advance
+			lineOff(line);
+
+			_currentLevel = 0;
+			if (++line == LINES) {
+				line = 0;
+			}
+		}
+	}
+
 	/**
 	 * Render the display row by row
 	 */
@@ -81,14 +391,14 @@ private:
 			// Turn on the current row
 			_driver.rowOn(_currentRow);
 			for (i = 0; i < cols; i++) {
-				if (pixel(i, _currentRow) > 0) {
+				if (Buffer::pixelValue(i, _currentRow) > 0) {
 					_driver.colOn(i);
 				}
 			}
 		} else {
 			// Turn off pixels that get switched off on this pass
 			for (i = 0; i < cols; i++) {
-				if (pixel(i, _currentRow) <= _currentLevel) {
+				if (Buffer::pixelValue(i, _currentRow) <= _currentLevel) {
 					_driver.colOff(i);
 				}
 			}
@@ -115,14 +425,14 @@ private:
 			// Turn on the current column
 			_driver.colOn(_currentCol);
 			for (i = 0; i < rows; i++) {
-				if (pixel(_currentCol, i) > 0) {
+				if (Buffer::pixelValue(_currentCol, i) > 0) {
 					_driver.rowOn(i);
 				}
 			}
 		} else {
 			// Turn off pixels that get switched off on this pass
 			for (i = 0; i < rows; i++) {
-				if (pixel(_currentCol, i) <= _currentLevel) {
+				if (Buffer::pixelValue(_currentCol, i) <= _currentLevel) {
 					_driver.rowOff(i);
 				}
 			}
@@ -147,7 +457,7 @@ private:
 			// Turn on the pixel at the current row & column
 			_driver.colOn(_currentCol);
 			_driver.rowOn(_currentRow);
-		} else if (pixel(_currentRow, _currentCol) <= _currentLevel) {
+		} else if (Buffer::pixelValue(_currentCol, _currentRow) <= _currentLevel) {
 			// Turn off the pixel
 			_driver.colOff(_currentCol);
 			_driver.rowOff(_currentRow);
@@ -166,6 +476,93 @@ private:
 		}
 	}
 
+	/**
+	 * Render the display row by row with bit angle modulation
+	 */
+	inline void tickRowBAM(void) {
+		uint16_t		i;
+
+		if (nextBit()) {
+			// Turn off the current row & advance
+			_driver.rowOff(_currentRow);
+			if (++_currentRow == rows) {
+				_currentRow = 0;
+			}
+		}
+
+		if (USE_MASKS) {
+			_driver.writeMasks(_masks[_currentRow][_currentLevel]);
+		} else {
+			for (i = 0; i < cols; i++) {
+				if (planePixel(_currentRow, _currentLevel, i)) {
+					_driver.colOn(i);
+				} else {
+					_driver.colOff(i);
+				}
+			}
+		}
+
+		if (0 == _currentLevel) {
+			_driver.rowOn(_currentRow);
+		}
+	}
+
+	/**
+	 * Render the display column by column with bit angle modulation
+	 */
+	inline void tickColBAM(void) {
+		uint16_t		i;
+
+		if (nextBit()) {
+			// Turn off the current column & advance
+			_driver.colOff(_currentCol);
+			if (++_currentCol == cols) {
+				_currentCol = 0;
+			}
+		}
+
+		if (USE_MASKS) {
+			_driver.writeMasks(_masks[_currentCol][_currentLevel]);
+		} else {
+			for (i = 0; i < rows; i++) {
+				if (planePixel(_currentCol, _currentLevel, i)) {
+					_driver.rowOn(i);
+				} else {
+					_driver.rowOff(i);
+				}
+			}
+		}
+
+		if (0 == _currentLevel) {
+			_driver.colOn(_currentCol);
+		}
+	}
+
+	/**
+	 * Render the display pixel by pixel with bit angle modulation
+	 */
+	inline void tickPixelBAM(void) {
+		if (nextBit()) {
+			// Turn off the current pixel & advance
+			_driver.colOff(_currentCol);
+			_driver.rowOff(_currentRow);
+			if (++_currentCol == cols) {
+				_currentCol = 0;
+				if (++_currentRow == rows) {
+					_currentRow = 0;
+				}
+			}
+		}
+
+		if (storedValue(_currentCol, _currentRow) & (1 << _currentLevel)) {
+			_driver.colOn(_currentCol);
+			_driver.rowOn(_currentRow);
+		} else {
+			_driver.colOff(_currentCol);
+			_driver.rowOff(_currentRow);
+		}
+	}
+
 public:
 	/**
 	 * Establish a new matrix
@@ -175,8 +572,27 @@ public:
 				_currentRow(0),
 				_currentCol(0),
 				_currentLevel(0),
-				_driver(driver) {
-		uint8_t	i;
+				_driver(driver),
+				_nextSet(0),
+				_timer(NULL),
+				_baseTop(0),
+				_holdTicks(0) {
+		uint16_t	i;
+
+		memset(_planes, 0, sizeof(_planes));
+		memset(_dirtyLines, 0, sizeof(_dirtyLines));
+		if (USE_MASKS) {
+			for (i = 0; i < LINES; i++) {
+				compileLine(i);
+			}
+		}
+
+		if (PWMMatrixModulation::BAM == modulation) {
+			// Start on the last bit of the last line, so the first tick starts the first line
+			_currentLevel = bits - 1;
+			_currentRow = (PWMMatrixMode::COLS == _MODE) ? 0 : rows - 1;
+			_currentCol = (PWMMatrixMode::ROWS == _MODE) ? 0 : cols - 1;
+		}
 
 		for (i = 0; i < rows; i++) {
 			_driver.rowOff(i);
@@ -186,9 +602,76 @@ public:
 		}
 	}
 
+	/**
+	 * Compile the lines changed since the last flush, so the matrix shows them
+	 * Only needed with maskBytes, otherwise the matrix shows the framebuffer as it is drawn
+	 */
+	void flush() {
+		if (!USE_MASKS) {
+			return;
+		}
+
+		for (uint16_t line = 0; line < LINES; line++) {
+			if (_dirtyLines[line / 8] & (1 << (line & 7))) {
+				_dirtyLines[line / 8] &= ~(1 << (line & 7));
+				compileLine(line);
+			}
+		}
+	}
+
+	/**
+	 * Let BAM stretch the period of the timer driving the matrix
+	 * The timer should be a REPETITIVE timer, already set to the period for the least significant bit.
+	 * The most significant bit is 2^(bits - 1) times as long, and must fit in the timer, so a 16 bit
+	 * timer is usually needed for an 8 bit framebuffer. The matrix should be the timer's listener, so
+	 * the period is changed as soon as the tick happens.
+	 * @param	timer	the timer
+	 * @return false on success, true if the longest tick would not fit in the timer (the timer is not used)
+	 */
+	bool setBAMTimer(Timer &timer) {
+		static_assert(PWMMatrixModulation::BAM == modulation, "The timer is only used for BAM");
+
+		// The most significant bit is always shifted by 7, see nextBit
+		uint32_t baseTop = (uint32_t)timer.getTop() + 1;
+		if ((baseTop << 7) > (uint32_t)timer.getMaximumTop() + 1) {
+			return true;
+		}
+
+		_baseTop = baseTop;
+		_timer = &timer;
+		return false;
+	}
+
 	/* Process a timer tick
 	 */
 	void alarm(UNUSED AlarmSource source) {
+		if (PWMMatrixModulation::BAM == modulation) {
+			if (_holdTicks) {
+				_holdTicks--;
+				return;
+			}
+
+			switch (_MODE) {
+			case PWMMatrixMode::ROWS:
+				tickRowBAM();
+				break;
+			case PWMMatrixMode::COLS:
+				tickColBAM();
+				break;
+			case PWMMatrixMode::INDIVIDUAL:
+				tickPixelBAM();
+				break;
+			default:
+				break;
+			}
+			return;
+		}
+
+		if (USE_MASKS) {
+			tickLine();
+			return;
+		}
+
 		switch (_MODE) {
 		case PWMMatrixMode::ROWS:
 			tickRow();
@@ -136,6 +136,87 @@ enum class RGBChannel : uint8_t {
 };
 #endif
 
+#if defined(__AVR_HAVE_MUL__) && !defined(FLAME_RGB_NO_ASM)
+#define FLAME_RGB_ASM 1
+#endif
+
+/**
+ * Scale an 8 bit value by scale/256, (value * (scale + 1)) >> 8
+ * A scale of 255 leaves the value untouched, a scale of 0 gives 0
+ * @param	value	the value to scale
+ * @param	scale	the scale
+ * @return the scaled value
+ */
+INLINE uint8_t scale8(uint8_t value, uint8_t scale) {
+#ifdef FLAME_RGB_ASM
+	asm(
+			"		mul %0, %1				\n\t"	// r1:r0 = value * scale
+			"		add r0, %0				\n\t"	// + value
+			"		ldi %0, 0				\n\t"
+			"		adc %0, r1				\n\t"	// take the high byte
+			"		clr __zero_reg__		\n\t"
+			: "+d" (value)
+			: "r" (scale)
+			: "r0"
+	);
+	return value;
+#else
+	return ((uint16_t)value * scale + value) >> 8;
+#endif
+}
+
+/**
+ * Blend between 2 8 bit values
+ * The result is rounded to the nearest value, but always moves at least 1 towards 'to' if amount is not 0,
+ * so repeated blends reach 'to'
+ * @param	from	the value to blend from
+ * @param	to		the value to blend towards
+ * @param	amount	the amount of 'to' in the result, 0 gives 'from', 255 gives 'to'
+ * @return the blended value
+ */
+INLINE uint8_t blend8(uint8_t from, uint8_t to, uint8_t amount) {
+	// Scale amount to 0 - 256 so 255 gives exactly 'to'
+	uint16_t weight = amount + (amount >> 7);
+	uint16_t blended = (uint16_t)from * (256 - weight);
+	blended += (uint16_t)to * weight;
+	blended += 128;
+
+	uint8_t result = blended >> 8;
+	if (result == from && amount) {
+		if (from < to) {
+			result++;
+		} else if (from > to) {
+			result--;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Add 2 8 bit values, saturating at 255
+ * @param	a	the first value
+ * @param	b	the second value
+ * @return the sum, or 255 if it overflowed
+ */
+INLINE uint8_t qadd8(uint8_t a, uint8_t b) {
+#ifdef FLAME_RGB_ASM
+	asm(
+			"		add %0, %1				\n\t"
+			"		brcc 1f					\n\t"
+			"		ldi %0, 0xff			\n\t"
+			"1:								\n\t"
+			: "+d" (a)
+			: "r" (b)
+	);
+	return a;
+#else
+	uint16_t sum = a + b;
+
+	return (sum > 255) ? 255 : sum;
+#endif
+}
+
 class RGB {
 protected:
 	union rgb	_data;
@@ -245,14 +326,16 @@ public:
 
 	/**
 	 * Set a value and gamma correct
+	 * @tparam Gamma	the gamma curve to use
 	 * @param red	the red value
 	 * @param green	the green value
 	 * @param blue	the blue value
 	 */
+	template <class Gamma = DefaultGamma>
 	void setGamma (uint8_t red, uint8_t green, uint8_t blue) {
-		_data.channel.red = precalculatedGammaCorrect(red);
-		_data.channel.green = precalculatedGammaCorrect(green);
-		_data.channel.blue = precalculatedGammaCorrect(blue);
+		_data.channel.red = Gamma::correct(red);
+		_data.channel.green = Gamma::correct(green);
+		_data.channel.blue = Gamma::correct(blue);
 	}
 
 	/**
@@ -269,19 +352,56 @@ public:
 	 * Get the value for a channel
 	 * @param channel	the channel to get
 	 */
-	uint8_t get (RGBChannel channel) {
+	uint8_t get (RGBChannel channel) const {
 		return _data.value[(uint8_t)channel];
 	}
 
 
+	/**
+	 * Set a value from hue, saturation & value
+	 * @param hue			the hue, 0-255 covers the full colour wheel, starting and ending at red
+	 * @param saturation	the saturation
+	 * @param value			the brightness
+	 */
+	void setHSV (uint8_t hue, uint8_t saturation, uint8_t value) {
+		uint16_t sector = hue * 6;
+		uint8_t fraction = sector;
+		uint8_t p = scale8(value, 255 - saturation);
+		uint8_t q = scale8(value, 255 - scale8(saturation, fraction));
+		uint8_t t = scale8(value, 255 - scale8(saturation, 255 - fraction));
+
+		switch (sector >> 8) {
+		case 0:
+			set(value, t, p);
+			break;
+		case 1:
+			set(q, value, p);
+			break;
+		case 2:
+			set(p, value, t);
+			break;
+		case 3:
+			set(p, q, value);
+			break;
+		case 4:
+			set(t, p, value);
+			break;
+		default:
+			set(value, p, q);
+			break;
+		}
+	}
+
 	/**
 	 * Set a value and gamma correct
+	 * @tparam Gamma	the gamma curve to use
 	 * @param value		the new value
 	 */
+	template <class Gamma = DefaultGamma>
 	void setGamma (const RGB &value) {
-		_data.channel.red = precalculatedGammaCorrect(value._data.channel.red);
-		_data.channel.green = precalculatedGammaCorrect(value._data.channel.green);
-		_data.channel.blue = precalculatedGammaCorrect(value._data.channel.blue);
+		_data.channel.red = Gamma::correct(value._data.channel.red);
+		_data.channel.green = Gamma::correct(value._data.channel.green);
+		_data.channel.blue = Gamma::correct(value._data.channel.blue);
 	}
 
 	/**
@@ -305,31 +425,37 @@ public:
 
 	/**
 	 * Set a value and gamma correct
+	 * @tparam Gamma	the gamma curve to use
 	 * @param value		the new value
 	 */
+	template <class Gamma = DefaultGamma>
 	void setGamma (const RGB *value) {
-		_data.channel.red = precalculatedGammaCorrect(value->_data.channel.red);
-		_data.channel.green = precalculatedGammaCorrect(value->_data.channel.green);
-		_data.channel.blue = precalculatedGammaCorrect(value->_data.channel.blue);
+		_data.channel.red = Gamma::correct(value->_data.channel.red);
+		_data.channel.green = Gamma::correct(value->_data.channel.green);
+		_data.channel.blue = Gamma::correct(value->_data.channel.blue);
 	}
 
 	/**
 	 * Gamma correct the current value
+	 * @tparam Gamma	the gamma curve to use
 	 */
+	template <class Gamma = DefaultGamma>
 	void gammaCorrect() {
-		_data.channel.red = precalculatedGammaCorrect(_data.channel.red);
-		_data.channel.green = precalculatedGammaCorrect(_data.channel.green);
-		_data.channel.blue = precalculatedGammaCorrect(_data.channel.blue);
+		_data.channel.red = Gamma::correct(_data.channel.red);
+		_data.channel.green = Gamma::correct(_data.channel.green);
+		_data.channel.blue = Gamma::correct(_data.channel.blue);
 
 	}
 
 	/**
 	 * Inverse gamma correct the current value
+	 * @tparam Gamma	the gamma curve to use
 	 */
+	template <class Gamma = DefaultGamma>
 	void inverseGammaCorrect() {
-		_data.channel.red = precalculatedInverseGammaCorrect(_data.channel.red);
-		_data.channel.green = precalculatedInverseGammaCorrect(_data.channel.green);
-		_data.channel.blue = precalculatedInverseGammaCorrect(_data.channel.blue);
+		_data.channel.red = Gamma::inverseCorrect(_data.channel.red);
+		_data.channel.green = Gamma::inverseCorrect(_data.channel.green);
+		_data.channel.blue = Gamma::inverseCorrect(_data.channel.blue);
 	}
 };
 
@@ -33,24 +33,147 @@
 
 namespace flame {
 
+/**
+ * Error accumulators for temporal dithering, 4 bits per channel, packed 2 to a byte
+ * @tparam	length		the number of LEDs in the string
+ * @tparam	dither		true if the strip is dithered
+ * @tparam	gamma		the gamma exponent of the strip, in hundredths
+ */
+template <uint16_t length, bool dither, uint16_t gamma>
+class RGBLEDStripDitherState {
+protected:
+	uint8_t		_error[(length * 3 + 1) / 2];
+
+	RGBLEDStripDitherState() {
+		memset(_error, 0, sizeof(_error));
+	}
+
+	/**
+	 * Get the gamma corrected, dithered value to send for a byte of the buffer
+	 * Must be called once per byte per frame
+	 * @param	byte	the uncorrected byte from the buffer
+	 * @param	index	the offset of the byte within the buffer
+	 * @return the value to send
+	 */
+	INLINE uint8_t ditherByte(uint8_t byte, uint16_t index) {
+		uint16_t corrected = GammaTable<gamma, 8, 12>::correct(byte);
+		uint8_t value = corrected >> 4;
+		uint8_t *error = _error + (index >> 1);
+		uint8_t accumulated;
+
+		if (index & 1) {
+			accumulated = (*error >> 4) + (corrected & 0x0f);
+			*error = (*error & 0x0f) | (accumulated << 4);
+		} else {
+			accumulated = (*error & 0x0f) + (corrected & 0x0f);
+			*error = (*error & 0xf0) | (accumulated & 0x0f);
+		}
+
+		if ((accumulated & 0x10) && value != 255) {
+			value++;
+		}
+
+		return value;
+	}
+
+	/**
+	 * Get the accumulators for a byte of the buffer, for output loops that dither in assembler
+	 * @param	index	the offset of the byte within the buffer
+	 * @return the accumulator byte, in the low nibble for even offsets and the high nibble for odd
+	 */
+	INLINE uint8_t *ditherError(uint16_t index) {
+		return _error + (index >> 1);
+	}
+
+	/**
+	 * Get the 12 bit gamma table that ditherByte uses, for output loops that dither in assembler
+	 * @return the table in program memory
+	 */
+	INLINE const uint16_t *ditherTable() {
+		return GammaTable<gamma, 8, 12>::table();
+	}
+};
+
+/**
+ * Undithered strips carry no state (and take no space as a base class)
+ */
+template <uint16_t length, uint16_t gamma>
+class RGBLEDStripDitherState<length, false, gamma> {
+protected:
+	/**
+	 * Undithered strips send the buffer as is
+	 * @param	byte	the byte from the buffer
+	 * @return the byte
+	 */
+	INLINE uint8_t ditherByte(uint8_t byte, UNUSED uint16_t index) {
+		return byte;
+	}
+
+	/**
+	 * Undithered strips have no accumulators
+	 * @return NULL
+	 */
+	INLINE uint8_t *ditherError(UNUSED uint16_t index) {
+		return NULL;
+	}
+
+	/**
+	 * Undithered strips have no gamma table
+	 * @return NULL
+	 */
+	INLINE const uint16_t *ditherTable() {
+		return NULL;
+	}
+};
+
 /**
  * Create a new RGBLEDSTRIP object to control a string of LED drivers
- * @tparam	clock...	the clock pin for the LEDs
- * @tparam	data...		the data pin for the LEDs, mult be on the same port as the clock
+ *
+ * When dithering, the buffer holds uncorrected values. The output drivers gamma correct each
+ * byte to 12 bits as it is sent, and carry the bottom 4 bits over to the following frames in a
+ * per channel accumulator, giving 12 bits of effective depth at low brightness. This costs
+ * half a byte of RAM per channel, and a table lookup and a few adds per byte sent.
+ *
  * @tparam	length		the number of LEDs in the string
+ * @tparam	dither		true to gamma correct and temporally dither on output
+ * @tparam	gamma		the gamma exponent to correct with, in hundredths, chosen for the LEDs
  */
-template <uint16_t length>
-class RGBLEDStrip {
+template <uint16_t length, bool dither = false, uint16_t gamma = FLAME_GAMMA_DEFAULT>
+class RGBLEDStrip : public RGBLEDStripDitherState<length, dither, gamma> {
 protected:
-	RGB		_data[length];
+	typedef GammaTable<gamma>	Gamma;
+
+	RGB			_data[length];
+	uint16_t	_start;		// the offset in _data of the first logical pixel
+
+	/**
+	 * Map a logical pixel onto its location in the buffer
+	 * @param	pixel	the logical pixel
+	 * @return the offset of the pixel in _data
+	 */
+	INLINE uint16_t offset(uint16_t pixel) {
+		uint16_t index = pixel + _start;
+
+		if (index >= length) {
+			index -= length;
+		}
+
+		return index;
+	}
 
 public:
+	/**
+	 * Create a new strip
+	 */
+	RGBLEDStrip() :
+		_start(0) {}
+
 	/**
 	 * Get a pixel
 	 * @param	pixel	the pikel to get
 	 */
 	RGB &getPixel(uint16_t pixel) {
-		return _data[pixel];
+		return _data[offset(pixel)];
 	}
 
 	/**
@@ -61,7 +184,7 @@ public:
 	 * @param	green	the green value
 	 */
 	void setPixel(uint16_t pixel, uint8_t red, uint8_t green, uint8_t blue) {
-		RGB *chip = _data + pixel;
+		RGB *chip = _data + offset(pixel);
 
 		chip->set(red, green, blue);
 	}
@@ -72,7 +195,7 @@ public:
 	 * @param	value	the value to set
 	 */
 	void setPixel(uint16_t pixel, const RGB *value) {
-		memcpy(_data + pixel, value, FLAME_BYTESIZEOF(*value));
+		memcpy(_data + offset(pixel), value, FLAME_BYTESIZEOF(*value));
 	}
 
 	/**
@@ -81,7 +204,7 @@ public:
 	 * @param	value	the value to set
 	 */
 	void setPixel(uint16_t pixel, const RGB &value) {
-		memcpy(_data + pixel, &value, FLAME_BYTESIZEOF(value));
+		memcpy(_data + offset(pixel), &value, FLAME_BYTESIZEOF(value));
 	}
 
 	/**
@@ -113,9 +236,9 @@ public:
 	 * @param	blue	the blue value
 	 */
 	void setPixelGamma(uint16_t pixel, uint8_t red, uint8_t green, uint8_t blue) {
-		RGB *chip = _data + pixel;
+		RGB *chip = _data + offset(pixel);
 
-		chip->setGamma(red, green, blue);
+		chip->template setGamma<Gamma>(red, green, blue);
 	}
 
 	/**
@@ -124,9 +247,9 @@ public:
 	 * @param	value	the value to set
 	 */
 	void setPixelGamma(uint16_t pixel, const RGB *value) {
-		RGB *chip = _data + pixel;
+		RGB *chip = _data + offset(pixel);
 
-		chip->setGamma(value);
+		chip->template setGamma<Gamma>(value);
 	}
 
 	/**
@@ -135,9 +258,9 @@ public:
 	 * @param	value	the value to set
 	 */
 	void setPixelGamma(uint16_t pixel, const RGB &value) {
-		RGB *chip = _data + pixel;
+		RGB *chip = _data + offset(pixel);
 
-		chip->setGamma(value);
+		chip->template setGamma<Gamma>(value);
 	}
 
 	/**
@@ -148,7 +271,7 @@ public:
 	 */
 	void setAllGamma(uint8_t red, uint8_t green, uint8_t blue) {
 		RGB newValue;
-		newValue.setGamma(red, green, blue);
+		newValue.template setGamma<Gamma>(red, green, blue);
 
 		for (uint16_t i = 0; i < length; i++) {
 			memcpy(_data + i, &newValue, FLAME_BYTESIZEOF(newValue));
@@ -161,13 +284,176 @@ public:
 	 */
 	void setAllGamma(const RGB &value) {
 		RGB newValue;
-		newValue.setGamma(value);
+		newValue.template setGamma<Gamma>(value);
 
 		for (uint16_t i = 0; i < length; i++) {
 			memcpy(_data + i, &newValue, FLAME_BYTESIZEOF(newValue));
 		}
 	}
 
+	/**
+	 * Scale the brightness of the whole strip
+	 * @param	scale	the scale to apply, 255 leaves the strip untouched, 0 turns it off
+	 */
+	void scaleAll(uint8_t scale) {
+		uint8_t *data = (uint8_t *)_data;
+
+		for (uint16_t i = 0; i < length * 3; i++) {
+			*data = scale8(*data, scale);
+			data++;
+		}
+	}
+
+	/**
+	 * Blend the whole strip towards a colour
+	 * Calling this repeatedly gives an exponential fade which reaches the target
+	 * @param	target	the colour to blend towards
+	 * @param	amount	the amount of the target to blend in, 0 does nothing, 255 sets the target
+	 */
+	void blendToward(const RGB &target, uint8_t amount) {
+		uint8_t first = target.get((RGBChannel)0);
+		uint8_t second = target.get((RGBChannel)1);
+		uint8_t third = target.get((RGBChannel)2);
+		uint8_t *data = (uint8_t *)_data;
+
+		for (uint16_t i = 0; i < length; i++) {
+			*data = blend8(*data, first, amount);
+			data++;
+			*data = blend8(*data, second, amount);
+			data++;
+			*data = blend8(*data, third, amount);
+			data++;
+		}
+	}
+
+	/**
+	 * Fill a range of pixels with a linear gradient
+	 * @param	first	the first pixel to fill
+	 * @param	last	the last pixel to fill (must not be less than first)
+	 * @param	from	the colour of the first pixel
+	 * @param	to		the colour of the last pixel
+	 */
+	void fillGradient(uint16_t first, uint16_t last, const RGB &from, const RGB &to) {
+		uint16_t count = last - first;
+		uint16_t value[3];
+		uint16_t step[3];
+
+		// 8.8 fixed point, the step wraps modulo 2^16 so negative deltas come out right
+		for (uint8_t channel = 0; channel < 3; channel++) {
+			uint8_t start = from.get((RGBChannel)channel);
+			int16_t delta = to.get((RGBChannel)channel) - start;
+
+			value[channel] = (start << 8) + 0x80;
+			step[channel] = count ? (uint16_t)((int32_t)delta * 256 / count) : 0;
+		}
+
+		RGB *pixel = _data + offset(first);
+		for (uint16_t i = 0; i <= count; i++) {
+			for (uint8_t channel = 0; channel < 3; channel++) {
+				pixel->set((RGBChannel)channel, value[channel] >> 8);
+				value[channel] += step[channel];
+			}
+
+			if (++pixel == _data + length) {
+				pixel = _data;
+			}
+		}
+	}
+
+	/**
+	 * Fill the strip with a linear gradient
+	 * @param	from	the colour of the first pixel
+	 * @param	to		the colour of the last pixel
+	 */
+	void fillGradient(const RGB &from, const RGB &to) {
+		fillGradient(0, length - 1, from, to);
+	}
+
+	/**
+	 * Fill a range of pixels with a gradient in HSV space
+	 * The hue always moves upwards from fromHue, wrapping through red, to toHue
+	 * @param	first			the first pixel to fill
+	 * @param	last			the last pixel to fill (must not be less than first)
+	 * @param	fromHue			the hue of the first pixel
+	 * @param	fromSaturation	the saturation of the first pixel
+	 * @param	fromValue		the brightness of the first pixel
+	 * @param	toHue			the hue of the last pixel
+	 * @param	toSaturation	the saturation of the last pixel
+	 * @param	toValue			the brightness of the last pixel
+	 */
+	void fillGradientHSV(uint16_t first, uint16_t last,
+			uint8_t fromHue, uint8_t fromSaturation, uint8_t fromValue,
+			uint8_t toHue, uint8_t toSaturation, uint8_t toValue) {
+		uint16_t count = last - first;
+		uint16_t hue = (fromHue << 8) + 0x80;
+		uint16_t saturation = (fromSaturation << 8) + 0x80;
+		uint16_t value = (fromValue << 8) + 0x80;
+		uint16_t hueStep = 0;
+		uint16_t saturationStep = 0;
+		uint16_t valueStep = 0;
+
+		if (count) {
+			hueStep = ((uint32_t)(uint8_t)(toHue - fromHue) << 8) / count;
+			saturationStep = (int32_t)(toSaturation - fromSaturation) * 256 / count;
+			valueStep = (int32_t)(toValue - fromValue) * 256 / count;
+		}
+
+		RGB *pixel = _data + offset(first);
+		for (uint16_t i = 0; i <= count; i++) {
+			pixel->setHSV(hue >> 8, saturation >> 8, value >> 8);
+			hue += hueStep;
+			saturation += saturationStep;
+			value += valueStep;
+
+			if (++pixel == _data + length) {
+				pixel = _data;
+			}
+		}
+	}
+
+	/**
+	 * Fill the strip with a gradient in HSV space
+	 * The hue always moves upwards from fromHue, wrapping through red, to toHue
+	 * @param	fromHue			the hue of the first pixel
+	 * @param	fromSaturation	the saturation of the first pixel
+	 * @param	fromValue		the brightness of the first pixel
+	 * @param	toHue			the hue of the last pixel
+	 * @param	toSaturation	the saturation of the last pixel
+	 * @param	toValue			the brightness of the last pixel
+	 */
+	void fillGradientHSV(uint8_t fromHue, uint8_t fromSaturation, uint8_t fromValue,
+			uint8_t toHue, uint8_t toSaturation, uint8_t toValue) {
+		fillGradientHSV(0, length - 1, fromHue, fromSaturation, fromValue,
+				toHue, toSaturation, toValue);
+	}
+
+	/**
+	 * Add another strip to this one, saturating each channel at 255
+	 * @param	other	the strip to add
+	 */
+	void add(const RGBLEDStrip<length, dither, gamma> &other) {
+		uint8_t *data = (uint8_t *)(_data + _start);
+		uint8_t *dataEnd = (uint8_t *)(_data + length);
+		const uint8_t *source = (const uint8_t *)(other._data + other._start);
+		const uint8_t *sourceEnd = (const uint8_t *)(other._data + length);
+
+		for (uint16_t i = 0; i < length; i++) {
+			*data = qadd8(*data, *source++);
+			data++;
+			*data = qadd8(*data, *source++);
+			data++;
+			*data = qadd8(*data, *source++);
+			data++;
+
+			if (data == dataEnd) {
+				data = (uint8_t *)_data;
+			}
+			if (source == sourceEnd) {
+				source = (const uint8_t *)other._data;
+			}
+		}
+	}
+
 	/**
 	 * Write the current buffer to the string of LEDs
 	 */
@@ -175,19 +461,14 @@ public:
 
 	/**
 	 * Rotate the string by 1 pixel
+	 * The pixel data is not moved, only the logical start of the strip, so this is O(1)
 	 * @param	forwards	true for forwards, false for backwards
 	 */
 	void rotate(bool forwards) {
-		RGB temp;
-
 		if (forwards) {
-			memcpy(&temp, _data + length - 1, FLAME_BYTESIZEOF(temp));
-			memmove(_data + 1, _data, FLAME_BYTESIZEOF(*_data) * (length - 1));
-			memcpy(_data, &temp, FLAME_BYTESIZEOF(temp));
+			_start = (0 == _start) ? length - 1 : _start - 1;
 		} else {
-			memcpy(&temp, _data, FLAME_BYTESIZEOF(temp));
-			memcpy(_data, _data + 1,  FLAME_BYTESIZEOF(*_data) * (length - 1));
-			memcpy(_data, &temp, FLAME_BYTESIZEOF(temp));
+			_start = (length - 1 == _start) ? 0 : _start + 1;
 		}
 	}
 };
@@ -26,11 +26,17 @@
  */
 
 /*
- *      Fixme:  need to measure how many clocks it takes to get to the point in the handler to toggle the pin,
- *      then subtract that from the trigger time
- *      Fixme: We lose accuracy if multiple servos are positioned on the same clock
- *      	one possible solution is to cluster the servos into groups such that there are no closely positioned
- *      		servos in any group, then stagger the triggering of the groups
+ *      The pulses are timed from compare matches of a 16 bit timer running in CTC mode without a prescaler.
+ *      All pulses start in the interrupt for the frame start and end in the interrupt for their compare match,
+ *      so the interrupt latency cancels out.
+ *      Servos ending within FLAME_SERVO_ISR_CYCLES of each other are switched off together, with one write
+ *      per port, at the earliest of their times, as the interrupt for the first could not set the timer in time
+ *      for the next.
+ *      If other interrupts delay a compare match until the counter is already past the next top, that group is
+ *      ended late in the same interrupt instead of waiting for the counter to wrap.
+ *      Servos being moved or eased are advanced after the last pulse of a frame, and their schedule rebuilt, with
+ *      interrupts enabled again. That costs O(servoCount) for the advance and O(servoCount²) for the build, which
+ *      only delays the foreground, so keep the gap to the next frame longer than the build for large servo counts.
  *
  */
 
@@ -38,6 +44,7 @@
 #define FLAME_SERVOCONTROL_H_
 
 #include <flame/Timer.h>
+#include <util/atomic.h>
 
 #ifdef FLAME_TIMER16_1
 
@@ -45,71 +52,383 @@
 #define FLAME_SERVO_MIN	(F_CPU / (1000L))
 // 2ms in timer ticks
 #define FLAME_SERVO_MAX	((F_CPU * 2) / (1000L))
+// 20ms in timer ticks
+#define FLAME_SERVO_FRAME	(F_CPU / (50L))
+
+// The CPU cycles from a compare match to the interrupt setting the next top, servos ending closer are grouped
+#ifndef FLAME_SERVO_ISR_CYCLES
+#define FLAME_SERVO_ISR_CYCLES	256
+#endif
 
 #define FLAME_MAX_SERVO_COUNT	254
 
 namespace flame {
 
 
-/* The servoOrder member is not really part of the control block, but instead is an easy way
- * to have an array of N things we can use to specify the order the servos should be serviced
+/**
+ * How a servo moves between positions with easeServo
+ *   LINEAR: constant speed
+ *   IN: accelerate from rest
+ *   OUT: decelerate to rest
+ *   IN_OUT: accelerate for the first half, then decelerate
  */
+enum class ServoEasing : uint8_t {
+	LINEAR,
+	IN,
+	OUT,
+	IN_OUT
+};
+
 struct ServoControlBlock {
 	FLAME_register		port;
 	uint8_t				pin;
 	uint16_t			position;
 	int16_t				clockMinOffset;
 	int16_t				clockMaxOffset;
-	uint8_t				servoOrder; // This isn't really a member of the control structure
+	uint16_t			target;			// the position being moved to
+	uint16_t			origin;			// the position an ease started from
+	uint16_t			rate;			// maximum ticks to move per frame, 0 for no limit
+	uint16_t			progress;		// how far through an ease, in 1/65536ths
+	uint16_t			progressStep;	// progress per frame, 0 if not easing
+	ServoEasing			easing;
 };
 typedef struct ServoControlBlock SERVOCONTROLBLOCK;
 
 template <uint8_t servoCount>
 class ServoControl : public TimerListener {
-#define SERVO_ORDER(flameServoIndex) \
-	(_controlBlocks[flameServoIndex].servoOrder)
-
 private:
+	static const uint8_t	FRAME_START = 0xff;
+
+	/**
+	 * The switching times of a frame, sorted by ascending time
+	 */
+	struct ServoSchedule {
+		uint8_t				portCount;
+		FLAME_register		ports[servoCount];
+		uint8_t				onMasks[servoCount];	// per port, set at the frame start
+		uint8_t				groupCount;
+		uint16_t			groupTimes[servoCount];	// ticks after the frame start
+		uint8_t				groupEnds[servoCount];	// per group, one past its last write
+		uint8_t				writePorts[servoCount];	// index into ports
+		uint8_t				writeMasks[servoCount];	// bits to clear
+	};
+
 	Timer 					&_timer;
 	SERVOCONTROLBLOCK 		_controlBlocks[servoCount];
-	volatile uint8_t		_nextServoIndex;
+	ServoSchedule			_schedules[2];
+	ServoSchedule * volatile	_active;
+	volatile bool			_pending;
+	volatile bool			_building;
+	volatile bool			_stale;			// a servo was positioned during a build
+	uint8_t					_group;
+	uint16_t				_matched;
+	uint32_t				_waitTicks;
+	uint16_t				_groupTicks;	// the shortest gap between groups the interrupt can set in time
 
 	/**
-	 * Sort the servos in order of ascending time (required to minimise the processing load)
+	 * Build the schedule for the current positions
+	 * @param	schedule	the schedule to fill
 	 */
-	void sortServos() {
-		if (servoCount < 2) {
-			return;
+	void build(ServoSchedule *schedule) {
+		uint8_t order[servoCount];
+		uint8_t count = 0;
+
+		// Insertion sort of the servo indices by position
+		for (uint8_t servo = 0; servo < servoCount; servo++) {
+			if (!_controlBlocks[servo].port) {
+				continue;
+			}
+
+			uint16_t position = _controlBlocks[servo].position;
+			uint8_t i = count++;
+			for (; i > 0 && _controlBlocks[order[i - 1]].position > position; i--) {
+				order[i] = order[i - 1];
+			}
+			order[i] = servo;
+		}
+
+		schedule->portCount = 0;
+		schedule->groupCount = 0;
+		uint8_t writes = 0;
+		uint8_t groupStart = 0;
+
+		for (uint8_t i = 0; i < count; i++) {
+			SERVOCONTROLBLOCK *block = &_controlBlocks[order[i]];
+			uint8_t mask = _BV(block->pin);
+
+			uint8_t port = 0;
+			for (; port < schedule->portCount && schedule->ports[port] != block->port; port++) {
+			}
+			if (port == schedule->portCount) {
+				schedule->ports[port] = block->port;
+				schedule->onMasks[port] = 0;
+				schedule->portCount++;
+			}
+			schedule->onMasks[port] |= mask;
+
+			if (0 == schedule->groupCount ||
+					block->position - schedule->groupTimes[schedule->groupCount - 1] >= _groupTicks) {
+				schedule->groupTimes[schedule->groupCount++] = block->position;
+				groupStart = writes;
+			}
+
+			uint8_t write = groupStart;
+			for (; write < writes && schedule->writePorts[write] != port; write++) {
+			}
+			if (write == writes) {
+				schedule->writePorts[write] = port;
+				schedule->writeMasks[write] = 0;
+				writes++;
+			}
+			schedule->writeMasks[write] |= mask;
+			schedule->groupEnds[schedule->groupCount - 1] = writes;
+		}
+	}
+
+	/**
+	 * Build the back buffer until no servo was positioned during the build, then hand it to the next frame start
+	 * Must be called with _building set and interrupts enabled
+	 * @param	shadow	the schedule to fill
+	 */
+	void finishBuild(ServoSchedule *shadow) {
+		bool done = false;
+
+		while (!done) {
+			build(shadow);
+
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				done = !_stale;
+				_stale = false;
+				if (done) {
+					_building = false;
+					_pending = true;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Rebuild the schedule into the back buffer, it is swapped in at the start of the next frame
+	 */
+	void update() {
+		ServoSchedule *shadow;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (_building) {
+				// Interrupted a build, which builds again to pick up this position
+				_stale = true;
+				return;
+			}
+
+			_pending = false;
+			_building = true;
+			shadow = (_active == &_schedules[0]) ? &_schedules[1] : &_schedules[0];
+		}
+
+		finishBuild(shadow);
+	}
+
+	/**
+	 * Convert a position to timer ticks
+	 * @param	servo		the servo
+	 * @param	position	the position of the servo (0 - 65535)
+	 * @return the pulse length in timer ticks
+	 */
+	uint16_t positionTicks(uint8_t servo, uint16_t position) {
+		return ((uint32_t)position) * (FLAME_SERVO_MAX + _controlBlocks[servo].clockMaxOffset -
+				(FLAME_SERVO_MIN + _controlBlocks[servo].clockMinOffset) ) / 65535 + FLAME_SERVO_MIN + _controlBlocks[servo].clockMinOffset;
+	}
+
+	/**
+	 * Apply an easing curve
+	 * @param	easing		the curve
+	 * @param	progress	how far through the move, in 1/65536ths
+	 * @return the fraction of the distance to have moved, in 1/65536ths
+	 */
+	static uint32_t ease(ServoEasing easing, uint16_t progress) {
+		uint16_t remaining = 65535 - progress;
+
+		switch (easing) {
+		case ServoEasing::IN:
+			return ((uint32_t)progress * progress) >> 16;
+		case ServoEasing::OUT:
+			return 65535 - (((uint32_t)remaining * remaining) >> 16);
+		case ServoEasing::IN_OUT:
+			if (progress < 32768) {
+				return ((uint32_t)progress * progress) >> 15;
+			}
+			return 65535 - (((uint32_t)remaining * remaining) >> 15);
+		default:
+			return progress;
+		}
+	}
+
+	/**
+	 * Move a servo one frame towards its target
+	 * @param	block	the servo
+	 * @return true if the servo moved
+	 */
+	static bool advanceServo(SERVOCONTROLBLOCK *block) {
+		if (!block->port || block->position == block->target) {
+			return false;
+		}
+
+		if (block->progressStep) {
+			uint32_t progress = (uint32_t)block->progress + block->progressStep;
+			if (progress > 0xffff) {
+				block->position = block->target;
+			} else {
+				block->progress = progress;
+				int32_t distance = (int32_t)block->target - block->origin;
+				block->position = block->origin + ((distance * (int32_t)ease(block->easing, progress)) >> 16);
+			}
+		} else if (!block->rate) {
+			block->position = block->target;
+		} else if (block->target > block->position) {
+			block->position = (block->target - block->position > block->rate) ?
+					block->position + block->rate : block->target;
 		} else {
-			uint8_t i;
-			uint16_t curPosition;
-
-			// We'll use a bubble sort here since the general case is that the list is sorted, with only 1 servo out of position
-			for (i = 0; (i + 1) < servoCount; i++) {
-				if ((curPosition = _controlBlocks[_controlBlocks[i].servoOrder].position)
-						> _controlBlocks[_controlBlocks[i + 1].servoOrder].position) {
-					_controlBlocks[_controlBlocks[i].servoOrder].position =
-							_controlBlocks[_controlBlocks[i + 1].servoOrder].position;
-					_controlBlocks[_controlBlocks[i + 1].servoOrder].position = curPosition;
-					if (i > 1) {
-						i -= 2;
-					} else {
-						// We want i to wrap around to 0 on the next iteration
-						i = -1;
-					}
+			block->position = (block->position - block->target > block->rate) ?
+					block->position - block->rate : block->target;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Move each servo one frame towards its target
+	 * Interrupts are only disabled for each servo, so it can be called with interrupts enabled
+	 * @return true if any servo moved
+	 */
+	bool advance() {
+		bool moved = false;
+
+		for (uint8_t servo = 0; servo < servoCount; servo++) {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				if (advanceServo(&_controlBlocks[servo])) {
+					moved = true;
 				}
 			}
 		}
+
+		return moved;
+	}
+
+	/**
+	 * Move the servos for the next frame, called from the interrupt after the last pulse
+	 * The advance and build run with interrupts enabled, so they don't hold up other interrupts or the next frame
+	 */
+	void moveServos() {
+		if (_building) {
+			// The foreground is building a schedule, the servos move next frame
+			return;
+		}
+
+		bool pending = _pending;
+		_pending = false;
+		_building = true;
+		ServoSchedule *shadow = (_active == &_schedules[0]) ? &_schedules[1] : &_schedules[0];
+
+		NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE) {
+			if (advance() || _stale) {
+				finishBuild(shadow);
+				return;
+			}
+		}
+
+		_building = false;
+		_pending = pending;
+	}
+
+	/**
+	 * Wait for the next part of the gap to the frame start, the gap is longer than the timer can hold
+	 */
+	void waitForFrame() {
+		uint32_t ticks = _waitTicks;
+		if (ticks > 0x18000UL) {
+			ticks = 0x10000UL;
+		} else if (ticks > 0x10000UL) {
+			// Split evenly, so the last part is not too short to set in time
+			ticks /= 2;
+		}
+		_waitTicks -= ticks;
+		_timer.setTop(ticks - 1);
+	}
+
+	/**
+	 * Wait for the next group
+	 * @param	ticks	the ticks from the last compare match to the group
+	 * @return true if the counter was already past the top, it has been moved back to time from the group
+	 */
+	bool waitForGroup(uint16_t ticks) {
+		uint16_t top = ticks - 1;
+
+		_timer.setTop(top);
+		uint16_t current = _timer.current();
+		if (current <= top) {
+			return false;
+		}
+
+		// Keep the later groups in step with the frame, less the few ticks spent here
+		_timer.setCurrent(current - ticks);
+		return true;
+	}
+
+	/**
+	 * Start the pulses or end the pulses of the next group, then wait for the one after
+	 * @return true if the next group is already due
+	 */
+	bool nextGroup() {
+		ServoSchedule *schedule = _active;
+
+		if (FRAME_START == _group) {
+			// Start of the servo pulses, pick up any new positions
+			if (_pending) {
+				_active = schedule = (schedule == &_schedules[0]) ? &_schedules[1] : &_schedules[0];
+				_pending = false;
+			}
+
+			for (uint8_t port = 0; port < schedule->portCount; port++) {
+				_SFR_MEM8(schedule->ports[port]) |= schedule->onMasks[port];
+			}
+
+			_group = 0;
+			_matched = 0;
+		} else {
+			// End the pulses of this group
+			for (uint8_t write = (0 == _group) ? 0 : schedule->groupEnds[_group - 1];
+					write < schedule->groupEnds[_group]; write++) {
+				_SFR_MEM8(schedule->ports[schedule->writePorts[write]]) &= ~schedule->writeMasks[write];
+			}
+
+			_matched = schedule->groupTimes[_group++];
+		}
+
+		// The counter restarted at the compare match, so the next top is relative to this group's time
+		if (_group < schedule->groupCount) {
+			return waitForGroup(schedule->groupTimes[_group] - _matched);
+		}
+
+		_group = FRAME_START;
+		_waitTicks = FLAME_SERVO_FRAME - _matched;
+		waitForFrame();
+		return false;
 	}
 
 public:
 	/**
 	 * Create a new ServoControl object
-	 * @param	timer			the timer to use (should be set to FLAME_MODE_ONE_SHOT)
+	 * @param	timer			the 16 bit timer to use (should be set to TimerMode::REPETITIVE)
 	 */
 	ServoControl(Timer &timer) :
 			_timer(timer),
-			_nextServoIndex(255) {
+			_active(&_schedules[0]),
+			_pending(false),
+			_building(false),
+			_stale(false),
+			_group(FRAME_START),
+			_matched(0),
+			_waitTicks(0),
+			_groupTicks(FLAME_SERVO_ISR_CYCLES + 1) {
 		uint8_t i;
 		for (i = 0; i < servoCount; i++) {
 			_controlBlocks[i].clockMaxOffset = 0;
@@ -117,8 +436,15 @@ public:
 			_controlBlocks[i].pin = 0;
 			_controlBlocks[i].port = 0;
 			_controlBlocks[i].position = 0;
-			_controlBlocks[i].servoOrder = 255;
+			_controlBlocks[i].target = 0;
+			_controlBlocks[i].origin = 0;
+			_controlBlocks[i].rate = 0;
+			_controlBlocks[i].progress = 0;
+			_controlBlocks[i].progressStep = 0;
+			_controlBlocks[i].easing = ServoEasing::LINEAR;
 		}
+		_schedules[0].portCount = 0;
+		_schedules[0].groupCount = 0;
 
 		_timer.setListener1(this);
 	}
@@ -133,12 +459,11 @@ public:
 		_controlBlocks[servo].pin = pinPin;
 		_controlBlocks[servo].port = pinOut;
 		_controlBlocks[servo].position = (FLAME_SERVO_MIN + FLAME_SERVO_MAX) / 2;
+		_controlBlocks[servo].target = _controlBlocks[servo].position;
 
 		setOutput(pinDir, pinOut, pinIn, pinPin, -1);
 
-		if (_timer.enabled()) {
-			sortServos();
-		}
+		update();
 	}
 	#pragma GCC diagnostic warning "-Wunused-parameter"
 
@@ -153,34 +478,95 @@ public:
 	}
 
 	/**
-	 * Set a servo to a new position
+	 * Set a servo to a new position, the position is applied from the start of the next frame
 	 * @param	servo		the servo to position
 	 * @param	newPosition	the new position of the servo (0 - 65535)
 	 */
 	void positionServo(uint8_t servo, uint16_t newPosition) {
-		_controlBlocks[servo].position = ((uint32_t)newPosition) * (FLAME_SERVO_MAX + _controlBlocks[servo].clockMaxOffset -
-				(FLAME_SERVO_MIN + _controlBlocks[servo].clockMinOffset) ) / 65535 + FLAME_SERVO_MIN + _controlBlocks[servo].clockMinOffset;
+		uint16_t ticks = positionTicks(servo, newPosition);
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			_controlBlocks[servo].position = ticks;
+			_controlBlocks[servo].target = ticks;
+			_controlBlocks[servo].progressStep = 0;
+		}
+
+		update();
+	}
+
+	/**
+	 * Move a servo to a new position at no more than a maximum speed, the servo is moved by the frame interrupt
+	 * @param	servo		the servo to move
+	 * @param	newPosition	the new position of the servo (0 - 65535)
+	 * @param	maxRate		the maximum distance to move per 20ms frame (0 - 65535), 0 to move in a single frame
+	 */
+	void moveServo(uint8_t servo, uint16_t newPosition, uint16_t maxRate) {
+		uint16_t ticks = positionTicks(servo, newPosition);
+		uint16_t rate = 0;
+		if (maxRate) {
+			rate = positionTicks(servo, maxRate) - positionTicks(servo, 0);
+			if (!rate) {
+				rate = 1;
+			}
+		}
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			_controlBlocks[servo].target = ticks;
+			_controlBlocks[servo].rate = rate;
+			_controlBlocks[servo].progressStep = 0;
+		}
+	}
+
+	/**
+	 * Move a servo to a new position along an easing curve, the servo is moved by the frame interrupt
+	 * @param	servo		the servo to move
+	 * @param	newPosition	the new position of the servo (0 - 65535)
+	 * @param	duration	the time to take, in milliseconds
+	 * @param	easing		the curve to follow
+	 */
+	void easeServo(uint8_t servo, uint16_t newPosition, uint16_t duration, ServoEasing easing) {
+		uint16_t ticks = positionTicks(servo, newPosition);
+		uint16_t frames = duration / 20;
+		uint16_t step = (frames > 1) ? (0x10000UL / frames) : 0xffff;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			_controlBlocks[servo].origin = _controlBlocks[servo].position;
+			_controlBlocks[servo].target = ticks;
+			_controlBlocks[servo].progress = 0;
+			_controlBlocks[servo].progressStep = step;
+			_controlBlocks[servo].easing = easing;
+		}
+	}
 
-		if (_timer.enabled()) {
-			sortServos();
+	/**
+	 * Determine if a servo is still moving towards its target
+	 * @param	servo		the servo to check
+	 * @return true if the servo has not reached its target
+	 */
+	bool moving(uint8_t servo) {
+		bool result;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			result = _controlBlocks[servo].position != _controlBlocks[servo].target;
 		}
+		return result;
 	}
 
 	/**
-	 * Determine if a servo can safely be positioned (avoids altering data while the class is processing it)
+	 * Determine if a servo can safely be positioned
+	 * Positions are double buffered, so this is always true
 	 * @return true if positions can be set
 	 */
 	bool canPosition() {
-		return 255 == _nextServoIndex;
+		return true;
 	}
 
 	/**
-	 * Set a servo to a new position, waiting until it can be safely positioned
+	 * Set a servo to a new position
+	 * Positions are double buffered, so this never waits
 	 * @param	servo		the servo to position
 	 * @param	newPosition	the new position of the servo (0 - 65535)
 	 */
 	void positionServoBusyWait(uint8_t servo, uint16_t newPosition) {
-		while (255 != _nextServoIndex) {}
 		positionServo(servo, newPosition);
 	}
 
@@ -188,18 +574,18 @@ public:
 	 * Enable the controller
 	 */
 	void enable() {
-		uint8_t i;
-		for (i = 0; i < servoCount; ++i) {
-			if (_controlBlocks[i].port) {
-				_controlBlocks[i].servoOrder = i;
-			} else {
-				_controlBlocks[i].servoOrder = 255;
-			}
+		_timer.setPeriods(TimerPrescaler::PRESCALER_5_1, 0, 0, 0);
+		_groupTicks = FLAME_SERVO_ISR_CYCLES / _timer.getPrescalerMultiplier() + 1;
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			_pending = false;
 		}
+		build(_active);
 
-		_nextServoIndex = 0;
-		sortServos();
+		_group = FRAME_START;
+		_waitTicks = 0;
 		alarm(AlarmSource::UNKNOWN);
+		_timer.enable();
 	}
 
 	/**
@@ -210,50 +596,22 @@ public:
 	}
 
 	/**
-	 * Start a servo cycle
-	 * @param	timer	the timer that triggered us (unused)
+	 * Start or end servo pulses
+	 * @param	source	the source of the alarm (unused)
 	 */
 	void alarm(UNUSED AlarmSource source) {
-		if (255 == _nextServoIndex) {
-			// Start of the servo pulse
-			for (uint8_t i = 0; i < servoCount; i++) {
-				if (_controlBlocks[i].port) {
-					pinOn(0, _controlBlocks[SERVO_ORDER(i)].port,
-							0, _controlBlocks[SERVO_ORDER(i)].pin, -1);
-				}
-			}
-			_nextServoIndex = 0;
-			// Set up the timer to end the first servo pulse
-			// Note that the timer is reset to 0 when the interrupt is triggered, so the current value is how long to reach this point
-			_timer.setPeriods(TimerPrescaler::PRESCALER_5_1,
-					_controlBlocks[SERVO_ORDER(_nextServoIndex)].position - _timer.current(), 0, 0);
-			_timer.enable();
+		if (_waitTicks) {
+			waitForFrame();
 			return;
 		}
 
-		uint16_t startPosition = _controlBlocks[SERVO_ORDER(_nextServoIndex)].position;
-
-		for (;;) {
-			pinOff(0, _controlBlocks[SERVO_ORDER(_nextServoIndex)].port,
-					0, _controlBlocks[SERVO_ORDER(_nextServoIndex)].pin, -1);
-			_nextServoIndex++;
-			if (_nextServoIndex >= servoCount || 255 == SERVO_ORDER(_nextServoIndex)) {
-				_nextServoIndex = 255;
-				// sleep for 20ms to the next servo pass
-				_timer.setTimes(20000UL, 0UL, 0UL); // sleep for 20ms
-				_timer.enable();
-				return;
-			}
-
-			// Set up the next servo if it is sufficiently far away from the current one
-			if ((uint32_t)_controlBlocks[SERVO_ORDER(_nextServoIndex)].position >
-					(uint32_t)_controlBlocks[SERVO_ORDER(_nextServoIndex-1)].position + _timer.current()) {
+		while (nextGroup()) {
+			// The compare match was missed, the group has been ended late
+		}
 
-				_timer.setPeriods(TimerPrescaler::PRESCALER_5_1,
-						_controlBlocks[SERVO_ORDER(_nextServoIndex)].position - startPosition - _timer.current(), 0, 0);
-				_timer.enable();
-				return;
-			}
+		if (FRAME_START == _group) {
+			// All pulses are done
+			moveServos();
 		}
 	}
 };
@@ -28,11 +28,31 @@
 #ifndef FLAME_SOFTWAREHBRIDGE_H_
 #define FLAME_SOFTWAREHBRIDGE_H_
 
-#ifdef FLAME_TIMER16_1
-
 #include <inttypes.h>
 #include <flame/io.h>
-#include <flame/Timer16.h>
+#include <flame/Timer.h>
+
+// The CPU cycles from a compare match to the end of the interrupt switching the bridge, without the dead time
+#ifndef FLAME_SOFTWAREHBRIDGE_ISR_CYCLES
+#define FLAME_SOFTWAREHBRIDGE_ISR_CYCLES	250
+#endif
+
+/* Synchronised current sensing needs the ADC to be auto triggered by Timer 1 compare match B,
+ * which is only available on the ATmegas
+ */
+#if defined(ADATE) && defined(ICR1)
+#define FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+#include <flame/AD.h>
+
+/**
+ * Assign the ADC interrupt to an H bridge for current sensing
+ * @param	__flameHBridge	the SoftwareHBridge to notify
+ */
+#define FLAME_SOFTWAREHBRIDGE_ASSIGN_ADC_INTERRUPT(__flameHBridge) \
+ISR(ADC_vect) { \
+	__flameHBridge.adc(); \
+}
+#endif
 
 namespace flame {
 
@@ -48,38 +68,71 @@ enum class SoftwareHBridgeType : bool {
 	DIRECT
 };
 
+/**
+ * What the bridge does with the motor current between PWM pulses
+ */
+enum class SoftwareHBridgeDecay : uint8_t {
+	SLOW,		// The bottom transistors short the motor, the current recirculates slowly
+	FAST		// All transistors are off, the current decays quickly through the diodes to the supply
+};
+
 class SoftwareHBridge : public TimerListener {
 protected:
-	SoftwareHBridgeType		_type;
+	// Transistor bits for bridge states
+	static const uint8_t		TOP_1 = _BV(0);
+	static const uint8_t		BOTTOM_1 = _BV(1);
+	static const uint8_t		TOP_2 = _BV(2);
+	static const uint8_t		BOTTOM_2 = _BV(3);
+	static const uint8_t		TOPS = TOP_1 | TOP_2;
+	static const uint8_t		TRANSISTORS = 4;
+
+	SoftwareHBridgeType			_type;
 	Timer						&_timer;
 
-	volatile uint8_t			*_dir1Top;
-	volatile uint8_t			*_out1Top;
-	uint8_t 					_pin1Top;
-	volatile uint8_t			*_out1Bottom;
-	uint8_t						_pin1Bottom;
-	volatile uint8_t			*_dir2Top;
-	volatile uint8_t			*_out2Top;
-	uint8_t						_pin2Top;
-	volatile uint8_t			*_out2Bottom;
-	uint8_t						_pin2Bottom;
+	volatile uint8_t			*_dir[TRANSISTORS];
+	volatile uint8_t			*_out[TRANSISTORS];
+	uint8_t						_mask[TRANSISTORS];
 
 	SoftwareHBridgeDirection	_direction;
+	SoftwareHBridgeDecay		_decay;
+	uint8_t						_deadTime;
+	uint8_t						_onState;
+	uint8_t						_offState;
+	volatile uint8_t			_state;
+	volatile bool				_rising;
+	uint16_t					_compare;
+
+#ifdef FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+	uint16_t					_limit;
+	volatile uint16_t			_current;
+	volatile bool				_skip;
+#endif
+
+	void transistor(uint8_t transistor, bool on);
+	void drive(uint8_t state);
+	void setStates(uint16_t magnitude);
+	bool inPulse();
 
 public:
-	SoftwareHBridge(SoftwareHBridgeType type, FLAME_Timer &timer, uint8_t timerChannel,
-			FLAME_DECLARE_PIN(dir1Top),
-			FLAME_DECLARE_PIN(dir1Bottom),
-			FLAME_DECLARE_PIN(dir2Top),
-			FLAME_DECLARE_PIN(dir2Bottom));
-	void reset();
-	void alarm();
+	SoftwareHBridge(SoftwareHBridgeType type, Timer &timer,
+			FLAME_DECLARE_PIN(top1),
+			FLAME_DECLARE_PIN(bottom1),
+			FLAME_DECLARE_PIN(top2),
+			FLAME_DECLARE_PIN(bottom2));
+	void setDecay(SoftwareHBridgeDecay decay);
+	void setDeadTime(uint16_t nanoseconds);
+	void start();
+	void alarm(AlarmSource source);
 	void set(SoftwareHBridgeDirection direction, uint16_t magnitude);
 	void set(SoftwareHBridgeDirection direction);
+#ifdef FLAME_SOFTWAREHBRIDGE_CURRENT_SENSE
+	void senseCurrent(ADCChannel channel, ADCReference reference, ADCPrescaler prescaler, uint16_t limit);
+	void setCurrentLimit(uint16_t limit);
+	uint16_t getCurrent() PURE;
+	void adc();
+#endif
 };
 
 }
 
-#endif // FLAME_TIMER16_1
-
 #endif /* FLAME_SOFTWAREHBRIDGE_H_ */
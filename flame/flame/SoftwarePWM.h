@@ -30,6 +30,15 @@
 
 #include <flame/Timer.h>
 #include <flame/Pin.h>
+#include <util/atomic.h>
+#include <string.h>
+
+/* The CPU cycles from a compare match to SoftwarePWMMode::EDGES setting the next timer top, with
+ * some margin for other interrupts. Edges closer than this are switched together.
+ */
+#ifndef FLAME_SOFTWAREPWM_ISR_CYCLES
+#define FLAME_SOFTWAREPWM_ISR_CYCLES	250
+#endif
 
 namespace flame {
 
@@ -41,6 +50,23 @@ public:
 	virtual void set() =0;
 	virtual bool check() =0;
 
+	/**
+	 * Get the output register driven by this listener, so the edge scheduler can
+	 * switch it together with other listeners on the same port
+	 * @return the output register, or NULL if the listener must be called through set/reset
+	 */
+	virtual volatile uint8_t *port() {
+		return NULL;
+	}
+
+	/**
+	 * Get the bits in port() driven by this listener
+	 * @return the bitmask within the output register
+	 */
+	virtual uint8_t portMask() {
+		return 0;
+	}
+
 	void setDutyCycle(uint8_t dutyCycle) {
 		when = dutyCycle;
 	}
@@ -48,6 +74,8 @@ public:
 	uint8_t getDutyCycle() {
 		return when;
 	}
+
+	virtual ~SoftwarePWMListener() {};
 };
 
 template<FLAME_DECLARE_PIN(pin)>
@@ -68,26 +96,269 @@ public:
 	INLINE bool check() {
 		return PinImplementation<FLAME_PIN_PARMS(pin)>::read();
 	}
+
+	volatile uint8_t *port() {
+		return &_SFR_MEM8(pinOut);
+	}
+
+	uint8_t portMask() {
+		return _BV(pinPin);
+	}
 };
 
+/**
+ * How SoftwarePWM drives its outputs
+ *   TICKS: interrupt on every one of the 256 steps of a period, checking each listener
+ *   EDGES: interrupt only at period start and at each distinct duty cycle, switching whole ports at once.
+ *          Edges less than FLAME_SOFTWAREPWM_ISR_CYCLES after the one before are switched in the same
+ *          interrupt, a little early, as the timer would already be past their top.
+ */
+enum class SoftwarePWMMode {
+	TICKS,
+	EDGES
+};
 
-template<uint8_t listenerCount=8>
+template<uint8_t listenerCount=8, SoftwarePWMMode pwmMode=SoftwarePWMMode::TICKS>
 class SoftwarePWM : public TimerListener {
 private:
+	static const uint8_t	PERIOD_START = 0xff;
+	static const uint8_t	SLOTS = (SoftwarePWMMode::EDGES == pwmMode) ? listenerCount : 1;
+
+	/**
+	 * A precomputed period, sorted by duty cycle
+	 */
+	struct Schedule {
+		uint8_t					portCount;
+		volatile uint8_t		*ports[SLOTS];
+		uint8_t					onMasks[SLOTS];			// per port, set at period start
+		uint8_t					zeroMasks[SLOTS];		// per port, cleared at period start
+		uint8_t					edgeCount;
+		uint8_t					edges[SLOTS];			// step of each edge, ascending
+		uint8_t					offMasks[SLOTS][SLOTS];	// per edge, per port
+		uint8_t					otherCount;
+		uint8_t					otherFirst;						// first other with a nonzero duty cycle
+		SoftwarePWMListener		*others[SLOTS];			// listeners without a port, sorted by duty cycle
+		uint8_t					othersEnd[SLOTS];		// per edge, one past the last other to reset
+	};
+
 	Timer					&_timer;
 	SoftwarePWMListener		*_listeners[listenerCount];
 	uint8_t					_listenerCount;
 	uint8_t					_ticks;
 
+	Schedule				_schedules[2];
+	Schedule * volatile		_active;
+	volatile bool			_pending;
+	uint8_t					_edge;
+	uint8_t					_step;
+	uint16_t				_waitSteps;
+	uint16_t				_baseTop;
+	uint16_t				_maxSteps;
+	uint16_t				_minSteps;		// the shortest wait the interrupt can set in time
+
+	/**
+	 * Build the schedule for the current duty cycles
+	 * @param schedule	the schedule to fill
+	 */
+	void build(Schedule *schedule) {
+		SoftwarePWMListener *sorted[listenerCount];
+
+		// Insertion sort by duty cycle, listener counts are small
+		for (uint8_t i = 0; i < _listenerCount; i++) {
+			SoftwarePWMListener *listener = _listeners[i];
+			uint8_t j = i;
+			for (; j > 0 && sorted[j - 1]->when > listener->when; j--) {
+				sorted[j] = sorted[j - 1];
+			}
+			sorted[j] = listener;
+		}
+
+		schedule->portCount = 0;
+		schedule->edgeCount = 0;
+		schedule->otherCount = 0;
+		schedule->otherFirst = 0;
+		memset(schedule->onMasks, 0, sizeof(schedule->onMasks));
+		memset(schedule->zeroMasks, 0, sizeof(schedule->zeroMasks));
+		memset(schedule->offMasks, 0, sizeof(schedule->offMasks));
+
+		for (uint8_t i = 0; i < _listenerCount; i++) {
+			SoftwarePWMListener *listener = sorted[i];
+			uint8_t when = listener->when;
+
+			// Duty cycles of 0 never switch on, 255 never switch off
+			if (when > 0 && when < 255 &&
+					(0 == schedule->edgeCount || schedule->edges[schedule->edgeCount - 1] != when)) {
+				schedule->edges[schedule->edgeCount] = when;
+				schedule->othersEnd[schedule->edgeCount] = schedule->otherCount;
+				schedule->edgeCount++;
+			}
+
+			volatile uint8_t *port = listener->port();
+			if (NULL == port) {
+				if (0 == when) {
+					schedule->otherFirst++;
+				}
+				schedule->others[schedule->otherCount++] = listener;
+				if (when > 0 && when < 255) {
+					schedule->othersEnd[schedule->edgeCount - 1] = schedule->otherCount;
+				}
+				continue;
+			}
+
+			uint8_t p = 0;
+			for (; p < schedule->portCount && schedule->ports[p] != port; p++) {
+			}
+			if (p == schedule->portCount) {
+				schedule->ports[schedule->portCount++] = port;
+			}
+
+			if (when > 0) {
+				schedule->onMasks[p] |= listener->portMask();
+			} else {
+				schedule->zeroMasks[p] |= listener->portMask();
+			}
+			if (when > 0 && when < 255) {
+				schedule->offMasks[schedule->edgeCount - 1][p] |= listener->portMask();
+			}
+		}
+	}
+
+	/**
+	 * Program the timer to interrupt after a number of steps, splitting gaps the timer cannot hold
+	 * The timer runs in CTC mode, so if it has already counted past the new top, the compare match
+	 * has been missed and would not come until the counter wraps.
+	 * @param steps	the number of steps to wait
+	 * @return true if the timer was already past the new top
+	 */
+	bool wait(uint16_t steps) {
+		uint16_t chunk = (steps > _maxSteps) ? _maxSteps : steps;
+		uint16_t top = chunk * _baseTop - 1;
+
+		_waitSteps = steps - chunk;
+		_timer.setTop(top);
+		return _timer.current() > top;
+	}
+
+	/**
+	 * Switch off the outputs for the current edge, and move on to the next
+	 * @param schedule	the active schedule
+	 */
+	INLINE void edgeOff(Schedule *schedule) {
+		const uint8_t *offMasks = schedule->offMasks[_edge];
+		for (uint8_t p = 0; p < schedule->portCount; p++) {
+			*(schedule->ports[p]) &= ~offMasks[p];
+		}
+		for (uint8_t i = (0 == _edge) ? schedule->otherFirst : schedule->othersEnd[_edge - 1]; i < schedule->othersEnd[_edge]; i++) {
+			schedule->others[i]->reset();
+		}
+
+		_edge++;
+	}
+
+	/**
+	 * Handle the timer interrupt for SoftwarePWMMode::TICKS
+	 */
+	void alarmTicks() {
+		if (!_ticks++) {
+			for (uint8_t i = 0; i < _listenerCount; i++) {
+				_listeners[i]->set();
+			}
+		} else {
+			for (uint8_t i = 0; i < _listenerCount; i++) {
+				if (_listeners[i]->check() && _listeners[i]->when < _ticks) {
+					_listeners[i]->reset();
+				}
+			}
+		}
+	}
+
+	/**
+	 * Switch the outputs for the edge that is due, and wait for the next one
+	 * @return true if the timer was already past the next edge
+	 */
+	bool nextEdge() {
+		if (_waitSteps) {
+			return wait(_waitSteps);
+		}
+
+		Schedule *schedule = _active;
+
+		if (PERIOD_START == _edge) {
+			if (_pending) {
+				_active = schedule = (schedule == &_schedules[0]) ? &_schedules[1] : &_schedules[0];
+				_pending = false;
+			}
+
+			for (uint8_t p = 0; p < schedule->portCount; p++) {
+				volatile uint8_t *port = schedule->ports[p];
+				*port = (*port & ~schedule->zeroMasks[p]) | schedule->onMasks[p];
+			}
+			for (uint8_t i = 0; i < schedule->otherFirst; i++) {
+				schedule->others[i]->reset();
+			}
+			for (uint8_t i = schedule->otherFirst; i < schedule->otherCount; i++) {
+				schedule->others[i]->set();
+			}
+
+			_edge = 0;
+			_step = 0;
+		} else {
+			_step = schedule->edges[_edge];
+			edgeOff(schedule);
+		}
+
+		// Edges too close to wait for are switched now
+		while (_edge < schedule->edgeCount && schedule->edges[_edge] - _step < _minSteps) {
+			edgeOff(schedule);
+		}
+
+		if (_edge < schedule->edgeCount) {
+			return wait(schedule->edges[_edge] - _step);
+		}
+
+		_edge = PERIOD_START;
+		return wait(256 - _step);
+	}
+
+	/**
+	 * Handle the timer interrupt for SoftwarePWMMode::EDGES
+	 */
+	void alarmEdges() {
+		if (!_baseTop) {
+			_baseTop = _timer.getTop() + 1;
+			_maxSteps = (_timer.getMaximumTop() + 1UL) / _baseTop;
+			_minSteps = FLAME_SOFTWAREPWM_ISR_CYCLES / _timer.getPrescalerMultiplier() / _baseTop + 1;
+		}
+
+		while (nextEdge()) {
+			// The compare match was missed, switch the next edge now and time the one after from here
+			_timer.setCurrent(0);
+		}
+	}
+
 public:
 	/**
 	 * Create a new software PWM manager
+	 * In SoftwarePWMMode::EDGES, the timer must be REPETITIVE and its top when first fired sets the length of a step
 	 * @param timer			the timer to drive the manager with
 	 */
 	SoftwarePWM(Timer &timer) :
 		_timer(timer),
 		_listenerCount(0),
-		_ticks(0) {}
+		_ticks(0),
+		_active(&_schedules[0]),
+		_pending(false),
+		_edge(PERIOD_START),
+		_step(0),
+		_waitSteps(0),
+		_baseTop(0),
+		_maxSteps(0),
+		_minSteps(1) {
+		_schedules[0].portCount = 0;
+		_schedules[0].edgeCount = 0;
+		_schedules[0].otherCount = 0;
+		_schedules[0].otherFirst = 0;
+	}
 
 	/**
 	 * Register a listener
@@ -103,24 +374,231 @@ public:
 		_listeners[_listenerCount]->when = 0;
 		_listeners[_listenerCount]->reset();
 
-		return _listenerCount++;
+		uint8_t index = _listenerCount++;
+		update();
+		return index;
+	}
+
+	/**
+	 * Apply changed duty cycles
+	 * In SoftwarePWMMode::EDGES, the schedule is rebuilt in a shadow copy and takes effect at the start of the next period.
+	 * Call this after setting the duty cycles of the listeners.
+	 */
+	void update() {
+		if (SoftwarePWMMode::EDGES != pwmMode) {
+			return;
+		}
+
+		Schedule *shadow;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			_pending = false;
+			shadow = (_active == &_schedules[0]) ? &_schedules[1] : &_schedules[0];
+		}
+
+		build(shadow);
+		_pending = true;
 	}
 
 	/**
 	 * Handle the timer interrupt by setting the outputs
 	 */
 	void alarm(UNUSED AlarmSource source) {
-		if (!_ticks++) {
-			for (uint8_t i = 0; i < _listenerCount; i++) {
-				_listeners[i]->set();
-			}
+		if (SoftwarePWMMode::EDGES == pwmMode) {
+			alarmEdges();
 		} else {
-			for (uint8_t i = 0; i < _listenerCount; i++) {
-				if (_listeners[i]->check() && _listeners[i]->when < _ticks) {
-					_listeners[i]->reset();
-				}
+			alarmTicks();
+		}
+	}
+};
+
+/**
+ * A pin driven by SoftwarePWMPinSet, resolved at compile time
+ * @tparam	pin...		the pin
+ */
+template<FLAME_DECLARE_PIN(pin)>
+struct SoftwarePWMChannel {
+	static const FLAME_register	out = pinOut;
+	static const uint8_t		mask = _BV(pinPin);
+
+	INLINE static void init() {
+		pinOff(FLAME_PIN_PARMS(pin));
+		setOutput(FLAME_PIN_PARMS(pin));
+	}
+};
+
+/**
+ * Compile time operations over a list of SoftwarePWMChannels, everything here inlines to straight line code
+ * @tparam	Channels	the channels
+ */
+template<typename... Channels>
+struct SoftwarePWMChannels {
+	INLINE static void init() {}
+
+	template<FLAME_register port>
+	static constexpr bool contains() {
+		return false;
+	}
+
+	template<FLAME_register port>
+	static constexpr uint8_t portMask() {
+		return 0;
+	}
+
+	template<FLAME_register port>
+	INLINE static uint8_t matching(UNUSED const uint8_t *dutyCycles, UNUSED uint8_t step) {
+		return 0;
+	}
+
+	template<typename All>
+	INLINE static void start(UNUSED const uint8_t *dutyCycles) {}
+
+	template<typename All>
+	INLINE static void tick(UNUSED const uint8_t *dutyCycles, UNUSED uint8_t step) {}
+};
+
+template<typename Channel, typename... Rest>
+struct SoftwarePWMChannels<Channel, Rest...> {
+	typedef SoftwarePWMChannels<Rest...> Next;
+
+	INLINE static void init() {
+		Channel::init();
+		Next::init();
+	}
+
+	/**
+	 * Check if any channel is on a port
+	 * @tparam	port	the output register
+	 */
+	template<FLAME_register port>
+	static constexpr bool contains() {
+		return Channel::out == port || Next::template contains<port>();
+	}
+
+	/**
+	 * Get the bits of all channels on a port
+	 * @tparam	port	the output register
+	 */
+	template<FLAME_register port>
+	static constexpr uint8_t portMask() {
+		return ((Channel::out == port) ? Channel::mask : 0) | Next::template portMask<port>();
+	}
+
+	/**
+	 * Get the bits of the channels on a port that end their pulse at a step
+	 * @tparam	port		the output register
+	 * @param	dutyCycles	the duty cycle of this channel, followed by the rest
+	 * @param	step		the step within the period
+	 */
+	template<FLAME_register port>
+	INLINE static uint8_t matching(const uint8_t *dutyCycles, uint8_t step) {
+		return ((Channel::out == port && *dutyCycles == step) ? Channel::mask : 0) |
+				Next::template matching<port>(dutyCycles + 1, step);
+	}
+
+	/**
+	 * Turn on every port at the start of a period, the last channel on each port writes it
+	 * @tparam	All			the full channel list
+	 * @param	dutyCycles	the duty cycles of the full channel list
+	 */
+	template<typename All>
+	INLINE static void start(const uint8_t *dutyCycles) {
+		if (!Next::template contains<Channel::out>()) {
+			_SFR_MEM8(Channel::out) = (_SFR_MEM8(Channel::out) | All::template portMask<Channel::out>()) &
+					~All::template matching<Channel::out>(dutyCycles, 0);
+		}
+		Next::template start<All>(dutyCycles);
+	}
+
+	/**
+	 * Turn off the channels whose pulse ends at a step, the last channel on each port writes it
+	 * @tparam	All			the full channel list
+	 * @param	dutyCycles	the duty cycles of the full channel list
+	 * @param	step		the step within the period
+	 */
+	template<typename All>
+	INLINE static void tick(const uint8_t *dutyCycles, uint8_t step) {
+		if (!Next::template contains<Channel::out>()) {
+			uint8_t clear = All::template matching<Channel::out>(dutyCycles, step);
+			if (clear) {
+				_SFR_MEM8(Channel::out) &= ~clear;
 			}
 		}
+		Next::template tick<All>(dutyCycles, step);
+	}
+};
+
+/**
+ * Software PWM over a fixed set of pins
+ * The pins are known at compile time, so each timer interrupt is a single OR per port at the start of a period,
+ * and a compare of each duty cycle and a single AND per port on the other steps, with no virtual calls.
+ * With 64 steps, a 16MHz part can drive 16 or more channels at 1kHz.
+ *
+ * @tparam	steps		the number of steps in a period, a duty cycle of steps or more is always on
+ * @tparam	Channels	the SoftwarePWMChannels to drive
+ */
+template<uint8_t steps, typename... Channels>
+class SoftwarePWMPinSet : public TimerListener {
+private:
+	typedef SoftwarePWMChannels<Channels...> All;
+	static const uint8_t COUNT = sizeof...(Channels);
+
+	uint8_t		_dutyCycles[COUNT];
+	uint8_t		_active[COUNT];		// latched at the start of each period
+	uint8_t		_step;
+
+public:
+	/**
+	 * Create a new software PWM manager, all channels start off
+	 */
+	SoftwarePWMPinSet() :
+		_step(0) {
+		memset(_dutyCycles, 0, sizeof(_dutyCycles));
+		memset(_active, 0, sizeof(_active));
+		All::init();
+	}
+
+	/**
+	 * Set the duty cycle of a channel, this takes effect at the start of the next period
+	 * @param	channel		the index of the channel in Channels
+	 * @param	dutyCycle	the number of steps the channel is on for
+	 */
+	void setDutyCycle(uint8_t channel, uint8_t dutyCycle) {
+		_dutyCycles[channel] = dutyCycle;
+	}
+
+	/**
+	 * Get the duty cycle of a channel
+	 * @param	channel		the index of the channel in Channels
+	 * @return the number of steps the channel is on for
+	 */
+	uint8_t getDutyCycle(uint8_t channel) {
+		return _dutyCycles[channel];
+	}
+
+	/**
+	 * Advance one step, may be called directly from an ISR to avoid the listener call
+	 */
+	INLINE void tick() {
+		uint8_t step = _step;
+
+		if (0 == step) {
+			memcpy(_active, _dutyCycles, COUNT);
+			All::template start<All>(_active);
+		} else {
+			All::template tick<All>(_active, step);
+		}
+
+		if (++step == steps) {
+			step = 0;
+		}
+		_step = step;
+	}
+
+	/**
+	 * Handle the timer interrupt by setting the outputs
+	 */
+	void alarm(UNUSED AlarmSource source) {
+		tick();
 	}
 };
 
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAME_STEPPERCONTROLLER_H_
+#define FLAME_STEPPERCONTROLLER_H_
+
+#include <flame/io.h>
+#include <flame/Timer.h>
+#include <flame/StepperMotor.h>
+#include <flame/StepperProfile.h>
+
+namespace flame {
+
+/**
+ * Moves a StepperMotor with a trapezoidal speed profile, taking each step from a timer compare interrupt
+ *
+ * The timer should be a 16 bit timer in TimerMode::REPETITIVE, with its prescaler set by setPeriods
+ * before the first move. At 16MHz, a prescaler of 8 allows step rates from 31Hz to beyond 20kHz.
+ */
+class StepperController : public TimerListener {
+private:
+	Timer					&_timer;
+	StepperMotor			&_motor;
+	StepperProfile			_profile;
+	uint16_t				_maxSpeed;
+	uint16_t				_nextDelay;		// the interval after the coming step, 0 if it is the last
+	bool					_forward;
+	volatile bool			_moving;
+	StepperListener			*_stepperListener;
+
+	bool step();
+
+public:
+	StepperController(Timer &timer, StepperMotor &motor);
+	void setAcceleration(uint32_t acceleration);
+	void setMaxSpeed(uint16_t maxSpeed);
+	bool move(int32_t steps);
+	bool moveTo(int32_t position);
+	void stop();
+	bool isMoving() PURE;
+	void alarm(AlarmSource source);
+	void registerListener(StepperListener &listener);
+	void deregisterListener();
+};
+
+}
+
+#endif /* FLAME_STEPPERCONTROLLER_H_ */
@@ -41,7 +41,7 @@ public:
 class StepperMotor : public TimerListener {
 private:
 	int32_t			_position;
-	RTC				&_rtc;
+	RTC				*_rtc;
 	bool			_moving;
 	bool			_forward;
 	float			_speed;
@@ -51,8 +51,11 @@ private:
 	StepperListener	*_stepperListener;
 
 public:
+	StepperMotor();
 	StepperMotor(RTC &rtc);
 	virtual void step(bool forward) =0;
+	void advance(bool forward);
+	virtual void idle();
 	void setPosition(int32_t position);
 	bool isMoving() PURE;
 	int32_t	getPosition() PURE;
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAME_STEPPERMOTORBIPOLAR_H_
+#define FLAME_STEPPERMOTORBIPOLAR_H_
+
+#include <flame/StepperMotor.h>
+#include <flame/Timer.h>
+#include <avr/pgmspace.h>
+
+namespace flame {
+
+// A quarter sine wave in 32 microsteps, sin(i * 90 / 32) * 255
+#ifdef __FLASH
+const uint8_t __flash microstepSine[] = {
+#else
+const uint8_t microstepSine[] PROGMEM = {
+#endif
+		0, 13, 25, 37, 50, 62, 74, 86, 98, 109, 120, 131, 142, 152, 162, 171,
+		180, 189, 197, 205, 212, 219, 225, 231, 236, 240, 244, 247, 250, 252, 254, 255,
+		255
+};
+
+/**
+ * A microstepping driver for a bipolar stepper motor on 2 H bridges (eg, L298N)
+ *
+ * The current in each coil follows a sine wave (coil A) and a cosine wave (coil B), the magnitude
+ * is set with PWM on the enable input of each bridge, and the sign with the bridge inputs.
+ * The enable inputs must be connected to output 1 (coil A) & output 2 (coil B) of the PWM timer,
+ * which should be in one of the PWM modes and configured before setCurrent is called.
+ *
+ * @tparam	microsteps	the number of microsteps per full step (1, 2, 4, 8, 16 or 32)
+ * @tparam	a1			the first input of the coil A bridge
+ * @tparam	a2			the second input of the coil A bridge
+ * @tparam	b1			the first input of the coil B bridge
+ * @tparam	b2			the second input of the coil B bridge
+ */
+template <uint8_t microsteps, FLAME_DECLARE_PIN(a1), FLAME_DECLARE_PIN(a2),
+		FLAME_DECLARE_PIN(b1), FLAME_DECLARE_PIN(b2)>
+class StepperMotorBipolar: public StepperMotor {
+private:
+	static_assert(microsteps && microsteps <= 32 && 0 == (32 % microsteps), "microsteps must be a power of 2 up to 32");
+
+	static const uint8_t	PHASES = 4 * microsteps;
+
+	Timer				&_pwmTimer;
+	uint8_t				_phase;
+	uint16_t			_runScale;
+	uint16_t			_holdScale;
+	uint16_t			_scale;
+
+	/**
+	 * Get the sine of a phase
+	 * @param	phase	the phase, 4 * microsteps per electrical cycle
+	 * @return the magnitude (0 - 255)
+	 */
+	static uint8_t sine(uint8_t phase) {
+		uint8_t offset = (phase % microsteps) * (32 / microsteps);
+		if ((phase / microsteps) & 1) {
+			offset = 32 - offset;
+		}
+
+#ifdef __FLASH
+		return microstepSine[offset];
+#else
+		return pgm_read_byte(microstepSine + offset);
+#endif
+	}
+
+	/**
+	 * Drive one coil
+	 * @param	phase		the phase of the coil
+	 * @param	channel		the PWM timer channel of the coil
+	 */
+	void driveCoil(uint8_t phase, uint8_t channel) {
+		uint16_t duty = ((uint32_t)sine(phase) * _scale) >> 8;
+
+		_pwmTimer.setOutput(channel, duty);
+	}
+
+	/**
+	 * Set the bridges and PWM outputs for the current phase
+	 */
+	void setCoils() {
+		uint8_t phaseB = _phase + microsteps;
+		if (phaseB >= PHASES) {
+			phaseB -= PHASES;
+		}
+
+		// The second half of the cycle reverses the coil
+		bool forwardA = _phase < 2 * microsteps;
+		bool forwardB = phaseB < 2 * microsteps;
+
+		pinSet(FLAME_PIN_PARMS(a1), forwardA);
+		pinSet(FLAME_PIN_PARMS(a2), !forwardA);
+		pinSet(FLAME_PIN_PARMS(b1), forwardB);
+		pinSet(FLAME_PIN_PARMS(b2), !forwardB);
+
+		driveCoil(_phase, 1);
+		driveCoil(phaseB, 2);
+	}
+
+	/**
+	 * Set up the pins
+	 */
+	void init() {
+		pinOff(FLAME_PIN_PARMS(a1));
+		pinOff(FLAME_PIN_PARMS(a2));
+		pinOff(FLAME_PIN_PARMS(b1));
+		pinOff(FLAME_PIN_PARMS(b2));
+		setOutput(FLAME_PIN_PARMS(a1));
+		setOutput(FLAME_PIN_PARMS(a2));
+		setOutput(FLAME_PIN_PARMS(b1));
+		setOutput(FLAME_PIN_PARMS(b2));
+	}
+
+public:
+	/**
+	 * Create a driver for a bipolar stepper motor, to be stepped by a StepperController or StepperPlanner
+	 *
+	 * @param	pwmTimer	the timer generating the PWM for the bridge enables
+	 */
+	StepperMotorBipolar(Timer &pwmTimer) :
+			StepperMotor(),
+			_pwmTimer(pwmTimer),
+			_phase(0),
+			_runScale(0),
+			_holdScale(0),
+			_scale(0) {
+		init();
+	}
+
+	/**
+	 * Create a driver for a bipolar stepper motor
+	 *
+	 * @param	rtc			the RTC used for stepper movements
+	 * @param	pwmTimer	the timer generating the PWM for the bridge enables
+	 */
+	StepperMotorBipolar(RTC &rtc, Timer &pwmTimer) :
+			StepperMotor(rtc),
+			_pwmTimer(pwmTimer),
+			_phase(0),
+			_runScale(0),
+			_holdScale(0),
+			_scale(0) {
+		init();
+	}
+
+	/**
+	 * Set the coil currents, and energise the coils at the holding current
+	 * @pre the PWM timer must be configured, as its top sets the PWM resolution
+	 *
+	 * @param	run		the current while moving (0 - 255)
+	 * @param	hold	the current at standstill (0 - 255)
+	 */
+	void setCurrent(uint8_t run, uint8_t hold) {
+		uint32_t range = (uint32_t)_pwmTimer.getTop() + 1;
+		_runScale = (range * run) / 255;
+		_holdScale = (range * hold) / 255;
+		_scale = _holdScale;
+
+		setCoils();
+	}
+
+	/**
+	 * Move a microstep, switching to the running current
+	 * @param	forwards	true to move forwards
+	 */
+	void step(bool forwards) {
+		if (forwards) {
+			if (++_phase >= PHASES) {
+				_phase = 0;
+			}
+		} else {
+			if (0 == _phase--) {
+				_phase = PHASES - 1;
+			}
+		}
+
+		_scale = _runScale;
+		setCoils();
+	}
+
+	/**
+	 * Drop to the holding current once the motor is stationary
+	 */
+	void idle() {
+		_scale = _holdScale;
+		setCoils();
+	}
+};
+
+}
+#endif /* FLAME_STEPPERMOTORBIPOLAR_H_ */
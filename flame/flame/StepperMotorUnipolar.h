@@ -128,7 +128,29 @@ private:
 		_MMIO_BYTE(phaseAOut) = (_MMIO_BYTE(phaseAOut) & ~PHASE_MASK) | coilPattern;
 	}
 
+	/**
+	 * Set up the pins
+	 */
+	void init() {
+		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 0, phaseAPinchangeInterrupt);
+		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 1, phaseAPinchangeInterrupt);
+		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 2, phaseAPinchangeInterrupt);
+		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 3, phaseAPinchangeInterrupt);
+
+		setPins();
+	}
+
 public:
+	/**
+	 * Create a driver for a unipolar stepper motor, to be stepped by a StepperController
+	 */
+	StepperMotorUnipolar() :
+			StepperMotor(),
+			_state(0),
+			_steps((StepperMode::HALF == mode) ? 8 : 4) {
+		init();
+	}
+
 	/**
 	 * Create a driver for a unipolar stepper motor
 	 *
@@ -138,12 +160,7 @@ public:
 			StepperMotor(rtc),
 			_state(0),
 			_steps((StepperMode::HALF == mode) ? 8 : 4) {
-		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 0, phaseAPinchangeInterrupt);
-		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 1, phaseAPinchangeInterrupt);
-		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 2, phaseAPinchangeInterrupt);
-		setOutput(phaseADir, phaseAOut, phaseAIn, phaseAPin + 3, phaseAPinchangeInterrupt);
-
-		setPins();
+		init();
 	}
 
 	void step(bool forwards) {
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAME_STEPPERPLANNER_H_
+#define FLAME_STEPPERPLANNER_H_
+
+#include <flame/io.h>
+#include <flame/Timer.h>
+#include <flame/StepperMotor.h>
+#include <flame/StepperProfile.h>
+#include <util/atomic.h>
+#include <math.h>
+
+namespace flame {
+
+/**
+ * A queued linear move
+ */
+template<uint8_t axisCount>
+struct StepperSegment {
+	uint32_t		steps[axisCount];	// steps to take on each axis
+	uint8_t			forward;			// bit per axis, set to step forward
+	uint32_t		major;				// steps on the axis that moves furthest
+	uint16_t		speed;				// cruising rate of the major axis, steps/second
+	uint16_t		maxEntry;			// fastest major axis rate the junction with the previous move allows
+	volatile uint16_t	entry;			// planned major axis rate at the start of the move
+	StepperSpeed	cruiseRamp;			// speed, as a position on the acceleration ramp
+	StepperSpeed	entryRamp;			// entry, as a position on the acceleration ramp
+};
+
+/**
+ * Moves several StepperMotors along straight lines, from a queue of moves
+ *
+ * All axes are stepped from a single timer, interleaved with Bresenham's algorithm. Each move is given
+ * a trapezoidal speed profile (see StepperProfile), and the queue is replanned as moves are added so that
+ * consecutive moves in similar directions pass through their junction without stopping.
+ *
+ * Speeds and acceleration apply to the axis moving furthest in each move, so no axis exceeds them.
+ * The timer should be a 16 bit timer in TimerMode::REPETITIVE, with its prescaler set by setPeriods
+ * before the first move.
+ *
+ * @tparam	axisCount		the number of axes
+ * @tparam	queueLength		the number of moves that can be queued
+ */
+template<uint8_t axisCount, uint8_t queueLength = 16>
+class StepperPlanner : public TimerListener {
+private:
+	Timer							&_timer;
+	StepperMotor					*_axes[axisCount];
+	StepperProfile					_profile;
+	StepperSegment<axisCount>		_queue[queueLength];
+	volatile uint8_t				_head;
+	volatile uint8_t				_count;
+	volatile bool					_running;
+	volatile uint16_t				_committedExit;
+	uint16_t						_nextDelay;		// the interval after the coming step, 0 if it ends the move
+	int32_t							_planned[axisCount];
+	uint16_t						_junctionSpeed;
+	uint32_t						_error[axisCount];
+
+	/**
+	 * Get the index of a queue entry
+	 * @param	offset		the offset from the head of the queue
+	 */
+	INLINE uint8_t index(uint8_t offset) {
+		uint8_t i = _head + offset;
+		return (i >= queueLength) ? i - queueLength : i;
+	}
+
+	/**
+	 * Start executing the move at the head of the queue, from the ramp positions replan() found
+	 * @pre _count > 0
+	 */
+	void startSegment() {
+		StepperSegment<axisCount> *segment = &_queue[_head];
+		StepperSpeed exit = {0, 0};
+
+		// The exit speed is committed now, so the next move's entry can no longer be replanned
+		_committedExit = 0;
+		if (_count > 1) {
+			StepperSegment<axisCount> *next = &_queue[index(1)];
+			_committedExit = next->entry;
+			exit = next->entryRamp;
+		}
+		_profile.start(segment->major, segment->entryRamp, segment->cruiseRamp, exit);
+
+		for (uint8_t axis = 0; axis < axisCount; axis++) {
+			_error[axis] = segment->major / 2;
+		}
+	}
+
+	/**
+	 * Recalculate the entry speeds of the queued moves
+	 * A backward pass limits each entry so the following moves can decelerate to a stop at the end of the queue,
+	 * then a forward pass limits each entry to what the previous move can accelerate to.
+	 * The entries are also found as ramp positions here, so starting a move in the interrupt doesn't divide
+	 */
+	void replan() {
+		float entries[queueLength];
+		StepperSpeed ramps[queueLength];
+
+		for (;;) {
+			uint8_t head;
+			uint8_t count;
+			bool running;
+			float fixedEntry;
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				head = _head;
+				count = _count;
+				running = _running;
+				fixedEntry = running ? _committedExit : 0;
+			}
+
+			// The executing move and the entry of the move after it are fixed
+			uint8_t first = running ? 1 : 0;
+			if (first >= count) {
+				return;
+			}
+
+			float twiceAcceleration = 2.0f * _profile.getAcceleration();
+			float next = 0;
+			for (uint8_t offset = count - 1; offset > first; offset--) {
+				StepperSegment<axisCount> *segment = &_queue[(head + offset) % queueLength];
+				float limit = sqrt(next * next + twiceAcceleration * segment->major);
+				entries[offset] = (segment->maxEntry < limit) ? segment->maxEntry : limit;
+				next = entries[offset];
+			}
+			entries[first] = fixedEntry;
+
+			for (uint8_t offset = first; offset + 1 < count; offset++) {
+				StepperSegment<axisCount> *segment = &_queue[(head + offset) % queueLength];
+				float limit = sqrt(entries[offset] * entries[offset] + twiceAcceleration * segment->major);
+				if (entries[offset + 1] > limit) {
+					entries[offset + 1] = limit;
+				}
+			}
+
+			for (uint8_t offset = first; offset < count; offset++) {
+				ramps[offset] = _profile.speed(entries[offset]);
+			}
+
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				if (head == _head && running == _running) {
+					for (uint8_t offset = first; offset < count; offset++) {
+						StepperSegment<axisCount> *segment = &_queue[(head + offset) % queueLength];
+						segment->entry = entries[offset];
+						segment->entryRamp = ramps[offset];
+					}
+					return;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Take a step on the major axis, interleave the other axes, and schedule the next step
+	 * The interval to the next step was calculated at the step before, so it is set before the timer can pass it,
+	 * and the interval after is calculated while waiting
+	 * @return true if the counter was already past the next step's top, so that step is due now
+	 */
+	bool step() {
+		StepperSegment<axisCount> *segment = &_queue[_head];
+		for (uint8_t axis = 0; axis < axisCount; axis++) {
+			_error[axis] += segment->steps[axis];
+			if (_error[axis] >= segment->major) {
+				_error[axis] -= segment->major;
+				_axes[axis]->advance(segment->forward & _BV(axis));
+			}
+		}
+
+		uint16_t delay = _nextDelay;
+		if (!delay) {
+			_head = index(1);
+			if (--_count) {
+				startSegment();
+				delay = _profile.delay();
+			} else {
+				_running = false;
+				_timer.disable();
+				for (uint8_t axis = 0; axis < axisCount; axis++) {
+					_axes[axis]->idle();
+				}
+				return false;
+			}
+		}
+
+		_timer.setTop(delay - 1);
+		bool late = _timer.current() > delay - 1;
+
+		_nextDelay = _profile.next();
+		return late;
+	}
+
+public:
+	/**
+	 * Create a new StepperPlanner
+	 * @param	timer	the timer to take steps from, this planner becomes its listener
+	 */
+	StepperPlanner(Timer &timer) :
+			_timer(timer),
+			_head(0),
+			_count(0),
+			_running(false),
+			_committedExit(0),
+			_nextDelay(0),
+			_junctionSpeed(100) {
+		for (uint8_t axis = 0; axis < axisCount; axis++) {
+			_axes[axis] = NULL;
+			_planned[axis] = 0;
+		}
+
+		_timer.setListener1(this);
+	}
+
+	/**
+	 * Attach a motor to an axis
+	 * @param	axis	the index of the axis
+	 * @param	motor	the motor that moves the axis
+	 */
+	void setAxis(uint8_t axis, StepperMotor &motor) {
+		_axes[axis] = &motor;
+		_planned[axis] = motor.getPosition();
+	}
+
+	/**
+	 * Set the acceleration and deceleration of the axis moving furthest in each move
+	 * @param	acceleration	the acceleration in steps/second/second
+	 */
+	void setAcceleration(uint32_t acceleration) {
+		_profile.setAcceleration(acceleration);
+	}
+
+	/**
+	 * Set how abruptly the speed of an axis may change at the junction of two moves
+	 * @param	junctionSpeed	the largest instantaneous change in speed of any axis, in steps/second
+	 */
+	void setJunctionSpeed(uint16_t junctionSpeed) {
+		_junctionSpeed = junctionSpeed;
+	}
+
+	/**
+	 * Queue a straight line move
+	 * @param	target	the position to move each axis to, in steps
+	 * @param	speed	the speed along the line, in steps/second
+	 * @return false if the queue is full
+	 */
+	bool addMove(const int32_t *target, uint16_t speed) {
+		if (_count >= queueLength) {
+			return false;
+		}
+
+		// The prescaler is only readable while the timer is running, so capture it on the first move
+		if (!_profile.getFrequency()) {
+			_profile.setFrequency(F_CPU / _timer.getPrescalerMultiplier());
+		}
+
+		// The interrupt can advance the head while we look, so take the indices together
+		uint8_t count;
+		StepperSegment<axisCount> *segment;
+		StepperSegment<axisCount> *previous;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			count = _count;
+			segment = &_queue[index(count)];
+			previous = count ? &_queue[index(count - 1)] : NULL;
+		}
+
+		float length = 0;
+
+		segment->forward = 0;
+		segment->major = 0;
+		for (uint8_t axis = 0; axis < axisCount; axis++) {
+			int32_t delta = target[axis] - _planned[axis];
+			if (delta >= 0) {
+				segment->forward |= _BV(axis);
+			} else {
+				delta = -delta;
+			}
+			segment->steps[axis] = delta;
+			if ((uint32_t)delta > segment->major) {
+				segment->major = delta;
+			}
+			length += (float)delta * delta;
+		}
+
+		if (!segment->major) {
+			return true;
+		}
+
+		length = sqrt(length);
+		float majorSpeed = speed * segment->major / length;
+		segment->speed = (majorSpeed < 1.0f) ? 1 : majorSpeed;
+		segment->cruiseRamp = _profile.speed(segment->speed);
+		segment->entry = 0;
+		segment->entryRamp = _profile.speed(0);
+
+		// At the junction both moves run their major axis at the same rate, limit it by the largest change of any axis
+		segment->maxEntry = 0;
+		if (previous) {
+			float jump = 0;
+			for (uint8_t axis = 0; axis < axisCount; axis++) {
+				float before = (float)previous->steps[axis] / previous->major;
+				float after = (float)segment->steps[axis] / segment->major;
+				if (!(previous->forward & _BV(axis))) {
+					before = -before;
+				}
+				if (!(segment->forward & _BV(axis))) {
+					after = -after;
+				}
+				float difference = fabs(before - after);
+				if (difference > jump) {
+					jump = difference;
+				}
+			}
+
+			float limit = (segment->speed < previous->speed) ? segment->speed : previous->speed;
+			if (jump * limit > _junctionSpeed) {
+				limit = _junctionSpeed / jump;
+			}
+			segment->maxEntry = limit;
+		}
+
+		for (uint8_t axis = 0; axis < axisCount; axis++) {
+			_planned[axis] = target[axis];
+		}
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			_count++;
+		}
+
+		replan();
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (!_running && _count) {
+				_running = true;
+				startSegment();
+				_timer.setTop(_profile.delay() - 1);
+				_nextDelay = _profile.next();
+				_timer.enable();
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * Get the number of moves waiting or in progress
+	 * @return the number of moves in the queue
+	 */
+	uint8_t queued() {
+		return _count;
+	}
+
+	/**
+	 * Check if another move can be queued
+	 * @return true if the queue is full
+	 */
+	bool full() {
+		return _count >= queueLength;
+	}
+
+	/**
+	 * Are the motors moving?
+	 * @return true if a move is in progress
+	 */
+	bool isMoving() {
+		return _running;
+	}
+
+	/**
+	 * Take a step on the major axis, interleave the other axes, and schedule the next step
+	 */
+	void alarm(UNUSED AlarmSource source) {
+		if (!_running) {
+			_timer.disable();
+			return;
+		}
+
+		while (step()) {
+			// The compare match was missed, take the step now and time the next from here
+			_timer.setCurrent(0);
+		}
+	}
+};
+
+}
+
+#endif /* FLAME_STEPPERPLANNER_H_ */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2014, Inferno Embedded
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of the Inferno Embedded nor the
+ *    names of its contributors may be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL INFERNO EMBEDDED BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FLAME_STEPPERPROFILE_H_
+#define FLAME_STEPPERPROFILE_H_
+
+#include <flame/io.h>
+
+namespace flame {
+
+enum class StepperProfileState : uint8_t {
+	IDLE,
+	ACCELERATE,
+	CRUISE,
+	DECELERATE,
+	EXIT
+};
+
+/**
+ * A speed as a position on the acceleration ramp, from StepperProfile::speed
+ */
+struct StepperSpeed {
+	uint32_t		count;		// steps to accelerate from rest to the speed
+	uint16_t		delay;		// interval between steps at the speed, in timer ticks
+};
+
+/**
+ * Generates the intervals between steps for a trapezoidal speed profile, using the integer
+ * approximation from Atmel application note AVR446 (Linear speed control of stepper motor)
+ *
+ * The setters use floating point, start() & next() only use integer arithmetic so they can be called from an ISR.
+ * Starting from speeds in steps/second divides, to keep that out of an ISR find the speeds with speed()
+ * beforehand and start from those
+ */
+class StepperProfile {
+private:
+	uint32_t				_frequency;
+	uint32_t				_acceleration;
+	uint16_t				_firstDelay;
+	uint32_t				_steps;
+	uint32_t				_step;
+	uint32_t				_decelStart;
+	int32_t					_accelCount;
+	uint32_t				_peakCount;
+	uint32_t				_exitCount;
+	uint16_t				_delay;
+	uint16_t				_minDelay;
+	int32_t					_rest;
+	StepperProfileState		_state;
+
+	uint32_t speedCount(uint16_t speed) PURE;
+	uint16_t speedDelay(uint16_t speed) PURE;
+	void ramp();
+	void decelerate(uint32_t count);
+
+public:
+	StepperProfile();
+	void setFrequency(uint32_t frequency);
+	void setAcceleration(uint32_t acceleration);
+	uint32_t getFrequency() PURE;
+	uint32_t getAcceleration() PURE;
+	StepperSpeed speed(uint16_t speed) PURE;
+	void start(uint32_t steps, uint16_t entrySpeed, uint16_t maxSpeed, uint16_t exitSpeed);
+	void start(uint32_t steps, const StepperSpeed &entry, const StepperSpeed &cruise, const StepperSpeed &exit);
+	void stop();
+	uint16_t delay() PURE;
+	uint16_t next();
+	bool active() PURE;
+	uint32_t remaining() PURE;
+};
+
+}
+
+#endif /* FLAME_STEPPERPROFILE_H_ */
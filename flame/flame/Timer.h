@@ -324,6 +324,7 @@ public:
 
 	virtual uint16_t getTop() =0;
 	virtual void setTop(uint16_t value) =0;
+	virtual uint16_t getMaximumTop() =0;
 	virtual void setOutput(uint8_t channel, uint16_t value) =0;
 	virtual void setOutput1(uint16_t value) =0;
 	virtual void setOutput2(uint16_t value) =0;
@@ -706,6 +707,14 @@ public:
 		}
 	}
 
+	/**
+	 * Get the largest value that can be passed to setTop
+	 * @return the largest top the counter can hold
+	 */
+	uint16_t getMaximumTop() {
+		return (8 == bits) ? 0xff : 0xffff;
+	}
+
 	/**
 	 * Set the number of timer cycles available
 	 * @param	value	the number of cycles in an iteration of the timer
@@ -988,7 +997,7 @@ public:
 				_SFR_MEM8(interruptMask) |= _BV(interruptEnableA);
 			}
 
-			if (_SFR_MEM8(outputCompare2) && _listener2) {
+			if (((16 == bits) ? _SFR_MEM16(outputCompare2) : _SFR_MEM8(outputCompare2)) && _listener2) {
 				_SFR_MEM8(interruptMask) |= _BV(interruptEnableA + 1);
 				_haveTime2 = true;
 			} else {
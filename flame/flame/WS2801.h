@@ -38,9 +38,14 @@ namespace flame {
  * @tparam	clock...	the clock pin for the LEDs
  * @tparam	data...		the data pin for the LEDs, must be on the same port as the clock
  * @tparam	length		the number of LEDs in the string
+ * @tparam	dither		temporally dither the output, see RGBLEDStrip
+ * @tparam	gamma		the gamma exponent for the LEDs, in hundredths
  */
-template <FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), uint16_t length>
-class WS2801 : public RGBLEDStrip<length> {
+template <FLAME_DECLARE_PIN(clock), FLAME_DECLARE_PIN(data), uint16_t length, bool dither = false,
+		uint16_t gamma = FLAME_GAMMA_DEFAULT>
+class WS2801 : public RGBLEDStrip<length, dither, gamma> {
+	typedef RGBLEDStrip<length, dither, gamma> Strip;
+
 private:
 	ShifterImplementation<FLAME_PIN_PARMS(clock), FLAME_PIN_PARMS(data), true, true, 2>
 				_shifter;
@@ -58,8 +63,27 @@ public:
 	 * Write the current buffer to the string of chips
 	 */
 	void flush() {
-		_shifter.shiftOut((uint8_t *)RGBLEDStrip<length>::_data,
-				FLAME_BYTESIZEOF(*RGBLEDStrip<length>::_data), length);
+		uint16_t start = Strip::_start;
+
+		if (dither) {
+			// Each byte goes through the dither accumulators, still starting at _start
+			uint16_t index = start * 3;
+			for (uint16_t count = length * 3; count; count--) {
+				_shifter.shiftOut(Strip::ditherByte(((uint8_t *)Strip::_data)[index], index));
+				if (++index == length * 3) {
+					index = 0;
+				}
+			}
+			return;
+		}
+
+		// The buffer is a ring, the first logical pixel is at _start
+		_shifter.shiftOut((uint8_t *)(Strip::_data + start),
+				FLAME_BYTESIZEOF(*Strip::_data), length - start);
+		if (start) {
+			_shifter.shiftOut((uint8_t *)Strip::_data,
+					FLAME_BYTESIZEOF(*Strip::_data), start);
+		}
 	}
 };
 
@@ -42,309 +42,668 @@ namespace flame {
  * @tparam	dataPin...		the data pin for the LEDs (This must be the same pin that Output2 (OCRnB) is on)
  * @tparam	length		the number of LEDs in the string
  * @tparam  timer		the timer parameters
+ * @tparam	dither		temporally dither the output, see RGBLEDStrip. Only the 16MHz and 20MHz
+ * 						loops have the spare cycles within each byte to do this
+ * @tparam	gamma		the gamma exponent for the LEDs, in hundredths
  */
-template<FLAME_DECLARE_PIN(dataPin), uint16_t length>
-class WS2811: public RGBLEDStrip<length> {
-public:
-	/**
-	 * Constructor
-	 */
-	WS2811() {
-		setOutput(FLAME_PIN_PARMS(dataPin));
-		pinOff(FLAME_PIN_PARMS(dataPin));
-	}
+template<FLAME_DECLARE_PIN(dataPin), uint16_t length, bool dither = false,
+		uint16_t gamma = FLAME_GAMMA_DEFAULT>
+class WS2811: public RGBLEDStrip<length, dither, gamma> {
+private:
+	typedef RGBLEDStrip<length, dither, gamma> Strip;
 
 	/**
-	 * Write the current buffer to the string of chips
+	 * Write a contiguous run of bytes to the string of chips
+	 * Must be called with interrupts disabled
+	 * @param	data		the first byte to write
+	 * @param	remaining	the number of bytes to write
+	 * @param	maskhi		the port value with the data pin high
+	 * @param	masklo		the port value with the data pin low
 	 */
-	void flush() {
-		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-			uint8_t masklo = _MMIO_BYTE(dataPinOut) & ~_BV(dataPinPin);
-			uint8_t maskhi = _MMIO_BYTE(dataPinOut) | _BV(dataPinPin);
-			uint8_t currentByte;
-			uint8_t bitCount;
-			uint16_t remaining = length * 3;
-			uint8_t *data = (uint8_t *)RGBLEDStrip<length>::_data;
+	INLINE void writeSegment(uint8_t *data, uint16_t remaining, uint8_t maskhi, uint8_t masklo) {
+		uint8_t currentByte;
+		uint8_t bitCount;
 
 #if   F_CPU == 20000000
-			/* The total length of each bit is 1.25us(25 cycles @ 20Mhz / 50ns per cyc)
-			 * * At 0us the dataline is pulled high.
-			 * * To send a zero the dataline is pulled low after 0.350us (7 cyc)
-			 * * To send a one the dataline is pulled low after 0.700us (14 cyc)
-			 * After the entire bitstream has been written, the dataout pin has to remain low
-			 * for at least 50us (reset condition).
-			 * Data transfer time( H+L=1.25us600ns)
-			 * 0H: high time 0.35us 150ns (7 cyc = 0.35us )
-			 * 0L: low time 0.8us 150ns (18 cyc = 0.9us 100ns more, but within tolerance )
-			 * 1H: high time 0.7us 150ns (14 cyc = 0.7us )
-			 * 1L: low time 0.6us 150ns (11 cyc = 0.55us 50ns less, but within tolerance)
-			 */
+		/* The total length of each bit is 1.25us(25 cycles @ 20Mhz / 50ns per cyc)
+		 * * At 0us the dataline is pulled high.
+		 * * To send a zero the dataline is pulled low after 0.350us (7 cyc)
+		 * * To send a one the dataline is pulled low after 0.700us (14 cyc)
+		 * After the entire bitstream has been written, the dataout pin has to remain low
+		 * for at least 50us (reset condition).
+		 * Data transfer time( H+L=1.25us600ns)
+		 * 0H: high time 0.35us 150ns (7 cyc = 0.35us )
+		 * 0L: low time 0.8us 150ns (18 cyc = 0.9us 100ns more, but within tolerance )
+		 * 1H: high time 0.7us 150ns (14 cyc = 0.7us )
+		 * 1L: low time 0.6us 150ns (11 cyc = 0.55us 50ns less, but within tolerance)
+		 */
+
+		while (remaining--) {
+			currentByte = *data++;
 
-			while (remaining--) {
-				currentByte = *data++;
-
-				asm volatile(
-						"		ldi %0,8			\n\t"	// 0
-						"loop%=:out %2, %3			\n\t"	// 1
-						"		lsl %1				\n\t"	// 2
-						"		dec %0				\n\t"	// 3
-
-						"		rjmp .+0			\n\t"	// 5
-						"		nop					\n\t"	// 6
-						"		brcs .+2			\n\t"	// 7l / 8h
-						"		out %2, %4			\n\t"	// 8l / -
-
-						"		rjmp .+0			\n\t"	// 10
-						"		rjmp .+0			\n\t"	// 12
-						"		rjmp .+0			\n\t"	// 14
-						"		out %2, %4			\n\t"	// 15
-						"		breq end%=			\n\t"	// 16 nt. 17 taken
-
-						"		rjmp .+0			\n\t"	// 18
-						"		rjmp .+0			\n\t"	// 20
-						"		rjmp .+0			\n\t"	// 22
-						"		nop					\n\t"	// 23
-						"		rjmp loop%=			\n\t"	// 25
-						"end%=:						\n\t"
-						: "=&d" (bitCount)
-						: "r" (currentByte), "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo)
-				);
-			}
+			asm volatile(
+					"		ldi %0,8			\n\t"	// 0
+					"loop%=:out %2, %3			\n\t"	// 1
+					"		lsl %1				\n\t"	// 2
+					"		dec %0				\n\t"	// 3
+
+					"		rjmp .+0			\n\t"	// 5
+					"		nop					\n\t"	// 6
+					"		brcs .+2			\n\t"	// 7l / 8h
+					"		out %2, %4			\n\t"	// 8l / -
+
+					"		rjmp .+0			\n\t"	// 10
+					"		rjmp .+0			\n\t"	// 12
+					"		rjmp .+0			\n\t"	// 14
+					"		out %2, %4			\n\t"	// 15
+					"		breq end%=			\n\t"	// 16 nt. 17 taken
+
+					"		rjmp .+0			\n\t"	// 18
+					"		rjmp .+0			\n\t"	// 20
+					"		rjmp .+0			\n\t"	// 22
+					"		nop					\n\t"	// 23
+					"		rjmp loop%=			\n\t"	// 25
+					"end%=:						\n\t"
+					: "=&d" (bitCount), "+r" (currentByte)
+					: "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo)
+			);
+		}
 #elif F_CPU == 16000000 || F_CPU == 16500000
-			/*	The total length of each bit is 1.25us (20 cycles @ 16Mhz)
-			 * * At 0us the dataline is pulled high.
-			 * * To send a zero the dataline is pulled low after 0.375us (6 cycles).
-			 * * To send a one the dataline is pulled low after 0.625us (10 cycles).
-			 * After the entire bitstream has been written, the dataout pin has to remain low
-			 * for at least 50uS (reset condition).
-			 * Due to the loop overhead there is a slight timing error: The loop will execute
-			 * in 21 cycles for the last bit write. This does not cause any issues though,
-			 * as only the timing between the rising and the falling edge seems to be critical.
-			 * Some quick experiments have shown that the bitstream has to be delayed by
-			 * more than 3us until it cannot be continued (3us=48 cyles).
-			 */
+		/*	The total length of each bit is 1.25us (20 cycles @ 16Mhz)
+		 * * At 0us the dataline is pulled high.
+		 * * To send a zero the dataline is pulled low after 0.375us (6 cycles).
+		 * * To send a one the dataline is pulled low after 0.625us (10 cycles).
+		 * After the entire bitstream has been written, the dataout pin has to remain low
+		 * for at least 50uS (reset condition).
+		 * Due to the loop overhead there is a slight timing error: The loop will execute
+		 * in 21 cycles for the last bit write. This does not cause any issues though,
+		 * as only the timing between the rising and the falling edge seems to be critical.
+		 * Some quick experiments have shown that the bitstream has to be delayed by
+		 * more than 3us until it cannot be continued (3us=48 cyles).
+		 */
+
+		while (remaining--) {
+			currentByte = *data++;
 
-			while (remaining--) {
-				currentByte = *data++;
-
-				asm volatile(
-						"		ldi %0,8		\n\t"	// 0
-						"loop%=:out %2, %3		\n\t"	// 1
-						"		lsl %1			\n\t"	// 2
-						"		dec %0			\n\t"	// 3
-
-						"		rjmp .+0		\n\t"	// 5
+			asm volatile(
+					"		ldi %0,8		\n\t"	// 0
+					"loop%=:out %2, %3		\n\t"	// 1
+					"		lsl %1			\n\t"	// 2
+					"		dec %0			\n\t"	// 3
 
-						"		brcs .+2		\n\t"	// 6l / 7h
-						"		out %2, %4		\n\t"	// 7l / -
+					"		rjmp .+0		\n\t"	// 5
 
-						"		rjmp .+0		\n\t"	// 9
+					"		brcs .+2		\n\t"	// 6l / 7h
+					"		out %2, %4		\n\t"	// 7l / -
 
-						"		nop				\n\t"	// 10
-						"		out %2, %4		\n\t"	// 11
-						"		breq end%=		\n\t"	// 12 nt. 13 taken
+					"		rjmp .+0		\n\t"	// 9
 
-						"		rjmp .+0		\n\t"	// 14
-						"		rjmp .+0		\n\t"	// 16
-						"		rjmp .+0		\n\t"	// 18
-						"		rjmp loop%=		\n\t"	// 20
-						"end%=:					\n\t"
-						: "=&d" (bitCount)
-						: "r" (currentByte), "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo)
-				);
-			}
-#elif F_CPU == 12000000
-			/*	The total length of each bit is 1.25us (15 cycles @ 12Mhz)
-			 * * At 0us the dataline is pulled high. (cycle 1+0)
-			 * * To send a zero the dataline is pulled low after 0.333us (1+4=5 cycles).
-			 * * To send a one the dataline is pulled low after 0.666us (1+8=9 cycles).
-			 *
-			 * Total loop timing is correct, but the timing for the falling edge can
-			 * not be accurately reached as the correct 0.375us (4.5 cyc.) and 0.675us (7.5 cyc)
-			 * timings fall in between cycles.
-			 * Final timing:
-			 * * 15 cycles for bits 7-1
-			 * * 16 cycles for bit 0
-			 * - The bit 0 timing exceeds the 1.25us bit-timing by 66.7ns, which is still
-			 * within datasheet tolerances (600ns)
-			 */
-			asm volatile(
-					"		in %0,%2		\n\t"
-					"		or %3,%0		\n\t"
-					"		and %4,%0		\n\t"
-					"olop%=:subi %A6,1		\n\t"	// 12
-					"		sbci %B6,0		\n\t"	// 13
-					"		brcs exit%=		\n\t"	// 14
-					"		ld %1,X+		\n\t"	// 15
-					"		ldi %0,8		\n\t"	// 16
+					"		nop				\n\t"	// 10
+					"		out %2, %4		\n\t"	// 11
+					"		breq end%=		\n\t"	// 12 nt. 13 taken
 
-					"loop%=:out %2, %3		\n\t"	// 1
-					"		lsl %1			\n\t"	// 2
-					"		nop				\n\t"	// 3
-
-					"		brcs .+2		\n\t"	// 4nt / 5t
-					"		out %2, %4		\n\t"	// 5
-					"		dec %0			\n\t"	// 6
-					"		rjmp .+0		\n\t"	// 8
-					"		out %2, %4		\n\t"	// 9
-					"		breq olop%=		\n\t"	// 10nt / 11t
-					"		nop				\n\t"	// 11
-					"		rjmp .+0		\n\t"	// 13
-					"		rjmp loop%=		\n\t"	// 15
-					"exit%=:				\n\t"
-					: "=&d" (bitCount)
-					: "r" (currentByte), "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo), "x" (data), "r" (remaining)
+					"		rjmp .+0		\n\t"	// 14
+					"		rjmp .+0		\n\t"	// 16
+					"		rjmp .+0		\n\t"	// 18
+					"		rjmp loop%=		\n\t"	// 20
+					"end%=:					\n\t"
+					: "=&d" (bitCount), "+r" (currentByte)
+					: "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo)
 			);
+		}
+#elif F_CPU == 12000000
+		/*	The total length of each bit is 1.25us (15 cycles @ 12Mhz)
+		 * * At 0us the dataline is pulled high. (cycle 1+0)
+		 * * To send a zero the dataline is pulled low after 0.333us (1+4=5 cycles).
+		 * * To send a one the dataline is pulled low after 0.666us (1+8=9 cycles).
+		 *
+		 * Total loop timing is correct, but the timing for the falling edge can
+		 * not be accurately reached as the correct 0.375us (4.5 cyc.) and 0.675us (7.5 cyc)
+		 * timings fall in between cycles.
+		 * Final timing:
+		 * * 15 cycles for bits 7-1
+		 * * 16 cycles for bit 0
+		 * - The bit 0 timing exceeds the 1.25us bit-timing by 66.7ns, which is still
+		 * within datasheet tolerances (600ns)
+		 */
+		asm volatile(
+				"		in %0,%6		\n\t"
+				"		or %4,%0		\n\t"
+				"		and %5,%0		\n\t"
+				"olop%=:subi %A3,1		\n\t"	// 12
+				"		sbci %B3,0		\n\t"	// 13
+				"		brcs exit%=		\n\t"	// 14
+				"		ld %1,X+		\n\t"	// 15
+				"		ldi %0,8		\n\t"	// 16
+
+				"loop%=:out %6, %4		\n\t"	// 1
+				"		lsl %1			\n\t"	// 2
+				"		nop				\n\t"	// 3
+
+				"		brcs .+2		\n\t"	// 4nt / 5t
+				"		out %6, %5		\n\t"	// 5
+				"		dec %0			\n\t"	// 6
+				"		rjmp .+0		\n\t"	// 8
+				"		out %6, %5		\n\t"	// 9
+				"		breq olop%=		\n\t"	// 10nt / 11t
+				"		nop				\n\t"	// 11
+				"		rjmp .+0		\n\t"	// 13
+				"		rjmp loop%=		\n\t"	// 15
+				"exit%=:				\n\t"
+				: "=&d" (bitCount), "=&r" (currentByte), "+x" (data), "+d" (remaining), "+r" (maskhi), "+r" (masklo)
+				: "I" (dataPinOut - __SFR_OFFSET)
+		);
 #elif F_CPU ==  9600000
-			/* The total length of each bit is 1.25us (12 cycles @ 9.6Mhz)
-			 * * At 0us the dataline is pulled high. (cycle 1)
-			 * * To send a zero the dataline is pulled low after 0.312us (1+3=4 cycles) (error 0.06us)
-			 * * To send a one the dataline is pulled low after 0.625us (1+6=7 cycles) (no error).
-			 *
-			 * 12 cycles can not be reached for bit 0 write. However since the timing
-			 * between the rising and falling edge is correct, it seems to be acceptable
-			 * to slightly increase bit timing
-			 *
-			 * Final timing:
-			 * * 12 cycles for bits 7-1
-			 * * 15 cycles for bit 0
-			 *
-			 * - The bit 0 timing exceeds the 1.25us timing by 312ns, which is still within
-			 * datasheet tolerances (600ns).
-			 */
-			asm volatile(
-					"		in %0,%2		\n\t"
-					"		or %3,%0		\n\t"
-					"		and %4,%0		\n\t"
-					"olop%=:subi %A6,1		\n\t"	// 10
-					"		sbci %B6,0		\n\t"	// 11
-					"		brcs exit%=		\n\t"	// 12
-					"		ld %1,X+		\n\t"	// 14
-					"		ldi %0,8		\n\t"	// 15
-
-					"loop%=:out %2, %3		\n\t"	// 1
-					"		lsl %1			\n\t"	// 2
-
-					"		brcs .+2		\n\t"	// 3nt / 4t
-					"		out %2, %4		\n\t"	// 4
-					"		dec %0			\n\t"	// 5
-					"		nop				\n\t"	// 6
-					"		out %2, %4		\n\t"	// 7
-					"		breq olop%=		\n\t"	// 8nt / 9t
-					"		rjmp .+0		\n\t"	// 10
-					"		rjmp loop%=		\n\t"	// 12
-					"exit%=: \n\t"
-					: "=&d" (bitCount)
-					: "r" (currentByte), "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo), "x" (data), "r" (remaining)
-			);
+		/* The total length of each bit is 1.25us (12 cycles @ 9.6Mhz)
+		 * * At 0us the dataline is pulled high. (cycle 1)
+		 * * To send a zero the dataline is pulled low after 0.312us (1+3=4 cycles) (error 0.06us)
+		 * * To send a one the dataline is pulled low after 0.625us (1+6=7 cycles) (no error).
+		 *
+		 * 12 cycles can not be reached for bit 0 write. However since the timing
+		 * between the rising and falling edge is correct, it seems to be acceptable
+		 * to slightly increase bit timing
+		 *
+		 * Final timing:
+		 * * 12 cycles for bits 7-1
+		 * * 15 cycles for bit 0
+		 *
+		 * - The bit 0 timing exceeds the 1.25us timing by 312ns, which is still within
+		 * datasheet tolerances (600ns).
+		 */
+		asm volatile(
+				"		in %0,%6		\n\t"
+				"		or %4,%0		\n\t"
+				"		and %5,%0		\n\t"
+				"olop%=:subi %A3,1		\n\t"	// 10
+				"		sbci %B3,0		\n\t"	// 11
+				"		brcs exit%=		\n\t"	// 12
+				"		ld %1,X+		\n\t"	// 14
+				"		ldi %0,8		\n\t"	// 15
+
+				"loop%=:out %6, %4		\n\t"	// 1
+				"		lsl %1			\n\t"	// 2
+
+				"		brcs .+2		\n\t"	// 3nt / 4t
+				"		out %6, %5		\n\t"	// 4
+				"		dec %0			\n\t"	// 5
+				"		nop				\n\t"	// 6
+				"		out %6, %5		\n\t"	// 7
+				"		breq olop%=		\n\t"	// 8nt / 9t
+				"		rjmp .+0		\n\t"	// 10
+				"		rjmp loop%=		\n\t"	// 12
+				"exit%=: \n\t"
+				: "=&d" (bitCount), "=&r" (currentByte), "+x" (data), "+d" (remaining), "+r" (maskhi), "+r" (masklo)
+				: "I" (dataPinOut - __SFR_OFFSET)
+		);
 #elif F_CPU ==  8000000
-			/* 	The total length of each bit is 1.25us (10 cycles @ 8Mhz)
-			 * * At 0us the dataline is pulled high. (cycle 1+0=1)
-			 * * To send a zero the dataline is pulled low after 0.375us (1+3=4 cycles).
-			 * * To send a one the dataline is pulled low after 0.625us (1+5=6 cycles).
-			 *
-			 * Final timing:
-			 * * 10 cycles for bits 7-1
-			 * * 14 cycles for bit 0
-			 * - The bit 0 timing exceeds the 1.25us bit-timing by 500ns, which is still
-			 * within datasheet tolerances (600ns)
+		/* 	The total length of each bit is 1.25us (10 cycles @ 8Mhz)
+		 * * At 0us the dataline is pulled high. (cycle 1+0=1)
+		 * * To send a zero the dataline is pulled low after 0.375us (1+3=4 cycles).
+		 * * To send a one the dataline is pulled low after 0.625us (1+5=6 cycles).
+		 *
+		 * Final timing:
+		 * * 10 cycles for bits 7-1
+		 * * 14 cycles for bit 0
+		 * - The bit 0 timing exceeds the 1.25us bit-timing by 500ns, which is still
+		 * within datasheet tolerances (600ns)
+		 */
+		asm volatile(
+				"		in %0,%6		\n\t"
+				"		or %4,%0		\n\t"
+				"		and %5,%0		\n\t"
+				"olop%=:subi %A3,1		\n\t"	// 9
+				"		sbci %B3,0		\n\t"	// 10
+				"		brcs exit%=		\n\t"	// 11
+				"		ld %1,X+		\n\t"	// 13
+				"		ldi %0,8		\n\t"	// 14
+
+				"loop%=:out %6, %4		\n\t"	// 1
+				"		lsl %1			\n\t"	// 2
+
+				"		brcs .+2		\n\t"	// 3nt / 4t
+				"		out %6, %5		\n\t"	// 4
+				"		dec %0			\n\t"	// 5
+				"		out %6, %5		\n\t"	// 6
+				"		breq olop%=		\n\t"	// 7nt / 8t
+				"		nop				\n\t"	// 8
+				"		rjmp loop%=		\n\t"	// 10
+				"exit%=:				\n\t"
+				: "=&d" (bitCount), "=&r" (currentByte), "+x" (data), "+d" (remaining), "+r" (maskhi), "+r" (masklo)
+				: "I" (dataPinOut - __SFR_OFFSET)
+		);
+#elif F_CPU ==  4000000
+		/* The total length of each bit is 1.25us (5 cycles @ 4Mhz)
+		 * * At 0us the dataline is pulled high. (cycle 0+1)
+		 * * To send a zero the dataline is pulled low after 0.5us (spec: 0.375us) (2+1=3 cycles).
+		 * * To send a one the dataline is pulled low after 0.75us (spec: 0.625us) (3+1=4 cycles).
+		 *
+		 * The timing of this implementation is slightly off, however it seems to
+		 * work empirically.
+		 * Final timing:
+		 * * 5 cycles for bits 7-1
+		 * * 6 cycles for bit 0
+		 * - The bit 0 timing exceeds the 1.25us timing by 250ns, which is still within
+		 * the tolerances stated in the datasheet (600 ns).
+		 */
+		asm volatile(
+				"		ld %0,X				\n\t"
+
+				"olop%=:out %4, %5			\n\t"	// 1
+				"		sbrs %0,7			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		subi r26,-1			\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %0,6			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		sbci r27,-1			\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %0,5			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		mov %1,%0			\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %1,4			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		nop 				\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %1,3			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		nop					\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %1,2			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		ld %0,X				\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %1,1			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+				"		dec %3				\n\t"	// 5
+
+				"		out %4, %5			\n\t"	// 1
+				"		sbrs %1,0			\n\t"	// 2
+				"		out %4, %6			\n\t"	// 3
+				"		out %4, %6			\n\t"	// 4
+
+				"		brne olop%=			\n\t"	// 6
+
+				: "=&d" (bitCount), "=&d" (currentByte), "+x" (data), "+r" (remaining)
+				: "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo)
+		);
+#else
+#error Clock speed not supported
+#endif
+	} // void writeSegment()
+
+	/**
+	 * Gamma correct, dither and write the whole ring buffer to the string of chips
+	 * The bits of each byte are unrolled, and the next byte is worked out in the cycles each bit
+	 * spends waiting, so the timing is the same as writeSegment. The first byte is worked out
+	 * before the line is raised, and the ring wraps between bytes.
+	 * Must be called with interrupts disabled
+	 * @param	data		the strip buffer
+	 * @param	index		the offset of the first byte to write
+	 * @param	maskhi		the port value with the data pin high
+	 * @param	masklo		the port value with the data pin low
+	 */
+	INLINE void writeDithered(uint8_t *data, uint16_t index, uint8_t maskhi, uint8_t masklo) {
+#if F_CPU == 20000000 || F_CPU == 16000000 || F_CPU == 16500000
+		const uint16_t *table = Strip::ditherTable();
+		uint8_t *end = data + length * 3;
+		uint8_t currentByte = Strip::ditherByte(data[index], index);
+		uint16_t remaining = length * 3 - 1;
+
+		if (++index == length * 3) {
+			index = 0;
+		}
+		uint8_t *next = data + index;
+		uint8_t *error = Strip::ditherError(index);
+		uint8_t odd = index & 1;
+
+		uint8_t nextByte;
+		uint8_t raw;
+		uint8_t frac;
+		uint8_t err;
+		uint8_t acc;
+		uint16_t saved;
+
+		while (remaining--) {
+#if F_CPU == 20000000
+			/* The timing of writeSegment, 25 cycles per bit with the line pulled low after 7 cycles
+			 * for a zero and 14 for a one. The rest of each bit works through Strip::ditherByte for
+			 * the next byte: the 12 bit table lookup, adding the bottom 4 bits to the byte's
+			 * accumulator (the high nibble for odd bytes), and rounding up on a carry unless at 255
 			 */
 			asm volatile(
-					"		in %0,%2		\n\t"
-					"		or %3,%0		\n\t"
-					"		and %4,%0		\n\t"
-					"olop%=:subi %A6,1		\n\t"	// 9
-					"		sbci %B6,0		\n\t"	// 10
-					"		brcs exit%=		\n\t"	// 11
-					"		ld %1,X+		\n\t"	// 13
-					"		ldi %0,8		\n\t"	// 14
-
-					"loop%=:out %2, %3		\n\t"	// 1
-					"		lsl %1			\n\t"	// 2
-
-					"		brcs .+2		\n\t"	// 3nt / 4t
-					"		out %2, %4		\n\t"	// 4
-					"		dec %0			\n\t"	// 5
-					"		out %2, %4		\n\t"	// 6
-					"		breq olop%=		\n\t"	// 7nt / 8t
-					"		nop				\n\t"	// 8
-					"		rjmp loop%=		\n\t"	// 10
-					"exit%=:				\n\t"
-					: "=&d" (bitCount)
-					: "r" (currentByte), "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "r" (masklo), "x" (data), "r" (remaining)
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		ld %[raw], %a[data]+	\n\t"	// 3
+					"		movw %A[saved], %A[error]	\n\t"	// 4
+					"		movw %A[error], %A[table]	\n\t"	// 5
+					"		nop	\n\t"	// 6
+					"		sbrs %[byte], 7	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		add %A[error], %[raw]	\n\t"	// 9
+					"		adc %B[error], __zero_reg__	\n\t"	// 10
+					"		add %A[error], %[raw]	\n\t"	// 11
+					"		adc %B[error], __zero_reg__	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		lpm %[frac], Z+	\n\t"	// 18
+					"		lpm %[raw], Z	\n\t"	// 21
+					"		movw %A[error], %A[saved]	\n\t"	// 22
+					"		mov %[next], %[frac]	\n\t"	// 23
+					"		swap %[next]	\n\t"	// 24
+					"		andi %[next], 0x0f	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		swap %[raw]	\n\t"	// 2
+					"		or %[next], %[raw]	\n\t"	// 3
+					"		andi %[frac], 0x0f	\n\t"	// 4
+					"		ld %[err], Z	\n\t"	// 6
+					"		sbrs %[byte], 6	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		sbrc %[odd], 0	\n\t"	// 9
+					"		swap %[err]	\n\t"	// 10
+					"		mov %[acc], %[err]	\n\t"	// 11
+					"		andi %[acc], 0x0f	\n\t"	// 12
+					"		add %[acc], %[frac]	\n\t"	// 13
+					"		andi %[err], 0xf0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		mov %[frac], %[acc]	\n\t"	// 16
+					"		andi %[frac], 0x0f	\n\t"	// 17
+					"		or %[err], %[frac]	\n\t"	// 18
+					"		sbrc %[odd], 0	\n\t"	// 19
+					"		swap %[err]	\n\t"	// 20
+					"		st Z, %[err]	\n\t"	// 22
+					"		add %A[error], %[odd]	\n\t"	// 23
+					"		adc %B[error], __zero_reg__	\n\t"	// 24
+					"		com %[odd]	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		andi %[odd], 0x01	\n\t"	// 2
+					"		swap %[acc]	\n\t"	// 3
+					"		andi %[acc], 0x01	\n\t"	// 4
+					"		add %[next], %[acc]	\n\t"	// 5
+					"		sbc %[next], __zero_reg__	\n\t"	// 6
+					"		sbrs %[byte], 5	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		rjmp .+0	\n\t"	// 10
+					"		rjmp .+0	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		rjmp .+0	\n\t"	// 21
+					"		rjmp .+0	\n\t"	// 23
+					"		rjmp .+0	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		nop	\n\t"	// 6
+					"		sbrs %[byte], 4	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		rjmp .+0	\n\t"	// 10
+					"		rjmp .+0	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		rjmp .+0	\n\t"	// 21
+					"		rjmp .+0	\n\t"	// 23
+					"		rjmp .+0	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		nop	\n\t"	// 6
+					"		sbrs %[byte], 3	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		rjmp .+0	\n\t"	// 10
+					"		rjmp .+0	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		rjmp .+0	\n\t"	// 21
+					"		rjmp .+0	\n\t"	// 23
+					"		rjmp .+0	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		nop	\n\t"	// 6
+					"		sbrs %[byte], 2	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		rjmp .+0	\n\t"	// 10
+					"		rjmp .+0	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		rjmp .+0	\n\t"	// 21
+					"		rjmp .+0	\n\t"	// 23
+					"		rjmp .+0	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		nop	\n\t"	// 6
+					"		sbrs %[byte], 1	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		rjmp .+0	\n\t"	// 10
+					"		rjmp .+0	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		rjmp .+0	\n\t"	// 21
+					"		rjmp .+0	\n\t"	// 23
+					"		rjmp .+0	\n\t"	// 25
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		nop	\n\t"	// 6
+					"		sbrs %[byte], 0	\n\t"	// 7l / 8h
+					"		out %[port], %[lo]	\n\t"	// 8l / -
+					"		rjmp .+0	\n\t"	// 10
+					"		rjmp .+0	\n\t"	// 12
+					"		rjmp .+0	\n\t"	// 14
+					"		out %[port], %[lo]	\n\t"	// 15
+					: [next] "=&d" (nextByte), [raw] "=&r" (raw), [frac] "=&d" (frac), [err] "=&d" (err),
+					  [acc] "=&d" (acc), [saved] "=&r" (saved), [data] "+x" (next), [error] "+z" (error),
+					  [odd] "+d" (odd)
+					: [port] "I" (dataPinOut - __SFR_OFFSET), [hi] "r" (maskhi), [lo] "r" (masklo),
+					  [byte] "r" (currentByte), [table] "r" (table)
 			);
-#elif F_CPU ==  4000000
-			/* The total length of each bit is 1.25us (5 cycles @ 4Mhz)
-			 * * At 0us the dataline is pulled high. (cycle 0+1)
-			 * * To send a zero the dataline is pulled low after 0.5us (spec: 0.375us) (2+1=3 cycles).
-			 * * To send a one the dataline is pulled low after 0.75us (spec: 0.625us) (3+1=4 cycles).
-			 *
-			 * The timing of this implementation is slightly off, however it seems to
-			 * work empirically.
-			 * Final timing:
-			 * * 5 cycles for bits 7-1
-			 * * 6 cycles for bit 0
-			 * - The bit 0 timing exceeds the 1.25us timing by 250ns, which is still within
-			 * the tolerances stated in the datasheet (600 ns).
+#else
+			/* The timing of writeSegment, 20 cycles per bit with the line pulled low after 6 cycles
+			 * for a zero and 10 for a one. The rest of each bit works through Strip::ditherByte for
+			 * the next byte, as for 20MHz
 			 */
 			asm volatile(
-					"		ld %0,X				\n\t"
-
-					"olop%=:out %2, %3			\n\t"	// 1
-					"		sbrs %0,7			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		subi r26,-1			\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %0,6			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		sbci r27,-1			\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %0,5			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		mov %1,%0			\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %1,4			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		nop 				\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %1,3			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		nop					\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %1,2			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		ld %0,X				\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %1,1			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-					"		dec %5				\n\t"	// 5
-
-					"		out %2, %3			\n\t"	// 1
-					"		sbrs %1,0			\n\t"	// 2
-					"		out %2, %6			\n\t"	// 3
-					"		out %2, %6			\n\t"	// 4
-
-					"		brne olop%=			\n\t"	// 6
-
-					: "=&d" (bitCount), "=&d" (currentByte)
-					: "I" (dataPinOut - __SFR_OFFSET), "r" (maskhi), "x" (data), "r" (remaining), "r" (masklo)
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		ld %[raw], %a[data]+	\n\t"	// 3
+					"		movw %A[saved], %A[error]	\n\t"	// 4
+					"		movw %A[error], %A[table]	\n\t"	// 5
+					"		sbrs %[byte], 7	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		add %A[error], %[raw]	\n\t"	// 8
+					"		adc %B[error], __zero_reg__	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		add %A[error], %[raw]	\n\t"	// 12
+					"		adc %B[error], __zero_reg__	\n\t"	// 13
+					"		lpm %[frac], Z+	\n\t"	// 16
+					"		lpm %[raw], Z	\n\t"	// 19
+					"		movw %A[error], %A[saved]	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		mov %[next], %[frac]	\n\t"	// 2
+					"		swap %[next]	\n\t"	// 3
+					"		andi %[next], 0x0f	\n\t"	// 4
+					"		swap %[raw]	\n\t"	// 5
+					"		sbrs %[byte], 6	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		or %[next], %[raw]	\n\t"	// 8
+					"		andi %[frac], 0x0f	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		ld %[err], Z	\n\t"	// 13
+					"		sbrc %[odd], 0	\n\t"	// 14
+					"		swap %[err]	\n\t"	// 15
+					"		mov %[acc], %[err]	\n\t"	// 16
+					"		andi %[acc], 0x0f	\n\t"	// 17
+					"		add %[acc], %[frac]	\n\t"	// 18
+					"		andi %[err], 0xf0	\n\t"	// 19
+					"		mov %[frac], %[acc]	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		andi %[frac], 0x0f	\n\t"	// 2
+					"		or %[err], %[frac]	\n\t"	// 3
+					"		sbrc %[odd], 0	\n\t"	// 4
+					"		swap %[err]	\n\t"	// 5
+					"		sbrs %[byte], 5	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		st Z, %[err]	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		add %A[error], %[odd]	\n\t"	// 12
+					"		adc %B[error], __zero_reg__	\n\t"	// 13
+					"		com %[odd]	\n\t"	// 14
+					"		andi %[odd], 0x01	\n\t"	// 15
+					"		swap %[acc]	\n\t"	// 16
+					"		andi %[acc], 0x01	\n\t"	// 17
+					"		add %[next], %[acc]	\n\t"	// 18
+					"		sbc %[next], __zero_reg__	\n\t"	// 19
+					"		nop	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		sbrs %[byte], 4	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		rjmp .+0	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		rjmp .+0	\n\t"	// 13
+					"		rjmp .+0	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		nop	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		sbrs %[byte], 3	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		rjmp .+0	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		rjmp .+0	\n\t"	// 13
+					"		rjmp .+0	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		nop	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		sbrs %[byte], 2	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		rjmp .+0	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		rjmp .+0	\n\t"	// 13
+					"		rjmp .+0	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		nop	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		sbrs %[byte], 1	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		rjmp .+0	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					"		rjmp .+0	\n\t"	// 13
+					"		rjmp .+0	\n\t"	// 15
+					"		rjmp .+0	\n\t"	// 17
+					"		rjmp .+0	\n\t"	// 19
+					"		nop	\n\t"	// 20
+
+					"		out %[port], %[hi]	\n\t"	// 1
+					"		rjmp .+0	\n\t"	// 3
+					"		rjmp .+0	\n\t"	// 5
+					"		sbrs %[byte], 0	\n\t"	// 6l / 7h
+					"		out %[port], %[lo]	\n\t"	// 7l / -
+					"		rjmp .+0	\n\t"	// 9
+					"		nop	\n\t"	// 10
+					"		out %[port], %[lo]	\n\t"	// 11
+					: [next] "=&d" (nextByte), [raw] "=&r" (raw), [frac] "=&d" (frac), [err] "=&d" (err),
+					  [acc] "=&d" (acc), [saved] "=&r" (saved), [data] "+x" (next), [error] "+z" (error),
+					  [odd] "+d" (odd)
+					: [port] "I" (dataPinOut - __SFR_OFFSET), [hi] "r" (maskhi), [lo] "r" (masklo),
+					  [byte] "r" (currentByte), [table] "r" (table)
 			);
+#endif
+			currentByte = nextByte;
+			if (next == end) {
+				next = data;
+				error = Strip::ditherError(0);
+				odd = 0;
+			}
+		}
+
+		writeSegment(&currentByte, 1, maskhi, masklo);
 #else
-#error Clock speed not supported
+		static_assert(!dither, "WS2811 dithering needs the 16MHz or 20MHz output loop");
 #endif
+	} // void writeDithered()
+
+public:
+	/**
+	 * Constructor
+	 */
+	WS2811() {
+		setOutput(FLAME_PIN_PARMS(dataPin));
+		pinOff(FLAME_PIN_PARMS(dataPin));
+	}
+
+	/**
+	 * Write the current buffer to the string of chips
+	 * The buffer is a ring starting at _start, so it is sent as 2 segments. The gap between
+	 * them is a few cycles, well short of the reset time.
+	 * A dithered strip is sent in one pass, wrapping between bytes.
+	 */
+	void flush() {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			uint8_t masklo = _MMIO_BYTE(dataPinOut) & ~_BV(dataPinPin);
+			uint8_t maskhi = _MMIO_BYTE(dataPinOut) | _BV(dataPinPin);
+			uint16_t start = Strip::_start;
+			uint8_t *data = (uint8_t *)Strip::_data;
+
+			if (dither) {
+				writeDithered(data, start * 3, maskhi, masklo);
+			} else {
+				writeSegment(data + start * 3, (length - start) * 3, maskhi, masklo);
+				if (start) {
+					writeSegment(data, start * 3, maskhi, masklo);
+				}
+			}
 		} // ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	} // void flush()
 };
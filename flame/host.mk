@@ -0,0 +1,32 @@
+# Include this file in a flame-test-* project Makefile to build and run it on the host instead of a microcontroller
+#
+# The headers in $(LIBDIR)/host stand in for avr-libc, with the IO registers mapped to an array,
+# and for the parts of Device_TX the displays need.
+# Library sources the test needs should be listed in EXTRA_SRCS.
+#
+LIBDIR ?= "../flame"
+MHZ ?= 16
+HZ ?= $(MHZ)000000
+
+SRCS = $(wildcard *.cpp) $(EXTRA_SRCS) $(LIBDIR)/host/HostIO.cpp
+
+HOSTCXX ?= g++
+
+CPPFLAGS += -I"." -I"$(LIBDIR)/host" -I"$(LIBDIR)" -I"$(LIBDIR)/flame" -Wall -Wno-class-memaccess -g -O2 -funsigned-char -DF_CPU=$(HZ)UL
+
+CXXFLAGS += -std=gnu++11
+
+RM := rm -rf
+
+all: test
+
+$(PROJECT): $(SRCS)
+	$(HOSTCXX) $(CPPFLAGS) $(CXXFLAGS) -o "$@" $(SRCS)
+
+test: $(PROJECT)
+	./$(PROJECT)
+
+clean:
+	-$(RM) $(PROJECT)
+
+.PHONY: all test clean
@@ -0,0 +1,7 @@
+/* IO registers and hooks for building flame-test-* projects on the host (see host.mk)
+ */
+#include <avr/io.h>
+#include <util/delay_basic.h>
+
+volatile uint8_t hostIO[65536];
+void (*hostDelayHook)(uint16_t loops) = 0;
@@ -0,0 +1,42 @@
+#pragma once
+/* Minimal checks for flame-test-* projects built on the host (see host.mk)
+ * Each failed check is printed, and hostTestResult() gives the exit status for main()
+ */
+#include <stdio.h>
+#include <stdarg.h>
+
+static int hostTestFailures = 0;
+
+/**
+ * Check a condition
+ * @param	passed		true if the check passed
+ * @param	format		a printf format describing the check
+ */
+static inline void check(bool passed, const char *format, ...) {
+	va_list args;
+
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+
+	if (passed) {
+		printf(": OK\n");
+	} else {
+		printf(": FAILED\n");
+		hostTestFailures++;
+	}
+}
+
+/**
+ * Report the test results
+ * @return the exit status for main()
+ */
+static inline int hostTestResult() {
+	if (hostTestFailures) {
+		printf("%d checks FAILED\n", hostTestFailures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+/* Host stand-in for <avr/cpufunc.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
+#define _NOP()
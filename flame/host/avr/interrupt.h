@@ -0,0 +1,8 @@
+#pragma once
+/* Host stand-in for <avr/interrupt.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
+#define ISR(v, ...) extern "C" void v(void)
+#define sei()
+#define cli()
+#define ISR_NOBLOCK
+#define ISR_BLOCK
@@ -0,0 +1,187 @@
+#pragma once
+/* Host stand-in for <avr/io.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
+#include <stdint.h>
+// io.h includes avr/pgmspace.h inside namespace flame, so bring in what the host pgmspace.h needs here first
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef __AVR_ATmega328P__
+#define __AVR_ATmega328P__
+#endif
+extern volatile uint8_t hostIO[65536];
+#define _MMIO_BYTE(a) (hostIO[(uintptr_t)(a) & 0xffff])
+#define _MMIO_WORD(a) (*(volatile uint16_t *)&hostIO[(uintptr_t)(a) & 0xffff])
+#define _SFR_MEM8(a) _MMIO_BYTE(a)
+#define _SFR_MEM16(a) _MMIO_WORD(a)
+#define _SFR_IO8(a) _MMIO_BYTE((a)+0x20)
+#define __SFR_OFFSET 0x20
+#define _BV(b) (1 << (b))
+#define _SFR_IO_ADDR(a) (0)
+#define _SFR_MEM_ADDR(a) (0)
+#define RXEN0 4
+#define TXEN0 3
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRE0 5
+#define U2X0 1
+#define SPCR _SFR_IO8(0x2C)
+#define SPSR _SFR_IO8(0x2D)
+#define SPDR _SFR_IO8(0x2E)
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define SPI2X 0
+#define ADCSRA _SFR_MEM8(0x7A)
+#define ADCSRB _SFR_MEM8(0x7B)
+#define ADMUX _SFR_MEM8(0x7C)
+#define ADC _SFR_MEM16(0x78)
+#define ADCL _SFR_MEM8(0x78)
+#define ADCH _SFR_MEM8(0x79)
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define DIDR0 _SFR_MEM8(0x7E)
+#define PRR _SFR_MEM8(0x64)
+#define PRADC 0
+#define TWBR _SFR_MEM8(0xB8)
+#define TWSR _SFR_MEM8(0xB9)
+#define TWDR _SFR_MEM8(0xBB)
+#define TWCR _SFR_MEM8(0xBC)
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWEN 2
+#define TWIE 0
+#define EICRA _SFR_MEM8(0x69)
+#define EIMSK _SFR_IO8(0x1D)
+#define ISC00 0
+#define ISC10 2
+#define INT0 0
+#define INT1 1
+#define TCCR1A _SFR_MEM8(0x80)
+#define TCCR1B _SFR_MEM8(0x81)
+#define TIMSK1 _SFR_MEM8(0x6F)
+#define TIFR1 _SFR_IO8(0x16)
+#define OCR1A _SFR_MEM16(0x88)
+#define OCR1B _SFR_MEM16(0x8A)
+#define ICR1 _SFR_MEM16(0x86)
+#define TCNT1 _SFR_MEM16(0x84)
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define COM1A0 6
+#define COM1A1 7
+#define COM1B0 4
+#define COM1B1 5
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOIE1 0
+#define UCSR0A _SFR_MEM8(0xC0)
+#define UCSR0B _SFR_MEM8(0xC1)
+#define UCSR0C _SFR_MEM8(0xC2)
+#define UBRR0 _SFR_MEM16(0xC4)
+#define UDR0 _SFR_MEM8(0xC6)
+#define UMSEL00 6
+#define UMSEL01 7
+#define UCPHA0 1
+#define UCPOL0 0
+#define UDORD0 2
+#define TXC0 6
+#define RXC0 7
+#define UDRIE0 5
+#define RAMEND 0x8FF
+#define SREG _SFR_IO8(0x3F)
+#define INT0_vect __vector_1
+#define INT1_vect __vector_2
+#define SPI_STC_vect __vector_17
+#define ADC_vect __vector_21
+#define TWI_vect __vector_24
+#define USART_RX_vect __vector_18
+#define USART_TX_vect __vector_20
+#define USART_UDRE_vect __vector_19
+#define TIMER0_COMPA_vect __vector_14
+#define TIMER0_COMPB_vect __vector_15
+#define TIMER1_COMPA_vect __vector_11
+#define TIMER1_COMPB_vect __vector_12
+#define TIMER2_COMPA_vect __vector_7
+#define TIMER2_COMPB_vect __vector_8
+#define WGM00 0
+#define WGM01 1
+#define WGM02 3
+#define WGM20 0
+#define WGM21 1
+#define WGM22 3
+#define COM0A0 6
+#define COM0A1 7
+#define COM0B0 4
+#define COM0B1 5
+#define COM2A0 6
+#define COM2A1 7
+#define COM2B0 4
+#define COM2B1 5
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define TCCR0A _SFR_IO8(0x24)
+#define TCCR0B _SFR_IO8(0x25)
+#define TCNT0 _SFR_IO8(0x26)
+#define OCR0A _SFR_IO8(0x27)
+#define OCR0B _SFR_IO8(0x28)
+#define TIMSK0 _SFR_MEM8(0x6E)
+#define TIFR0 _SFR_IO8(0x15)
+#define TCCR2A _SFR_MEM8(0xB0)
+#define TCCR2B _SFR_MEM8(0xB1)
+#define TCNT2 _SFR_MEM8(0xB2)
+#define OCR2A _SFR_MEM8(0xB3)
+#define OCR2B _SFR_MEM8(0xB4)
+#define TIMSK2 _SFR_MEM8(0x70)
+#define OCF1A 1
+#define OCF1B 2
+#define TOV1 0
+#define ICF1 5
+#define PCMSK0 _SFR_MEM8(0x6B)
+#define PCMSK1 _SFR_MEM8(0x6C)
+#define PCMSK2 _SFR_MEM8(0x6D)
+#define PCICR _SFR_MEM8(0x68)
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCINT0_vect __vector_3
+#define PCINT1_vect __vector_4
+#define PCINT2_vect __vector_5
+#define EECR _SFR_IO8(0x1F)
+#define EEDR _SFR_IO8(0x20)
+#define EEAR _SFR_IO8(0x21)
+#define EEPE 1
+#define EEMPE 2
+#define EERE 0
+#define EERIE 3
+#define EE_READY_vect __vector_22
+#define PORTB _SFR_IO8(0x05)
+#define DDRB _SFR_IO8(0x04)
+#define PINB _SFR_IO8(0x03)
+#define PORTC _SFR_IO8(0x08)
+#define PORTD _SFR_IO8(0x0B)
+#define DDRD _SFR_IO8(0x0A)
+#include <avr/sfr_defs.h>
@@ -0,0 +1,12 @@
+#pragma once
+/* Host stand-in for <avr/sfr_defs.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
+#include <avr/io.h>
+#ifndef loop_until_bit_is_set
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define loop_until_bit_is_set(sfr, bit) do { } while (!bit_is_set(sfr, bit))
+#endif
+#ifndef loop_until_bit_is_clear
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_clear(sfr, bit) do { } while (bit_is_set(sfr, bit))
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+/* Host stand-in for <flame/Device_TX.h>, used to build flame-test-* projects on the host (see host.mk)
+ * The displays are written against the TXBuffer interface, this provides just enough of it for
+ * the drawing code to build. There are never any buffers to send.
+ */
+#include <stdint.h>
+#include <flame/io.h>
+
+namespace flame {
+
+class TXBuffer {
+public:
+	uint16_t getPosition() {
+		return 0;
+	}
+	void seek(UNUSED uint16_t position) {}
+	int nextCharacter() {
+		return -1;
+	}
+	bool hasMore() {
+		return false;
+	}
+};
+
+class Device_TX {
+protected:
+	TXBuffer	_currentTx;
+
+	bool moreTX() {
+		return false;
+	}
+};
+
+template<uint8_t txCount>
+class Device_TXImplementation : public Device_TX {
+};
+
+}
@@ -0,0 +1,8 @@
+#pragma once
+/* Host stand-in for <util/atomic.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define NONATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(t) for (int _ab = 1; _ab; _ab = 0)
+#define NONATOMIC_BLOCK(t) for (int _ab = 1; _ab; _ab = 0)
@@ -0,0 +1,3 @@
+#pragma once
+/* Host stand-in for <util/crc16.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
@@ -0,0 +1,6 @@
+#pragma once
+/* Host stand-in for <util/delay.h>, used to build flame-test-* projects on the host (see host.mk)
+ */
+#include <util/delay_basic.h>
+static inline void _delay_us(double) {}
+static inline void _delay_ms(double) {}
@@ -0,0 +1,8 @@
+#pragma once
+/* Host stand-in for <util/delay_basic.h>, used to build flame-test-* projects on the host (see host.mk)
+ * Delay loops call hostDelayHook if it is set, so tests can check what happens around them
+ */
+#include <stdint.h>
+extern void (*hostDelayHook)(uint16_t loops);
+static inline void _delay_loop_1(uint8_t loops) { if (hostDelayHook) hostDelayHook(loops ? loops : 256); }
+static inline void _delay_loop_2(uint16_t loops) { if (hostDelayHook) hostDelayHook(loops); }